@@ -25,6 +25,19 @@ target_link_libraries(
         llama
 )
 
+# Keep the static cJSON private to the backend, so its allocator hooks never
+# reach a host that links cJSON itself
+if (CMAKE_SYSTEM_NAME STREQUAL "Linux")
+    target_link_options(wasi_nn_backend PRIVATE "LINKER:--exclude-libs,libcjson.a")
+endif ()
+
+# Optional: deflate for offloaded KV snapshots
+find_package(ZLIB)
+if (ZLIB_FOUND)
+    target_compile_definitions(wasi_nn_backend PRIVATE WASI_NN_HAVE_ZLIB=1)
+    target_link_libraries(wasi_nn_backend PRIVATE ZLIB::ZLIB)
+endif ()
+
 # Install
 install(TARGETS wasi_nn_backend
     LIBRARY DESTINATION lib
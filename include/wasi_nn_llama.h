@@ -48,6 +48,8 @@ extern "C" {
 	 context_full = 101,     // Context Full.
 	 prompt_tool_long = 102, // Prompt Too Long.
 	 model_not_found = 103,  // Model Not Found.
+	 cancelled = 104,        // Inference cancelled by cancel_inference().
+	 session_evicted = 105,  // Session evicted by the memory governor.
  } wasi_nn_error;
  
  /**
@@ -179,6 +181,133 @@ extern "C" {
 		   tensor *input_tensor, tensor_data output_tensor, uint32_t *output_tensor_size,
 		   const char *runtime_config, uint32_t config_len);
 
+ // Streaming token delivery.
+ //
+ // The callback receives each generated text piece as soon as it is sampled.
+ // Pieces always end on a UTF-8 character boundary and never contain (a prefix
+ // of) a stop sequence. Return false from the callback to stop generation early;
+ // the text delivered so far is kept as the assistant turn.
+ typedef bool (*wasi_nn_stream_callback)(const char *piece, uint32_t piece_len,
+		   void *user_data);
+
+ __attribute__((visibility("default"))) wasi_nn_error
+ run_inference_stream(void *ctx, graph_execution_context exec_ctx, uint32_t index,
+		   tensor *input_tensor, const char *runtime_config, uint32_t config_len,
+		   wasi_nn_stream_callback callback, void *user_data);
+
+ // Cancellation of the turn in progress on a session.
+ //
+ // The run_inference, run_inference_stream or get_output call serving the turn
+ // returns `cancelled` promptly: generation stops at the next decode step (or
+ // prompt chunk) and the text generated so far is written to the output as
+ // usual and kept as the assistant turn. A turn still queued returns
+ // `cancelled` without output. A request made while no turn is running is
+ // dropped when the next turn is submitted.
+ __attribute__((visibility("default"))) wasi_nn_error
+ cancel_inference(void *ctx, graph_execution_context exec_ctx);
+
+ // Batched inference over independent single-turn prompts.
+ //
+ // input_tensors, output_tensors and output_tensor_sizes hold batch_size
+ // entries; output_tensor_sizes[i] is the capacity of output_tensors[i] on
+ // input and the full response length on output. runtime_configs/config_lens
+ // are optional per-item JSON configs (either array or entry may be NULL).
+ // Items are decoded together and are not added to the session history.
+ __attribute__((visibility("default"))) wasi_nn_error
+ run_inference_batch(void *ctx, graph_execution_context exec_ctx, uint32_t batch_size,
+		   tensor *input_tensors, tensor_data *output_tensors, uint32_t *output_tensor_sizes,
+		   const char **runtime_configs, const uint32_t *config_lens);
+
+ // Speculative decoding statistics.
+ //
+ // Counters cover one session, or the whole backend when exec_ctx is 0.
+ // speedup is generated tokens per target-model decode step (1.0 without a
+ // draft model); tokens_per_second is measured over the generation phase.
+ typedef struct {
+	 bool enabled;                 // a draft model is loaded
+	 uint64_t n_draft_tokens;      // tokens proposed by the draft model
+	 uint64_t n_draft_accepted;    // proposals accepted by the target model
+	 uint64_t n_generated_tokens;  // all generated tokens
+	 double acceptance_rate;       // n_draft_accepted / n_draft_tokens
+	 double speedup;
+	 double tokens_per_second;
+ } wasi_nn_speculative_stats;
+
+ __attribute__((visibility("default"))) wasi_nn_error
+ get_speculative_stats(void *ctx, graph_execution_context exec_ctx,
+		   wasi_nn_speculative_stats *stats);
+
+ // Backend statistics.
+ //
+ // KV figures come from the llama memory API: the positions spanned by one
+ // session's sequence, or by all sequences when exec_ctx is 0 (cells shared
+ // between sequences count once per sequence). A span is an upper bound on the
+ // cells a sequence holds, since positions removed from its middle still count.
+ // Byte figures use the K and V size of one token over all layers. Prompt
+ // counters cover the selected session or all open sessions. Offload, arena and
+ // task queue figures always cover the whole backend.
+ typedef struct {
+	 uint32_t n_sessions;                  // open sessions
+	 uint32_t n_sessions_bound;            // sessions holding a KV sequence
+	 uint32_t n_slots;                     // parallel decoding slots
+	 uint32_t kv_cells_total;              // KV cache size in tokens
+	 uint64_t kv_tokens_spanned;
+	 uint64_t kv_bytes_per_token;
+	 uint64_t kv_bytes_spanned;
+	 uint64_t kv_bytes_total;
+	 double kv_usage;                      // kv_tokens_spanned / kv_cells_total (upper bound)
+	 uint64_t n_prompt_tokens;             // prompt tokens submitted
+	 uint64_t n_prompt_tokens_reused;      // of which served from the KV cache
+	 uint64_t prefix_cache_hits;
+	 uint64_t prefix_cache_misses;
+	 uint64_t prefix_cache_tokens_shared;  // prefill tokens saved by shared prefixes
+	 uint64_t memory_usage_bytes;          // anonymous memory of the cgroup, or of the process
+	 uint64_t memory_limit_bytes;          // cgroup or configured limit, 0 = none
+	 uint32_t memory_pressure_level;       // 0 none, 1 elevated, 2 critical
+	 uint32_t n_sessions_kv_ram;           // idle sessions offloaded to a RAM snapshot
+	 uint32_t n_sessions_kv_disk;          // idle sessions offloaded to disk
+	 uint64_t kv_offload_ram_bytes;        // RAM held by snapshots (after compression)
+	 uint64_t kv_offload_restores;         // turns resumed from an offloaded snapshot
+	 uint64_t arena_requests;              // runtime configs parsed in a request arena
+	 uint64_t arena_heap_allocs;           // arena blocks taken from the heap
+	 uint64_t arena_peak_bytes;            // largest arena use of one request
+	 uint64_t scratch_reallocs;            // reused reply/token buffers that had to grow
+	 uint32_t model_shared_refs;           // backends sharing this model's weights, 0 = loaded privately
+	 uint64_t admission_waits;             // turns that waited for KV space
+	 uint64_t admission_evictions;         // idle sessions evicted to admit another turn
+	 uint64_t admission_rejections;        // turns and sessions refused (context_full / too_large)
+	 double kv_fragmentation;              // estimated share of holes in the used part of the KV cache
+	 uint64_t kv_compactions;              // idle-time compactions run
+	 double kv_fragmentation_before_compaction;  // at the last compaction
+	 double kv_fragmentation_after_compaction;
+	 double kv_compaction_ms;              // duration of the last compaction
+	 uint64_t context_shifts;              // KV sequences shifted before a turn or while generating
+	 uint32_t tasks_pending;               // turns waiting in the task queue
+	 uint64_t tasks_completed;             // turns run by the task processors
+	 uint64_t tasks_timed_out;             // turns still queued at their deadline_ms, else default_task_timeout_ms
+	 uint64_t tasks_rejected;              // turns refused at queue_reject_threshold
+	 uint64_t tasks_preempted;             // running turns parked at a token boundary for URGENT work
+	 uint32_t tasks_active;                // turns claimed by a task processor and still running
+	 uint64_t tasks_cancelled;             // queued turns answered without running (cancel_inference, shutdown)
+ } wasi_nn_backend_stats;
+
+ __attribute__((visibility("default"))) wasi_nn_error
+ get_backend_stats(void *ctx, graph_execution_context exec_ctx,
+		   wasi_nn_backend_stats *stats);
+
+ // Session persistence.
+ //
+ // Requires "session_cache_dir" in the backend config. The chat history and the
+ // KV state of the session are written to files keyed by session ID and model
+ // version. Restoring loads the history now and the KV state on the next turn,
+ // so a resumed conversation is not prefilled again. restore_session_state
+ // returns not_found when nothing was saved for this session and model.
+ __attribute__((visibility("default"))) wasi_nn_error
+ save_session_state(void *ctx, graph_execution_context exec_ctx);
+
+ __attribute__((visibility("default"))) wasi_nn_error
+ restore_session_state(void *ctx, graph_execution_context exec_ctx);
+
  // Additional API functions
  __attribute__((visibility("default"))) wasi_nn_error
  init_backend_with_config(void **ctx, const char *config, uint32_t config_len);
@@ -30,6 +30,8 @@ enum stop_type
     STOP_TYPE_EOS,
     STOP_TYPE_WORD,
     STOP_TYPE_LIMIT,
+    STOP_TYPE_DEADLINE, // custom: the caller's deadline passed
+    STOP_TYPE_CANCELLED, // custom: the caller cancelled the task
 };
 
 // state diagram: https://github.com/ggml-org/llama.cpp/pull/9283
@@ -75,6 +77,8 @@ enum error_type
     ERROR_TYPE_PERMISSION,
     ERROR_TYPE_UNAVAILABLE,   // custom error
     ERROR_TYPE_NOT_SUPPORTED, // custom error
+    ERROR_TYPE_TIMEOUT,       // custom error
+    ERROR_TYPE_CANCELLED,     // custom error
 };
 
 static bool server_task_type_need_embd(server_task_type task_type)
@@ -114,6 +118,11 @@ struct slot_params
 
     int64_t t_max_prompt_ms = -1;  // TODO: implement
     int64_t t_max_predict_ms = -1; // if positive, limit the generation phase to this time limit
+    int64_t t_deadline_us = 0;     // if positive, ggml_time_us() at which the task is abandoned
+    int32_t priority = 0;          // custom: scheduling priority, see server_context::preempt_priority
+
+    // custom: raised by the caller to stop the task at the next token or prompt chunk
+    std::shared_ptr<std::atomic<bool>> cancel_flag;
 
     std::vector<common_adapter_lora_info> lora;
 
@@ -671,6 +680,10 @@ inline std::string stop_type_to_str(stop_type type)
         return "word";
     case STOP_TYPE_LIMIT:
         return "limit";
+    case STOP_TYPE_DEADLINE:
+        return "deadline";
+    case STOP_TYPE_CANCELLED:
+        return "cancelled";
     default:
         return "none";
     }
@@ -1257,6 +1270,14 @@ static json format_error_response(const std::string &message, const enum error_t
         type_str = "unavailable_error";
         code = 503;
         break;
+    case ERROR_TYPE_TIMEOUT:
+        type_str = "timeout_error";
+        code = 408;
+        break;
+    case ERROR_TYPE_CANCELLED:
+        type_str = "cancelled_error";
+        code = 499;
+        break;
     }
     return json{
         {"code", code},
@@ -1444,6 +1465,7 @@ struct server_slot
     bool has_next_token = true;
     bool has_new_line = false;
     bool truncated = false;
+    bool parked = false; // custom: preempted by higher-priority work, sits out decode steps
     stop_type stop;
 
     std::string stopping_word;
@@ -1482,6 +1504,7 @@ struct server_slot
         generated_text = "";
         has_new_line = false;
         truncated = false;
+        parked = false;
         stop = STOP_TYPE_NONE;
         stopping_word = "";
         n_past = 0;
@@ -1549,6 +1572,20 @@ struct server_slot
         return state != SLOT_STATE_IDLE;
     }
 
+    // custom: why the task has to stop early, STOP_TYPE_NONE while it may go on
+    stop_type interrupted() const
+    {
+        if (params.cancel_flag && params.cancel_flag->load(std::memory_order_relaxed))
+        {
+            return STOP_TYPE_CANCELLED;
+        }
+        if (params.t_deadline_us > 0 && ggml_time_us() >= params.t_deadline_us)
+        {
+            return STOP_TYPE_DEADLINE;
+        }
+        return STOP_TYPE_NONE;
+    }
+
     bool can_speculate() const
     {
         return ctx_dft && params.speculative.n_max > 0 && params.cache_prompt;
@@ -1765,7 +1802,7 @@ struct server_metrics
 struct server_queue
 {
     int id = 0;
-    bool running;
+    bool running = false;
 
     // queues
     std::deque<server_task> queue_tasks;
@@ -1889,7 +1926,8 @@ struct server_queue
      */
     void start_loop()
     {
-        running = true;
+        // note: running is armed by the owner before the loop thread is spawned,
+        //       so a terminate() issued before the thread gets here is not lost
 
         while (true)
         {
@@ -1944,7 +1982,8 @@ private:
         // no need lock because this is called exclusively by post()
         auto rm_func = [id_target](const server_task &task)
         {
-            return task.id_target == id_target;
+            // drop both the queued task itself and any other task aimed at it
+            return task.id == id_target || task.id_target == id_target;
         };
         queue_tasks.erase(
             std::remove_if(queue_tasks.begin(), queue_tasks.end(), rm_func),
@@ -2020,12 +2059,14 @@ struct server_response
         {
             std::unique_lock<std::mutex> lock(mutex_results);
             condition_results.wait(lock, [&]
-                                   {
-                if (!running) {
-                    SRV_DBG("%s : queue result stop\n", __func__);
-                    std::terminate(); // we cannot return here since the caller is HTTP code
-                }
-                return !queue_results.empty(); });
+                                   { return !running || !queue_results.empty(); });
+
+            if (!running)
+            {
+                // the backend is shutting down - the caller handles the missing result
+                SRV_DBG("%s : queue result stop\n", __func__);
+                return nullptr;
+            }
 
             for (size_t i = 0; i < queue_results.size(); i++)
             {
@@ -2063,7 +2104,7 @@ struct server_response
             if (!running)
             {
                 SRV_DBG("%s : queue result stop\n", __func__);
-                std::terminate(); // we cannot return here since the caller is HTTP code
+                return nullptr;
             }
             if (cr_res == std::cv_status::timeout)
             {
@@ -2108,10 +2149,95 @@ struct server_response
     }
 };
 
+// Build a context on an already loaded model; the parts of common_init_from_params()
+// that do not load weights. The caller keeps the model alive.
+static common_init_result common_init_from_model(common_params &params, llama_model *model)
+{
+    common_init_result iparams;
+
+    const llama_vocab *vocab = llama_model_get_vocab(model);
+
+    auto cparams = common_context_params_to_llama(params);
+    llama_context *lctx = llama_init_from_model(model, cparams);
+    if (lctx == nullptr)
+    {
+        SRV_ERR("failed to create context with model '%s'\n", params.model.path.c_str());
+        return iparams;
+    }
+    iparams.context.reset(lctx);
+
+    if (params.ctx_shift && !llama_memory_can_shift(llama_get_memory(lctx)))
+    {
+        SRV_WRN("%s\n", "KV cache shifting is not supported for this context, disabling KV cache shifting");
+        params.ctx_shift = false;
+    }
+
+    // adapters belong to this context; the shared weights stay untouched
+    for (auto &la : params.lora_adapters)
+    {
+        llama_adapter_lora_ptr lora;
+        lora.reset(llama_adapter_lora_init(model, la.path.c_str()));
+        if (lora == nullptr)
+        {
+            SRV_ERR("failed to apply lora adapter '%s'\n", la.path.c_str());
+            iparams.context.reset();
+            return iparams;
+        }
+        la.ptr = lora.get();
+        iparams.lora.emplace_back(std::move(lora));
+    }
+
+    if (!params.lora_init_without_apply)
+    {
+        common_set_adapter_lora(lctx, params.lora_adapters);
+    }
+
+    if (llama_vocab_eos(vocab) == LLAMA_TOKEN_NULL)
+    {
+        params.sampling.ignore_eos = false;
+    }
+
+    params.sampling.logit_bias_eog.clear();
+    for (llama_token i = 0; i < llama_vocab_n_tokens(vocab); i++)
+    {
+        if (llama_vocab_is_eog(vocab, i))
+        {
+            params.sampling.logit_bias_eog.push_back({i, -INFINITY});
+        }
+    }
+
+    if (params.sampling.ignore_eos)
+    {
+        params.sampling.logit_bias.insert(params.sampling.logit_bias.end(),
+                                          params.sampling.logit_bias_eog.begin(), params.sampling.logit_bias_eog.end());
+    }
+
+    if (params.sampling.penalty_last_n == -1)
+    {
+        params.sampling.penalty_last_n = llama_n_ctx(lctx);
+    }
+
+    if (params.sampling.dry_penalty_last_n == -1)
+    {
+        params.sampling.dry_penalty_last_n = llama_n_ctx(lctx);
+    }
+
+    // no warmup: the weights were paged in by whoever loaded the model
+    return iparams;
+}
+
 struct server_context
 {
     common_params params_base;
 
+    // Optional source of already loaded models (e.g. shared between contexts).
+    // When set, load_model() takes weights from it and only creates contexts.
+    std::function<std::shared_ptr<llama_model>(common_params &)> model_provider;
+
+    // note: declared before llama_init so the shared weights outlive the contexts
+    std::shared_ptr<llama_model> model_shared;
+    std::shared_ptr<llama_model> model_dft_shared;
+
     // note: keep these alive - they determine the lifetime of the model, context, etc.
     common_init_result llama_init;
     common_init_result llama_init_dft;
@@ -2130,6 +2256,16 @@ struct server_context
     bool clean_kv_cache = true;
     bool add_bos_token = true;
 
+    // custom: while a slot with at least this priority is processing, slots of
+    // lower priority are parked at token boundaries (-1 = never preempt)
+    int32_t preempt_priority = -1;
+    std::atomic<uint64_t> n_preemptions{0};
+
+    // custom: slots added after the n_parallel regular ones and kept for
+    // preempt_priority work, so that work never waits for a busy sequence.
+    // They share n_ctx with the regular slots, so the KV cache does not grow.
+    int32_t n_reserved_slots = 0;
+
     int32_t n_ctx; // total context for all clients / slots
 
     // slots / clients
@@ -2167,18 +2303,54 @@ struct server_context
         llama_batch_free(batch);
     }
 
+    // Load through model_provider when one is set, otherwise as llama.cpp does.
+    // shared holds the provided model and is empty for a private load.
+    common_init_result init_model(common_params &params, std::shared_ptr<llama_model> &shared)
+    {
+        shared.reset();
+        if (model_provider)
+        {
+            shared = model_provider(params);
+            if (shared)
+            {
+                common_init_result iparams = common_init_from_model(params, shared.get());
+                if (iparams.context == nullptr)
+                {
+                    shared.reset();
+                }
+                return iparams;
+            }
+        }
+        return common_init_from_params(params);
+    }
+
     bool load_model(const common_params &params)
     {
         SRV_INF("loading model '%s'\n", params.model.path.c_str());
 
         params_base = params;
 
-        llama_init = common_init_from_params(params_base);
+        // drop the draft model of a previous load so a config without one does not reuse it
+        model_dft = nullptr;
+        llama_init_dft.context.reset();
+        llama_init_dft.model.reset();
+        model_dft_shared.reset();
+
+        // contexts go before the weights they were built on
+        llama_init = common_init_result();
+        model_shared.reset();
 
-        model = llama_init.model.get();
+        // custom: the context also holds the reserved slots' sequences, within
+        // the configured n_ctx
+        common_params params_ctx = params_base;
+        params_ctx.n_parallel += n_reserved_slots;
+
+        llama_init = init_model(params_ctx, model_shared);
+
+        model = model_shared ? model_shared.get() : llama_init.model.get();
         ctx = llama_init.context.get();
 
-        if (model == nullptr)
+        if (model == nullptr || ctx == nullptr)
         {
             SRV_ERR("failed to load model, '%s'\n", params_base.model.path.c_str());
             return false;
@@ -2204,9 +2376,9 @@ struct server_context
             params_dft.cache_type_k = params_base.speculative.cache_type_k;
             params_dft.cache_type_v = params_base.speculative.cache_type_v;
 
-            llama_init_dft = common_init_from_params(params_dft);
+            llama_init_dft = init_model(params_dft, model_dft_shared);
 
-            model_dft = llama_init_dft.model.get();
+            model_dft = model_dft_shared ? model_dft_shared.get() : llama_init_dft.model.get();
 
             if (model_dft == nullptr)
             {
@@ -2287,11 +2459,12 @@ bool load_adapter(const common_params &params) {
 
     void init()
     {
-        const int32_t n_ctx_slot = n_ctx / params_base.n_parallel;
+        const int32_t n_slots = params_base.n_parallel + n_reserved_slots;
+        const int32_t n_ctx_slot = n_ctx / n_slots;
 
-        SRV_INF("initializing slots, n_slots = %d\n", params_base.n_parallel);
+        SRV_INF("initializing slots, n_slots = %d (%d reserved)\n", n_slots, n_reserved_slots);
 
-        for (int i = 0; i < params_base.n_parallel; i++)
+        for (int i = 0; i < n_slots; i++)
         {
             server_slot slot;
 
@@ -2370,6 +2543,12 @@ bool load_adapter(const common_params &params) {
         return nullptr;
     }
 
+    // custom: reserved slots only take preempt_priority work
+    bool slot_reserved_from(const server_slot &slot, const server_task &task) const
+    {
+        return slot.id >= params_base.n_parallel && task.params.priority < preempt_priority;
+    }
+
     server_slot *get_available_slot(const server_task &task)
     {
         server_slot *ret = nullptr;
@@ -2383,7 +2562,7 @@ bool load_adapter(const common_params &params) {
             for (server_slot &slot : slots)
             {
                 // skip the slot if it is not available
-                if (slot.is_processing())
+                if (slot.is_processing() || slot_reserved_from(slot, task))
                 {
                     continue;
                 }
@@ -2423,7 +2602,7 @@ bool load_adapter(const common_params &params) {
             for (server_slot &slot : slots)
             {
                 // skip the slot if it is not available
-                if (slot.is_processing())
+                if (slot.is_processing() || slot_reserved_from(slot, task))
                 {
                     continue;
                 }
@@ -2636,6 +2815,19 @@ bool load_adapter(const common_params &params) {
             }
         }
 
+        // the caller cancelled or has given up on the answer: stop at this token and keep the text so far
+        if (slot.has_next_token)
+        {
+            const stop_type interrupt = slot.interrupted();
+            if (interrupt != STOP_TYPE_NONE)
+            {
+                slot.stop = interrupt;
+                slot.has_next_token = false;
+
+                SLT_DBG(slot, "stopped (%s), n_decoded = %d\n", stop_type_to_str(interrupt).c_str(), slot.n_decoded);
+            }
+        }
+
         // check if there is a new line in the generated text
         if (result.text_to_send.find('\n') != std::string::npos)
         {
@@ -3302,6 +3494,59 @@ bool load_adapter(const common_params &params) {
         }
     }
 
+    // custom: park the slots that have to make way for higher-priority work and
+    // resume the rest. A parked slot keeps its KV cells, sampler and pending
+    // sampled token, so it continues exactly where it stopped.
+    void update_preemption()
+    {
+        int32_t top_priority = -1;
+        if (preempt_priority >= 0)
+        {
+            for (const auto &slot : slots)
+            {
+                if (slot.is_processing() && slot.params.priority >= preempt_priority)
+                {
+                    top_priority = std::max(top_priority, slot.params.priority);
+                }
+            }
+        }
+
+        for (auto &slot : slots)
+        {
+            const bool park = top_priority >= 0 && slot.is_processing() && slot.params.priority < top_priority;
+
+            // a parked generation would only notice a cancel or its deadline once resumed
+            const stop_type interrupt = park && slot.state == SLOT_STATE_GENERATING ? slot.interrupted() : STOP_TYPE_NONE;
+            if (interrupt != STOP_TYPE_NONE)
+            {
+                slot.stop = interrupt;
+                slot.has_next_token = false;
+                slot.parked = false;
+                slot.release();
+                send_final_response(slot);
+                metrics.on_prediction(slot);
+                continue;
+            }
+
+            if (park == slot.parked)
+            {
+                continue;
+            }
+
+            slot.parked = park;
+            if (park)
+            {
+                n_preemptions++;
+                SLT_INF(slot, "parked for priority %d work, n_past = %d, n_decoded = %d\n",
+                        top_priority, slot.n_past, slot.n_decoded);
+            }
+            else
+            {
+                SLT_INF(slot, "resumed, n_past = %d\n", slot.n_past);
+            }
+        }
+    }
+
     void update_slots()
     {
         // check if all slots are idle
@@ -3381,6 +3626,8 @@ bool load_adapter(const common_params &params) {
             }
         }
 
+        update_preemption();
+
         // start populating the batch for this iteration
         common_batch_clear(batch);
 
@@ -3395,7 +3642,7 @@ bool load_adapter(const common_params &params) {
         // frist, add sampled tokens from any ongoing sequences
         for (auto &slot : slots)
         {
-            if (slot.state != SLOT_STATE_GENERATING)
+            if (slot.state != SLOT_STATE_GENERATING || slot.parked)
             {
                 continue;
             }
@@ -3430,6 +3677,33 @@ bool load_adapter(const common_params &params) {
         {
             for (auto &slot : slots)
             {
+                // cancelled, or the deadline passed, before the prompt was processed; stop between chunks
+                if (slot.state == SLOT_STATE_PROCESSING_PROMPT || slot.state == SLOT_STATE_STARTED)
+                {
+                    const stop_type interrupt = slot.interrupted();
+                    if (interrupt != STOP_TYPE_NONE)
+                    {
+                        SLT_WRN(slot, "%s during prompt processing, n_past = %d\n",
+                                stop_type_to_str(interrupt).c_str(), slot.n_past);
+                        slot.release();
+                        if (interrupt == STOP_TYPE_CANCELLED)
+                        {
+                            send_error(slot, "task cancelled before the prompt was processed", ERROR_TYPE_CANCELLED);
+                        }
+                        else
+                        {
+                            send_error(slot, "deadline passed before the prompt was processed", ERROR_TYPE_TIMEOUT);
+                        }
+                        continue;
+                    }
+                }
+
+                // a parked prompt resumes from the same chunk later
+                if (slot.parked)
+                {
+                    continue;
+                }
+
                 // check if we can batch this slot with the previous one
                 if (slot.is_processing())
                 {
@@ -3892,7 +4166,7 @@ bool load_adapter(const common_params &params) {
             // do speculative decoding
             for (auto &slot : slots)
             {
-                if (!slot.is_processing() || !slot.can_speculate())
+                if (!slot.is_processing() || !slot.can_speculate() || slot.parked)
                 {
                     continue;
                 }
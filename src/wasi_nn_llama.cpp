@@ -20,7 +20,10 @@
 #include "server/server.cpp"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <future>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -31,12 +34,37 @@
 #include <condition_variable>
 #include <mutex>
 #include <unordered_set>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef WASI_NN_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 // This is not a true global. It is static to this compilation unit,
 // effectively private to the shared library's implementation.
 static std::mutex g_context_registry_mutex;
 static std::unordered_set<void*> g_active_contexts;
 
+// Models loaded by any backend in this process, keyed by file identity and the
+// parameters that decide where the weights live. Each backend creates its own
+// llama_context on top; an entry only holds a weak reference, so the weights
+// are freed with the last backend that uses them.
+struct SharedModelEntry
+{
+  std::mutex load_mutex;  // one load per key; other keys load concurrently
+  std::weak_ptr<llama_model> model;
+};
+static std::mutex g_model_registry_mutex;
+static std::unordered_map<std::string, std::shared_ptr<SharedModelEntry>> g_model_registry;
+
 // Enhanced logging macros that work with both old and new systems
 #define WASI_NN_LOG_DEBUG(ctx, fmt, ...) \
   do { \
@@ -132,9 +160,44 @@ struct wasi_nn_runtime_params
   std::string grammar;
   bool grammar_set = false;
 
+  // Scheduling priority of the session from this turn on, -1 = unchanged
+  int32_t priority = -1;
+
+  // Tenant the session's turns are fair-queued under from this turn on
+  std::string tenant;
+  bool tenant_set = false;
+
+  // Deadline of this turn in ms from submission, 0 = none. Generation stops at
+  // the first token boundary past it and the partial answer comes back with `timeout`
+  uint32_t deadline_ms = 0;
+
   wasi_nn_runtime_params() = default;
 };
 
+// Outcome of a queued task, delivered through the task's promise. A turn cut
+// off by its deadline or by cancel_inference() has status `timeout` or
+// `cancelled` and keeps the partial output.
+struct wasi_nn_task_result
+{
+  wasi_nn_error status = success;
+  std::string output;
+};
+
+// Shared by a queued task and whoever waits for its result. Exactly one party
+// claims the task: the processor that runs it, a waiter whose deadline passed,
+// or shutdown. The claimer fulfils the promise.
+struct wasi_nn_task_handle
+{
+  std::promise<wasi_nn_task_result> promise;
+  std::shared_future<wasi_nn_task_result> future;
+  std::chrono::steady_clock::time_point timeout_at;
+  std::atomic<bool> claimed{false};
+
+  wasi_nn_task_handle() : future(promise.get_future().share()) {}
+
+  bool claim() { return !claimed.exchange(true, std::memory_order_acq_rel); }
+};
+
 // Enhanced task structure for WASI-NN backend
 struct wasi_nn_task
 {
@@ -145,8 +208,18 @@ struct wasi_nn_task
   std::chrono::steady_clock::time_point timeout_at;
   uint32_t timeout_ms = 30000; // Default 30 second timeout
   std::string prompt;
+  // Overrides parsed by run_inference, nullptr for the session defaults
+  std::shared_ptr<const wasi_nn_runtime_params> runtime_params;
+  // Fair-queueing flow: callers set the tenant (or leave it empty for the
+  // session), submit_task() turns it into the flow key and looks up the weight
+  std::string flow;
+  double weight = 1.0;
+  double charged_cost = 0.0;  // tokens charged to the flow when dispatched
   bool is_queued = false;
 
+  // Fulfilled by the task processor; compute() hands it to get_output()
+  std::shared_ptr<wasi_nn_task_handle> handle;
+
   wasi_nn_task() : created_at(std::chrono::steady_clock::now())
   {
     timeout_at = created_at + std::chrono::milliseconds(timeout_ms);
@@ -156,11 +229,558 @@ struct wasi_nn_task
 // Forward declaration for task queue
 struct wasi_nn_task_queue;
 
+// Speculative decoding counters, accumulated from the timings of each finished generation
+struct SpeculativeStats
+{
+  uint64_t n_draft_tokens = 0;      // tokens proposed by the draft model
+  uint64_t n_draft_accepted = 0;    // proposals confirmed by the target model
+  uint64_t n_generated_tokens = 0;  // all generated tokens, drafted or not
+  double generation_ms = 0.0;       // time spent in the generation phase
+
+  void add(const result_timings &timings)
+  {
+    n_draft_tokens += std::max(0, timings.draft_n);
+    n_draft_accepted += std::max(0, timings.draft_n_accepted);
+    if (timings.predicted_n > 0) {
+      n_generated_tokens += timings.predicted_n;
+      generation_ms += timings.predicted_ms;
+    }
+  }
+};
+
+// Where an idle session's KV state lives (Phase 6.9)
+enum KvTier {
+  KV_TIER_LIVE = 0,  // in its KV sequence (or nothing cached)
+  KV_TIER_RAM,       // host-RAM snapshot
+  KV_TIER_DISK,      // offload file
+};
+
+// Disk-tier file of an offloaded session; removed with the last reference
+struct OffloadFile
+{
+  explicit OffloadFile(std::string file_path) : path(std::move(file_path)) {}
+  ~OffloadFile() { std::remove(path.c_str()); }
+  std::string path;
+};
+
+// Sequence state taken out of the live KV cache
+struct KvSnapshot
+{
+  std::vector<uint8_t> data;  // llama_state_seq_get_data() output, deflated if compressed
+  size_t raw_size = 0;        // size of the uncompressed state
+  bool compressed = false;
+  llama_tokens tokens;        // the slot's cache_tokens at snapshot time
+  std::string model_version;  // state only loads into the model it came from
+};
+
+// Conversation store of a session (Phase 6.10). Message contents sit back to
+// back in one string, and the rendered conversation is kept as tokens together
+// with the span each message rendered to. A turn renders and tokenizes only the
+// new message, and dropping old turns is a span erase instead of a re-render.
+struct SessionHistory
+{
+  struct Entry
+  {
+    std::string role;      // "system", "user", ... (fits the small-string buffer)
+    uint32_t text_begin;   // content is text[text_begin, text_begin + text_len)
+    uint32_t text_len;
+    uint32_t token_begin;  // rendering is tokens[token_begin, token_end)
+    uint32_t token_end;
+  };
+
+  std::vector<Entry> entries;
+  std::string text;
+  // Rendered conversation; after a user message it ends with the generation prompt
+  llama_tokens tokens;
+  // Token spans are valid. Cleared when a template had to render the whole
+  // conversation at once; the next rebuild tries to split it again.
+  bool segmented = true;
+  bool rendered = false;      // tokens match the messages
+  std::string model_version;  // model the tokens were rendered for
+
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+  const std::string &role(size_t i) const { return entries[i].role; }
+
+  std::string content(size_t i) const
+  {
+    return text.substr(entries[i].text_begin, entries[i].text_len);
+  }
+
+  common_chat_msg message(size_t i) const
+  {
+    common_chat_msg msg;
+    msg.role = entries[i].role;
+    msg.content = content(i);
+    return msg;
+  }
+
+  // Full message list, for persistence and whole-conversation renders only
+  std::vector<common_chat_msg> messages() const
+  {
+    std::vector<common_chat_msg> msgs;
+    msgs.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+      msgs.push_back(message(i));
+    }
+    return msgs;
+  }
+
+  void push(const std::string &msg_role, const std::string &msg_content, size_t token_begin)
+  {
+    entries.push_back({msg_role, (uint32_t)text.size(), (uint32_t)msg_content.size(),
+                       (uint32_t)token_begin, (uint32_t)tokens.size()});
+    text += msg_content;
+  }
+
+  // Drop the last message; its tokens go too when the spans are valid
+  void pop_back()
+  {
+    text.resize(entries.back().text_begin);
+    if (segmented) {
+      tokens.resize(entries.back().token_begin);
+    } else {
+      rendered = false;
+    }
+    entries.pop_back();
+  }
+
+  // Drop messages [first, last) and their tokens, except the first n_keep
+  // tokens of the span (a leading BOS), moving the later spans down
+  void erase(size_t first, size_t last, size_t n_keep = 0)
+  {
+    if (first >= last || last > entries.size()) {
+      return;
+    }
+    const uint32_t text_begin = entries[first].text_begin;
+    const uint32_t n_text = entries[last - 1].text_begin + entries[last - 1].text_len - text_begin;
+    const uint32_t token_begin = entries[first].token_begin + (uint32_t)n_keep;
+    const uint32_t n_tokens = entries[last - 1].token_end - token_begin;
+
+    text.erase(text_begin, n_text);
+    if (segmented) {
+      tokens.erase(tokens.begin() + token_begin, tokens.begin() + token_begin + n_tokens);
+    } else {
+      rendered = false;
+    }
+    entries.erase(entries.begin() + first, entries.begin() + last);
+    for (size_t i = first; i < entries.size(); i++) {
+      entries[i].text_begin -= n_text;
+      entries[i].token_begin -= n_tokens;
+      entries[i].token_end -= n_tokens;
+    }
+    text.shrink_to_fit();
+  }
+
+  void clear()
+  {
+    entries.clear();
+    text.clear();
+    tokens.clear();
+    segmented = true;
+    rendered = false;
+  }
+};
+
 struct SessionInfo
 {
   std::string session_id;
-  std::vector<common_chat_msg> chat_history;
+  SessionHistory history;
   std::chrono::steady_clock::time_point last_activity;
+
+  // KV sequence owned by this session (== id of the server slot that decodes it),
+  // -1 while unbound. Bound lazily on the first turn, see bind_session_sequence().
+  llama_seq_id seq_id = -1;
+  bool in_flight = false;  // a generation for this session is running
+  // Set by the "priority" runtime parameter; admission control only evicts
+  // sessions at or below the priority of the turn that needs the space
+  wasi_nn_task_priority priority = WASI_NN_PRIORITY_NORMAL;
+  // Set by the "tenant" runtime parameter; turns of one tenant share a fair-queueing flow
+  std::string tenant;
+  uint64_t n_tokens_processed = 0;  // prefilled + generated, the cost fair queueing charges
+
+  // Context shifts: the KV sequence holds history.tokens without the n_shifted
+  // tokens that follow the kept prefix. shift_unknown is set when the engine
+  // shifted or trimmed the sequence on its own and n_shifted must be re-derived.
+  int32_t n_shifted = 0;
+  bool shift_unknown = false;
+
+  // Prefill statistics: prompt tokens submitted vs. served from the KV cache
+  uint64_t n_prompt_tokens_total = 0;
+  uint64_t n_prompt_tokens_reused = 0;
+
+  // Draft acceptance for this session's generations
+  SpeculativeStats speculative;
+
+  // Saved KV state to load into the sequence on the next turn (restored sessions)
+  std::string restore_kv_path;
+
+  // Tiered KV offload: state moved out of the live cache while idle
+  KvTier kv_tier = KV_TIER_LIVE;
+  // Snapshots are immutable once published so the governor can compress or
+  // write them out without holding sessions_mutex
+  std::shared_ptr<const KvSnapshot> kv_snapshot;  // KV_TIER_RAM
+  std::shared_ptr<OffloadFile> kv_offload_file;   // KV_TIER_DISK
+
+  // Token buffer lent to each turn so its capacity carries over (Phase 6.11)
+  llama_tokens scratch_tokens;
+
+  // set_input() / compute() / get_output() pipeline
+  std::string pending_input;                         // staged by set_input()
+  std::shared_ptr<wasi_nn_task_handle> pending_task;  // queued by compute()
+
+  // Raised by cancel_inference(), cleared when the caller submits the next turn.
+  // Shared with the engine slot running the turn, which checks it every step.
+  std::shared_ptr<std::atomic<bool>> cancel_requested = std::make_shared<std::atomic<bool>>(false);
+  std::weak_ptr<wasi_nn_task_handle> queued_task;  // latest turn submitted to the task queue
+};
+
+// Token-level radix tree over the prompts held in the KV sequences. A lookup
+// returns the sequence sharing the longest prefix with a new prompt so that
+// prefix can be copied with llama_memory_seq_cp() instead of being prefilled.
+// Entries are hints only: the engine re-checks them against the slot's
+// cache_tokens before copying, so a stale entry costs nothing but a miss.
+struct PrefixCache
+{
+  struct Node
+  {
+    llama_tokens edge;  // tokens on the edge from the parent into this node
+    std::unordered_map<llama_token, std::unique_ptr<Node>> children;
+    std::unordered_set<llama_seq_id> seqs;  // sequences whose prompt covers the whole edge
+  };
+
+  struct Match
+  {
+    llama_seq_id seq_id = -1;
+    size_t n_tokens = 0;
+  };
+
+  // Record the prompt now held by a sequence, replacing its previous one
+  void insert(llama_seq_id seq_id, const llama_tokens &tokens)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    erase_locked(seq_id);
+    if (tokens.empty()) {
+      return;
+    }
+
+    Node *node = &root;
+    size_t pos = 0;
+    while (pos < tokens.size()) {
+      auto it = node->children.find(tokens[pos]);
+      if (it == node->children.end()) {
+        auto child = std::make_unique<Node>();
+        child->edge.assign(tokens.begin() + pos, tokens.end());
+        child->seqs.insert(seq_id);
+        node->children.emplace(tokens[pos], std::move(child));
+        break;
+      }
+
+      Node *child = it->second.get();
+      const size_t n = match_edge(*child, tokens, pos);
+      if (n < child->edge.size()) {
+        child = split(node, tokens[pos], n);
+      }
+      child->seqs.insert(seq_id);
+      node = child;
+      pos += n;
+    }
+    prompts[seq_id] = tokens;
+  }
+
+  // Forget a sequence whose KV cells were removed or moved
+  void erase(llama_seq_id seq_id)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    erase_locked(seq_id);
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    root.children.clear();
+    prompts.clear();
+  }
+
+  // Longest prefix of tokens recorded for any sequence other than exclude
+  Match find(const llama_tokens &tokens, llama_seq_id exclude) const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    Match best;
+    const Node *node = &root;
+    size_t pos = 0;
+    while (pos < tokens.size()) {
+      auto it = node->children.find(tokens[pos]);
+      if (it == node->children.end()) {
+        break;
+      }
+
+      // Sequences below a node are a subset of the node's own
+      const Node *child = it->second.get();
+      auto seq = std::find_if(child->seqs.begin(), child->seqs.end(),
+                              [exclude](llama_seq_id id) { return id != exclude; });
+      if (seq == child->seqs.end()) {
+        break;
+      }
+
+      const size_t n = match_edge(*child, tokens, pos);
+      best.seq_id = *seq;
+      best.n_tokens = pos + n;
+      if (n < child->edge.size()) {
+        break;
+      }
+      node = child;
+      pos += n;
+    }
+    return best;
+  }
+
+  // Length of the prefix tokens shares with the prompt recorded for seq_id
+  size_t common_prefix(llama_seq_id seq_id, const llama_tokens &tokens) const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = prompts.find(seq_id);
+    if (it == prompts.end()) {
+      return 0;
+    }
+    const llama_tokens &prompt = it->second;
+    const size_t n_max = std::min(prompt.size(), tokens.size());
+    size_t n = 0;
+    while (n < n_max && prompt[n] == tokens[n]) {
+      n++;
+    }
+    return n;
+  }
+
+private:
+  static size_t match_edge(const Node &node, const llama_tokens &tokens, size_t pos)
+  {
+    size_t n = 0;
+    while (n < node.edge.size() && pos + n < tokens.size() && node.edge[n] == tokens[pos + n]) {
+      n++;
+    }
+    return n;
+  }
+
+  // Split the edge to parent->children[key] after n tokens; returns the new middle node
+  static Node *split(Node *parent, llama_token key, size_t n)
+  {
+    std::unique_ptr<Node> child = std::move(parent->children[key]);
+    auto middle = std::make_unique<Node>();
+    middle->edge.assign(child->edge.begin(), child->edge.begin() + n);
+    middle->seqs = child->seqs;
+    child->edge.erase(child->edge.begin(), child->edge.begin() + n);
+
+    const llama_token child_key = child->edge.front();
+    middle->children.emplace(child_key, std::move(child));
+
+    Node *result = middle.get();
+    parent->children[key] = std::move(middle);
+    return result;
+  }
+
+  void erase_locked(llama_seq_id seq_id)
+  {
+    auto prompt_it = prompts.find(seq_id);
+    if (prompt_it == prompts.end()) {
+      return;
+    }
+    const llama_tokens &tokens = prompt_it->second;
+
+    // Nodes on the path stop at the prompt's end, so every edge matches whole
+    std::vector<std::pair<Node *, llama_token>> path;
+    Node *node = &root;
+    size_t pos = 0;
+    while (pos < tokens.size()) {
+      auto it = node->children.find(tokens[pos]);
+      if (it == node->children.end()) {
+        break;
+      }
+      Node *child = it->second.get();
+      child->seqs.erase(seq_id);
+      path.emplace_back(node, tokens[pos]);
+      pos += child->edge.size();
+      node = child;
+    }
+
+    // A node without sequences has no children left either
+    for (auto step = path.rbegin(); step != path.rend(); ++step) {
+      auto it = step->first->children.find(step->second);
+      if (it != step->first->children.end() && it->second->seqs.empty()) {
+        step->first->children.erase(it);
+      }
+    }
+    prompts.erase(prompt_it);
+  }
+
+  mutable std::mutex mutex;
+  Node root;
+  std::unordered_map<llama_seq_id, llama_tokens> prompts;  // recorded prompt per sequence
+};
+
+// KV cache usage per sequence. The engine thread re-reads every sequence from
+// the llama memory API after each update_slots() step and after each engine
+// command; any thread can read the published numbers without a round trip.
+// The API only exposes a sequence's lowest and highest position, so a sequence
+// counts the positions it spans: an upper bound on its cells if positions were
+// removed from its middle.
+struct KvAccounting
+{
+  // Start over for a freshly loaded context
+  void reset(uint32_t n_cells_total, uint64_t n_bytes_per_token, uint64_t n_host_bytes_per_token, size_t n_seq)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    n_cells = n_cells_total;
+    bytes_per_token = n_bytes_per_token;
+    host_bytes_per_token = n_host_bytes_per_token;
+    seq_tokens.assign(n_seq, 0);
+    tokens_spanned = 0;
+    free_holes = 0;
+  }
+
+  // Re-read the span of every sequence (index == seq_id). Runs after every
+  // decode step, so it works in place without allocating.
+  void refresh(llama_memory_t mem)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tokens_spanned = 0;
+    uint64_t n_freed = 0;
+    uint64_t n_grown = 0;
+    for (size_t seq_id = 0; seq_id < seq_tokens.size(); seq_id++) {
+      const llama_pos pos_max = llama_memory_seq_pos_max(mem, seq_id);
+      const int32_t n_tokens = pos_max >= 0 ? pos_max - std::max(0, (int)llama_memory_seq_pos_min(mem, seq_id)) + 1 : 0;
+      if (n_tokens < seq_tokens[seq_id]) {
+        n_freed += seq_tokens[seq_id] - n_tokens;
+      } else {
+        n_grown += n_tokens - seq_tokens[seq_id];
+      }
+      seq_tokens[seq_id] = n_tokens;
+      tokens_spanned += n_tokens;
+    }
+
+    // Sequences interleave in the unified cache, so freed cells leave holes;
+    // the cache fills holes before it extends the used range
+    free_holes = free_holes + n_freed > n_grown ? free_holes + n_freed - n_grown : 0;
+    free_holes = tokens_spanned == 0 ? 0 : std::min<uint64_t>(free_holes, n_cells - std::min<uint64_t>(n_cells, tokens_spanned));
+  }
+
+  // Estimated share of holes within the used part of the cache (Phase 6.14)
+  double fragmentation() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return free_holes > 0 ? (double)free_holes / (tokens_spanned + free_holes) : 0.0;
+  }
+
+  // The cache was defragmented, its used cells are contiguous again
+  void compacted()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    free_holes = 0;
+  }
+
+  int32_t sequence_tokens(llama_seq_id seq_id) const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return seq_id >= 0 && (size_t)seq_id < seq_tokens.size() ? seq_tokens[seq_id] : 0;
+  }
+
+  // Sum of the spans of all sequences; cells shared between sequences count
+  // once per sequence
+  uint64_t spanned_tokens() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tokens_spanned;
+  }
+
+  uint32_t capacity() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return n_cells;
+  }
+
+  uint64_t token_bytes() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes_per_token;
+  }
+
+  // Part of token_bytes() held in host memory; the rest lives in VRAM
+  uint64_t host_token_bytes() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return host_bytes_per_token;
+  }
+
+private:
+  mutable std::mutex mutex;
+  std::vector<int32_t> seq_tokens;  // positions spanned by each sequence
+  uint64_t tokens_spanned = 0;
+  uint64_t free_holes = 0;          // cells freed since the last compaction and not refilled (estimate)
+  uint32_t n_cells = 0;             // KV cache size in tokens
+  uint64_t bytes_per_token = 0;     // K and V bytes of one token over all layers
+  uint64_t host_bytes_per_token = 0;  // of which in host memory (layers not offloaded)
+};
+
+// Bump allocator for the transient objects of one request (Phase 6.11). Each
+// calling thread keeps one; reset() keeps its blocks, so once a thread has
+// served a request of a given size the next one takes nothing from the heap.
+struct RequestArena
+{
+  static constexpr size_t BLOCK_SIZE = 32 * 1024;
+  static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+
+  void *allocate(size_t size)
+  {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    for (; current < blocks.size(); current++) {
+      Block &block = blocks[current];
+      if (block.used + size <= block.size) {
+        void *ptr = block.data.get() + block.used;
+        block.used += size;
+        bytes_used += size;
+        return ptr;
+      }
+    }
+
+    const size_t block_size = std::max(BLOCK_SIZE, size);
+    blocks.push_back({std::unique_ptr<char[]>(new char[block_size]), block_size, size});
+    heap_allocs++;
+    bytes_used += size;
+    return blocks.back().data.get();
+  }
+
+  bool owns(const void *ptr) const
+  {
+    for (const Block &block : blocks) {
+      if (ptr >= block.data.get() && ptr < block.data.get() + block.size) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void reset()
+  {
+    for (Block &block : blocks) {
+      block.used = 0;
+    }
+    current = 0;
+    bytes_used = 0;
+    heap_allocs = 0;
+  }
+
+  size_t bytes_used = 0;   // this request
+  size_t heap_allocs = 0;  // blocks this request had to add
+
+private:
+  struct Block
+  {
+    std::unique_ptr<char[]> data;
+    size_t size;
+    size_t used;
+  };
+  std::vector<Block> blocks;
+  size_t current = 0;
 };
 
 struct LlamaChatContext
@@ -177,18 +797,83 @@ struct LlamaChatContext
   uint32_t idle_timeout_ms;
   bool auto_cleanup_enabled;
 
+  // Session persistence (Phase 6.5): closed and evicted sessions are written to
+  // disk and restored when the same session_id returns under the same model
+  std::string session_cache_dir;      // empty = persistence disabled
+  bool session_save_on_close = true;
+  bool session_save_on_evict = true;
+  bool session_restore_on_open = true;
+
+  // Session history budget (Phase 6.10)
+  uint32_t history_max_tokens = 0;                   // rendered tokens per session, 0 = unlimited
+  std::string history_truncation = "drop_oldest";    // drop_oldest or none
+  // Whether the loaded chat template renders messages independently, and the
+  // kinds of segmented append already checked against a whole-conversation
+  // render ("<system>:<previous role>:<role>"); guarded by sessions_mutex
+  bool history_segmentable = true;
+  std::unordered_set<std::string> history_segments_verified;
+
+  // Tiered KV offload (Phase 6.9): idle sessions move their sequence state to a
+  // host-RAM snapshot, and to disk once the RAM tier is over budget
+  bool kv_offload_enabled = false;
+  uint32_t kv_offload_idle_ms = 300000;  // idle time before offloading, 0 = only when a sequence is reclaimed
+  uint32_t kv_offload_ram_mb = 1024;     // RAM tier budget
+  std::string kv_offload_dir;            // disk tier, empty = no disk tier
+  std::atomic<uint64_t> kv_offload_serial{0};    // offload file names
+  std::atomic<uint64_t> kv_offload_restores{0};  // sessions resumed from the RAM or disk tier
+
+  // Load models through the process-wide registry (Phase 6.12)
+  bool share_models = false;
+
+  // Idle-time KV compaction (Phase 6.14)
+  bool kv_compaction_enabled = false;
+  uint32_t kv_compaction_idle_ms = 2000;        // quiet time before compacting
+  float kv_compaction_threshold = 0.1f;         // estimated fragmentation that triggers it
+  std::atomic<uint64_t> kv_compactions{0};
+  std::atomic<double> kv_fragmentation_before{0.0};  // at the last compaction
+  std::atomic<double> kv_fragmentation_after{0.0};
+  std::atomic<double> kv_compaction_ms{0.0};
+  std::atomic<uint64_t> context_shifts{0};    // KV sequences shifted before a turn or while generating
+
+  // KV admission control (Phase 6.13)
+  std::string admission_policy = "queue";    // queue, evict or reject
+  uint32_t admission_timeout_ms = 30000;     // longest wait under "queue"
+  std::atomic<uint64_t> admission_waits{0};      // turns that waited for KV space
+  std::atomic<uint64_t> admission_evictions{0};  // idle sessions evicted for another turn
+  std::atomic<uint64_t> admission_rejections{0}; // turns and sessions refused
+
   // Enhanced concurrency and task management (Phase 4.2)
   uint32_t queue_size;
 
   // Advanced task queue system
   std::shared_ptr<wasi_nn_task_queue> task_queue;
-  std::thread task_processor_thread;
+  std::vector<std::thread> task_processor_threads;  // one per parallel slot
   bool task_processing_enabled = true;
 
+  // Continuous batching engine (Phase 6.1)
+  // A single server_queue loop drives server_context::update_slots(), so every
+  // active session shares one llama_batch per decode step.
+  uint32_t max_concurrent;                  // number of parallel slots (n_parallel)
+  std::thread engine_thread;
+  std::atomic<bool> engine_running{false};
+  std::mutex engine_commands_mutex;
+  std::vector<std::function<void()>> engine_commands;  // run between update_slots() steps
+  std::vector<std::function<void()>> engine_commands_draining;  // engine thread; swapped with engine_commands
+
+  // Guards sessions against concurrent API callers
+  std::mutex sessions_mutex;
+  std::condition_variable sequence_available;  // a session finished generating
+
+  // Backend-wide speculative decoding counters (guarded by sessions_mutex)
+  SpeculativeStats speculative_stats;
+
   // Task timeout and priority settings
   uint32_t default_task_timeout_ms = 30000;
   bool priority_scheduling_enabled = true;
   bool fair_scheduling_enabled = true;
+  bool preemption_enabled = false;  // URGENT turns preempt running lower-priority generations
+  bool preemption_reserve_sequence = true;  // keep one KV sequence for URGENT turns
+  std::unordered_map<std::string, double> tenant_weights;  // fair-queueing weights, 1 when not listed
 
   // Queue monitoring and limits
   uint32_t queue_warning_threshold = 40;    // Warn when queue is 80% full
@@ -203,6 +888,8 @@ struct LlamaChatContext
   // Phase 4.3: Advanced Memory Management
   uint32_t n_keep_tokens = 256;             // Number of tokens to keep when shifting context
   uint32_t n_discard_tokens = 0;            // Number of tokens to discard (0 = auto half)
+  uint32_t kv_sink_tokens = 4;              // "smart": leading attention-sink tokens never evicted
+  uint32_t kv_window_tokens = 0;            // "smart": recent tokens kept on eviction (0 = half the slot)
   float memory_pressure_threshold = 0.85f;  // Trigger cleanup at 85% memory usage
   bool enable_partial_cache_deletion = true;
   bool enable_token_cache_reuse = true;
@@ -211,8 +898,41 @@ struct LlamaChatContext
 
   // Memory monitoring
   std::atomic<uint64_t> current_memory_usage{0};
-  std::atomic<uint32_t> cache_hits{0};
-  std::atomic<uint32_t> cache_misses{0};
+
+  // Memory governor (Phase 6.8): a background thread samples anonymous memory
+  // of the cgroup (or process) and PSI, publishes the pressure level and evicts
+  // before the OOM killer
+  uint32_t memory_sample_interval_ms = 1000;  // 0 = governor disabled
+  float memory_critical_threshold = 0.95f;    // usage ratio that evicts whole sessions
+  float memory_psi_threshold = 10.0f;         // PSI avg10 (%) counted as pressure
+  float memory_hysteresis = 0.05f;            // usage ratio below a threshold that ends its level
+  std::atomic<uint64_t> memory_limit_bytes{0};  // effective limit, 0 = unknown
+  std::atomic<int> memory_pressure_level{0};    // MemoryPressureLevel
+  std::atomic<float> memory_psi_some{0.0f};
+  std::atomic<float> memory_psi_full{0.0f};
+  std::thread memory_governor_thread;
+  std::mutex memory_governor_mutex;
+  std::condition_variable memory_governor_wakeup;
+  bool memory_governor_running = false;  // guarded by memory_governor_mutex
+  std::unordered_set<graph_execution_context> evicted_sessions;  // tombstones, guarded by sessions_mutex
+
+  // Shared prefix cache (Phase 6.4): sessions copy common prompt prefixes
+  // from other KV sequences instead of prefilling them again
+  bool enable_prefix_cache = false;
+  uint32_t prefix_cache_min_tokens = 32;               // shorter shared prefixes are recomputed
+  PrefixCache prefix_cache;
+  std::atomic<uint64_t> prefix_cache_hits{0};          // prompts that copied a shared prefix
+  std::atomic<uint64_t> prefix_cache_misses{0};        // cold prompts with nothing to share
+  std::atomic<uint64_t> prefix_cache_tokens_shared{0}; // prefill tokens saved by copies
+
+  // Request memory (Phase 6.11)
+  std::atomic<uint64_t> arena_requests{0};     // requests served from a request arena
+  std::atomic<uint64_t> arena_heap_allocs{0};  // arena blocks taken from the heap
+  std::atomic<uint64_t> arena_peak_bytes{0};   // largest single-request arena use
+  std::atomic<uint64_t> scratch_reallocs{0};   // reused scratch buffers that had to grow
+
+  // KV cache accounting (Phase 6.7), refreshed by the engine thread
+  KvAccounting kv_accounting;
 
   // Logging configuration
   std::string log_level;
@@ -248,12 +968,12 @@ struct LlamaChatContext
   LlamaChatContext()
       : next_exec_ctx_id(1),
         max_sessions(100), idle_timeout_ms(300000), auto_cleanup_enabled(true),
-        queue_size(50),
+        queue_size(50), max_concurrent(1),
         context_shifting_enabled(true), cache_strategy("lru"), max_cache_tokens(10000),
         n_keep_tokens(256), n_discard_tokens(0), memory_pressure_threshold(0.85f),
         enable_partial_cache_deletion(true), enable_token_cache_reuse(true),
         cache_deletion_strategy("lru"), max_memory_mb(0),
-        current_memory_usage(0), cache_hits(0), cache_misses(0),
+        current_memory_usage(0),
         log_level("info"), enable_debug_log(false), enable_timestamps(true), enable_colors(false),
         log_instance(nullptr), log_initialized(false),
         current_model_path(""), current_model_version(""),
@@ -267,36 +987,203 @@ struct LlamaChatContext
 
 // Forward declarations for helper functions
 static void parse_config_to_params(const char *config_json, common_params &params, LlamaChatContext *chat_ctx = nullptr);
+static wasi_nn_error setup_threadpools(LlamaChatContext *chat_ctx);
+static void stop_inference_engine(LlamaChatContext *chat_ctx);
+static void stop_memory_governor(LlamaChatContext *chat_ctx);
+static bool offload_session_kv(LlamaChatContext *chat_ctx, SessionInfo &session_info);
+static void tier_idle_sessions(LlamaChatContext *chat_ctx, int pressure_level);
+static void compact_idle_kv_cache(LlamaChatContext *chat_ctx);
+static void task_processor_loop(LlamaChatContext *chat_ctx, bool urgent_lane);
+static void stop_task_processing(LlamaChatContext *chat_ctx);
+static wasi_nn_error submit_task(LlamaChatContext *chat_ctx, wasi_nn_task &&task,
+                                 std::shared_ptr<wasi_nn_task_handle> &handle);
+static const wasi_nn_task_result &wait_for_task(LlamaChatContext *chat_ctx, wasi_nn_task_handle &handle);
+
+// Bounded multi-producer / multi-consumer ring after Dmitry Vyukov's design.
+// Each cell carries a sequence number saying whose turn it is, so a push or a
+// pop claims its cell with one CAS on the shared position and never blocks.
+template <typename T>
+class BoundedMpmcRing
+{
+public:
+  explicit BoundedMpmcRing(size_t min_capacity)
+  {
+    size_t capacity = 2;
+    while (capacity < min_capacity) {
+      capacity <<= 1;
+    }
+    cells.reset(new Cell[capacity]);
+    mask = capacity - 1;
+    for (size_t i = 0; i < capacity; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // False when the ring is full
+  bool try_push(T &&value)
+  {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[pos & mask];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = std::move(value);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // False when the ring is empty
+  bool try_pop(T &value)
+  {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[pos & mask];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          value = std::move(cell.value);
+          cell.sequence.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  size_t capacity() const { return mask + 1; }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T value;
+  };
 
-// Task queue with priority management
+  std::unique_ptr<Cell[]> cells;
+  size_t mask = 0;
+  // Producers and consumers each spin on their own cache line
+  alignas(64) std::atomic<size_t> enqueue_pos{0};
+  alignas(64) std::atomic<size_t> dequeue_pos{0};
+};
+
+// Task queue with priority management. Submitting host threads never take a
+// lock: a task reserves a place in the depth counter and is pushed onto the
+// ring of its priority. Processors drain the rings from URGENT down to LOW and
+// only take queue_mutex to sleep while all of them are empty.
 struct wasi_nn_task_queue
 {
-  std::deque<wasi_nn_task> high_priority_queue;    // Priority 3 (urgent)
-  std::deque<wasi_nn_task> normal_priority_queue;  // Priority 1-2 (normal/high)
-  std::deque<wasi_nn_task> low_priority_queue;     // Priority 0 (low)
+  static constexpr int n_priorities = WASI_NN_PRIORITY_URGENT + 1;
+  std::unique_ptr<BoundedMpmcRing<std::unique_ptr<wasi_nn_task>>> rings[n_priorities];
 
   std::mutex queue_mutex;
   std::condition_variable queue_condition;
+  std::atomic<uint32_t> idle_processors{0};
+
+  // Phase 6.17: a dedicated processor for tasks at or above this priority (-1 =
+  // none), so an urgent turn never waits for a general processor to finish. It
+  // sleeps on its own condition and is only woken by tasks it may take.
+  int urgent_lane_priority = -1;
+  std::condition_variable urgent_condition;
+  std::atomic<uint64_t> urgent_submitted{0};
+  std::atomic<bool> urgent_lane_idle{false};
 
   uint32_t max_queue_size = 50;
-  uint32_t current_size = 0;
-  bool running = true;
-  int next_task_id = 1;
+  uint32_t reject_threshold = 50;   // queue_reject_threshold, new tasks are refused at this depth
+  uint32_t warning_threshold = 40;  // queue_warning_threshold
+  // Waiting tasks nobody has claimed yet. A task claimed by its waiter stays in
+  // its ring until a processor pops and drops it, so rings hold twice this.
+  std::atomic<uint32_t> current_size{0};
+  std::atomic<bool> running{true};
+  std::atomic<int> next_task_id{1};
 
   // Queue statistics
-  uint32_t tasks_queued = 0;
-  uint32_t tasks_completed = 0;
-  uint32_t tasks_timeout = 0;
-  uint32_t tasks_rejected = 0;
+  std::atomic<uint32_t> tasks_queued{0};
+  std::atomic<uint32_t> tasks_completed{0};
+  std::atomic<uint32_t> tasks_timeout{0};
+  std::atomic<uint32_t> tasks_cancelled{0};  // answered before a processor claimed them, other than by timeout
+  std::atomic<uint32_t> tasks_rejected{0};
+
+  // Phase 6.15: weighted fair queueing (fair_scheduling_enabled). Processors
+  // move popped tasks into per-flow backlogs and, within a priority level,
+  // serve the flow with the least virtual time. Dispatch charges the flow its
+  // expected token cost / weight; completion corrects it to the real cost.
+  // Without fair scheduling every task of a level shares one flow.
+  struct FairFlow
+  {
+    double virtual_time = 0.0;
+    double expected_cost = 64.0;  // moving average of the tokens one turn costs
+  };
+
+  // Phase 6.16: a flow's backlog is served earliest deadline first
+  struct DeadlineHeap
+  {
+    std::vector<std::unique_ptr<wasi_nn_task>> tasks;
+
+    static bool later(const std::unique_ptr<wasi_nn_task> &a, const std::unique_ptr<wasi_nn_task> &b)
+    {
+      return a->timeout_at > b->timeout_at;
+    }
+
+    void push(std::unique_ptr<wasi_nn_task> task)
+    {
+      tasks.push_back(std::move(task));
+      std::push_heap(tasks.begin(), tasks.end(), later);
+    }
+
+    std::unique_ptr<wasi_nn_task> pop()
+    {
+      std::pop_heap(tasks.begin(), tasks.end(), later);
+      std::unique_ptr<wasi_nn_task> task = std::move(tasks.back());
+      tasks.pop_back();
+      return task;
+    }
+
+    bool empty() const { return tasks.empty(); }
+  };
+
+  bool fair_scheduling = false;
+  std::mutex dispatch_mutex;  // processors only
+  std::unordered_map<std::string, DeadlineHeap> backlog[n_priorities];
+  std::unordered_map<std::string, FairFlow> fair_flows;
+  double system_virtual_time = 0.0;  // start tag of the last dispatched task
+
+  // Size the rings; called once before the first task is queued
+  void init(uint32_t queue_size, uint32_t reject_at, uint32_t warn_at);
 
   // Add task to appropriate priority queue
   bool enqueue_task(wasi_nn_task &&task, LlamaChatContext* ctx = nullptr);
 
-  // Get next task based on priority
-  bool dequeue_task(wasi_nn_task &task, LlamaChatContext* ctx = nullptr);
+  // Get next task based on priority; the urgent lane only takes urgent tasks
+  bool dequeue_task(wasi_nn_task &task, LlamaChatContext* ctx = nullptr, bool urgent_lane = false);
+
+  // Correct the flow of a finished task to the tokens it actually cost
+  void charge(const wasi_nn_task &task, uint64_t n_tokens);
+
+  // Take the next runnable task: highest priority, then fairest flow, then earliest deadline
+  bool pop_next(std::unique_ptr<wasi_nn_task> &next, int min_priority = WASI_NN_PRIORITY_LOW);
+  bool claim_popped(wasi_nn_task &queued);
+
+  // Complete a task no processor has claimed yet with `status`
+  bool expire_task(wasi_nn_task_handle &handle, wasi_nn_error status);
+
+  // Wake the processors and let them exit
+  void stop();
 
-  // Clean up expired tasks
-  void cleanup_expired_tasks();
+  // Complete every task still waiting with `status`
+  void fail_pending(wasi_nn_error status);
 
   // Get queue status
   void get_queue_status(uint32_t &queued, uint32_t &active, uint32_t &capacity);
@@ -304,40 +1191,450 @@ struct wasi_nn_task_queue
 
 // Implementation of LlamaChatContext destructor
 LlamaChatContext::~LlamaChatContext() {
+  // Stop the task processors and the inference engine before the server context goes away
+  stop_memory_governor(this);
+  stop_task_processing(this);
+  stop_inference_engine(this);
+
   // Cleanup logging system
   if (log_initialized && log_instance) {
     common_log_free(log_instance);
     log_instance = nullptr;
     log_initialized = false;
   }
-
-  // Cleanup task processing thread
-  if (task_processing_enabled && task_processor_thread.joinable()) {
-    if (task_queue) {
-      task_queue->running = false;
-      task_queue->queue_condition.notify_all();
-    }
-    task_processor_thread.join();
-  }
 }
 
 // ==============================================================================
-// Phase 5.2: Stable Model Switching Implementation
+// Phase 6.7: KV Cache Accounting
 // ==============================================================================
+// Eviction, pressure handling and stats work from the real number of tokens each
+// sequence holds instead of estimates derived from n_ctx.
 
-// Wait for all active tasks to complete
-static wasi_nn_error wait_for_tasks_completion(LlamaChatContext *chat_ctx, uint32_t timeout_ms = 30000) {
-  if (!chat_ctx || !chat_ctx->task_queue) {
-    return success; // No tasks to wait for
+// Integer GGUF key "<arch>.<suffix>", or fallback when the model does not set it
+static int64_t model_arch_meta_int(const llama_model *model, const char *suffix, int64_t fallback)
+{
+  char arch[64];
+  if (llama_model_meta_val_str(model, "general.architecture", arch, sizeof(arch)) <= 0) {
+    return fallback;
   }
+  char value[32];
+  const std::string key = std::string(arch) + "." + suffix;
+  if (llama_model_meta_val_str(model, key.c_str(), value, sizeof(value)) <= 0) {
+    return fallback;
+  }
+  const int64_t parsed = strtoll(value, nullptr, 10);
+  return parsed > 0 ? parsed : fallback;
+}
 
-  auto start_time = std::chrono::steady_clock::now();
-  auto timeout = std::chrono::milliseconds(timeout_ms);
+// K and V bytes one token occupies across all layers of the model. Head sizes
+// come from attention.key_length / value_length: models such as Gemma and Qwen3
+// use heads wider or narrower than n_embd / n_head.
+static uint64_t kv_bytes_per_token(const common_params &params, const llama_model *model)
+{
+  const int32_t n_head = llama_model_n_head(model);
+  if (n_head <= 0) {
+    return 0;
+  }
+  const int64_t n_embd_head = llama_model_n_embd(model) / n_head;
+  const int64_t n_embd_k_gqa = model_arch_meta_int(model, "attention.key_length", n_embd_head) * llama_model_n_head_kv(model);
+  const int64_t n_embd_v_gqa = model_arch_meta_int(model, "attention.value_length", n_embd_head) * llama_model_n_head_kv(model);
+  return (uint64_t)llama_model_n_layer(model) *
+         (ggml_row_size(params.cache_type_k, n_embd_k_gqa) + ggml_row_size(params.cache_type_v, n_embd_v_gqa));
+}
 
-  NN_INFO_PRINTF("Waiting for active tasks to complete before model switch...");
+// Part of the KV bytes of one token kept in host memory. llama.cpp places the
+// cache of a layer on the device that runs it, and offloads the last
+// n_gpu_layers layers unless no_kv_offload is set.
+static uint64_t kv_host_bytes_per_token(const common_params &params, const llama_model *model,
+                                        uint64_t bytes_per_token)
+{
+  const int32_t n_layer = llama_model_n_layer(model);
+  if (n_layer <= 0 || !llama_supports_gpu_offload() || params.no_kv_offload) {
+    return bytes_per_token;
+  }
+  const int32_t n_offloaded = params.n_gpu_layers < 0 ? n_layer : std::min(params.n_gpu_layers, n_layer);
+  return bytes_per_token * (uint64_t)(n_layer - n_offloaded) / (uint64_t)n_layer;
+}
 
-  while (true) {
-    uint32_t queued = 0, active = 0, capacity = 0;
+// Size the accounting for a freshly loaded context
+static void init_kv_accounting(LlamaChatContext *chat_ctx)
+{
+  auto &server_ctx = chat_ctx->server_ctx;
+  const uint64_t bytes_per_token = kv_bytes_per_token(server_ctx.params_base, server_ctx.model);
+  const uint64_t host_bytes_per_token = kv_host_bytes_per_token(server_ctx.params_base, server_ctx.model,
+                                                                bytes_per_token);
+  chat_ctx->kv_accounting.reset(llama_n_ctx(server_ctx.ctx), bytes_per_token, host_bytes_per_token,
+                                server_ctx.slots.size());
+
+  WASI_NN_LOG_INFO(chat_ctx, "KV cache: %u cells, %llu bytes per token (%llu in host memory), %.1f MiB total",
+                   llama_n_ctx(server_ctx.ctx), (unsigned long long)bytes_per_token,
+                   (unsigned long long)host_bytes_per_token,
+                   llama_n_ctx(server_ctx.ctx) * bytes_per_token / (1024.0 * 1024.0));
+}
+
+// Re-read the length of every slot's sequence; engine thread only (or engine stopped)
+static void refresh_kv_accounting(LlamaChatContext *chat_ctx)
+{
+  auto &server_ctx = chat_ctx->server_ctx;
+  if (!server_ctx.ctx) {
+    return;
+  }
+
+  chat_ctx->kv_accounting.refresh(llama_get_memory(server_ctx.ctx));
+}
+
+// ==============================================================================
+// Phase 6.1: Continuous Batching Engine
+// ==============================================================================
+// All decoding happens on one engine thread running server_queue::start_loop().
+// run_inference() callers post completion tasks and block on server_response;
+// the loop admits them into free slots and decodes every active slot in a
+// shared llama_batch, so aggregate throughput scales with concurrent sessions.
+
+// Run queued engine commands; must be called on the engine thread (or after it stopped)
+static void drain_engine_commands(LlamaChatContext *chat_ctx)
+{
+  // Called before every decode step: the two vectors trade buffers, so once
+  // they have grown nothing here allocates
+  auto &commands = chat_ctx->engine_commands_draining;
+  {
+    std::lock_guard<std::mutex> lock(chat_ctx->engine_commands_mutex);
+    if (chat_ctx->engine_commands.empty()) {
+      return;
+    }
+    commands.swap(chat_ctx->engine_commands);
+  }
+
+  for (auto &command : commands) {
+    command();
+  }
+  commands.clear();
+}
+
+// Execute fn on the engine thread between two update_slots() steps and wait for it.
+// Anything that touches slots or the KV cache from an API thread must go through here.
+static void run_on_engine_thread(LlamaChatContext *chat_ctx, const std::function<void()> &fn)
+{
+  if (!chat_ctx->engine_running.load() ||
+      std::this_thread::get_id() == chat_ctx->engine_thread.get_id()) {
+    fn();
+    refresh_kv_accounting(chat_ctx);
+    return;
+  }
+
+  auto done = std::make_shared<std::promise<void>>();
+  std::future<void> finished = done->get_future();
+  {
+    std::lock_guard<std::mutex> lock(chat_ctx->engine_commands_mutex);
+    chat_ctx->engine_commands.push_back([chat_ctx, fn, done]() {
+      try {
+        fn();
+        refresh_kv_accounting(chat_ctx);
+      } catch (const std::exception &e) {
+        NN_ERR_PRINTF("Engine command failed: %s", e.what());
+      }
+      done->set_value();
+    });
+  }
+
+  // Wake the loop up; NEXT_RESPONSE is a no-op task that triggers update_slots()
+  server_task wakeup(SERVER_TASK_TYPE_NEXT_RESPONSE);
+  wakeup.id = chat_ctx->server_ctx.queue_tasks.get_new_id();
+  chat_ctx->server_ctx.queue_tasks.post(std::move(wakeup));
+
+  finished.wait();
+}
+
+// Start the engine loop on a freshly initialized server context
+static wasi_nn_error start_inference_engine(LlamaChatContext *chat_ctx)
+{
+  if (!chat_ctx || chat_ctx->engine_running.load()) {
+    return success;
+  }
+
+  auto &server_ctx = chat_ctx->server_ctx;
+  if (!server_ctx.ctx || server_ctx.slots.empty()) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Cannot start inference engine without an initialized context");
+    return runtime_error;
+  }
+
+  wasi_nn_error result = setup_threadpools(chat_ctx);
+  if (result != success) {
+    return result;
+  }
+
+  // Sessions own their KV sequences, so never wipe the cache when all slots go idle
+  server_ctx.clean_kv_cache = false;
+
+  init_kv_accounting(chat_ctx);
+
+  // Per-request max_tokens is authoritative; the model n_predict is only the default
+  for (auto &slot : server_ctx.slots) {
+    slot.n_predict = -1;
+  }
+
+  server_ctx.queue_tasks.on_new_task([chat_ctx](server_task &&task) {
+    chat_ctx->server_ctx.process_single_task(std::move(task));
+  });
+  server_ctx.queue_tasks.on_update_slots([chat_ctx]() {
+    drain_engine_commands(chat_ctx);
+    chat_ctx->server_ctx.update_slots();
+    refresh_kv_accounting(chat_ctx);
+  });
+  server_ctx.queue_tasks.running = true;
+  server_ctx.queue_results.running = true;
+
+  chat_ctx->engine_running = true;
+  chat_ctx->engine_thread = std::thread([chat_ctx]() {
+    WASI_NN_LOG_INFO(chat_ctx, "Inference engine started with %zu slots",
+                     chat_ctx->server_ctx.slots.size());
+    chat_ctx->server_ctx.queue_tasks.start_loop();
+    WASI_NN_LOG_INFO(chat_ctx, "Inference engine stopped");
+  });
+
+  return success;
+}
+
+// Stop the engine loop; blocked run_inference() callers are released with an error
+static void stop_inference_engine(LlamaChatContext *chat_ctx)
+{
+  if (!chat_ctx || !chat_ctx->engine_running.load()) {
+    return;
+  }
+
+  chat_ctx->server_ctx.queue_tasks.terminate();
+  chat_ctx->server_ctx.queue_results.terminate();
+
+  if (chat_ctx->engine_thread.joinable()) {
+    chat_ctx->engine_thread.join();
+  }
+  chat_ctx->engine_running = false;
+
+  // Commands posted while shutting down still have waiters; run them here
+  drain_engine_commands(chat_ctx);
+}
+
+// ==============================================================================
+// Phase 6.2: Per-Session KV Sequences
+// ==============================================================================
+// Each session owns one llama seq_id while bound - the id of the server slot that
+// decodes it - so its cache stays warm across turns while other sessions run.
+// n_seq_max bounds how many sessions are bound at once; when every sequence is
+// taken, the least recently used idle session gives its sequence up. Its state
+// is offloaded (Phase 6.9) and loaded back on its next turn.
+
+// Number of KV sequences available to sessions
+static int32_t session_sequence_count(LlamaChatContext *chat_ctx)
+{
+  auto &server_ctx = chat_ctx->server_ctx;
+  if (!server_ctx.ctx) {
+    return 0;
+  }
+  return std::min((int32_t)server_ctx.slots.size(), (int32_t)llama_n_seq_max(server_ctx.ctx));
+}
+
+// KV sequence bound to a session, -1 if none; caller holds sessions_mutex
+static llama_seq_id session_seq_id(LlamaChatContext *chat_ctx, graph_execution_context exec_ctx)
+{
+  auto it = chat_ctx->sessions.find(exec_ctx);
+  return it != chat_ctx->sessions.end() ? it->second.seq_id : -1;
+}
+
+// Error for a handle without a session: session_evicted when the memory
+// governor evicted it, invalid_argument otherwise; caller holds sessions_mutex
+static wasi_nn_error missing_session_error(LlamaChatContext *chat_ctx, graph_execution_context exec_ctx)
+{
+  return chat_ctx->evicted_sessions.count(exec_ctx) ? session_evicted : invalid_argument;
+}
+
+// Drop every KV cell of one sequence together with the slot's token mirror.
+// Returns false if the slot is still generating and was left untouched.
+static bool reset_sequence(LlamaChatContext *chat_ctx, llama_seq_id seq_id)
+{
+  auto &server_ctx = chat_ctx->server_ctx;
+  bool reset = false;
+
+  run_on_engine_thread(chat_ctx, [&]() {
+    server_slot *slot = server_ctx.get_slot_by_id(seq_id);
+    if (!slot || slot->is_processing()) {
+      return;
+    }
+    llama_memory_seq_rm(llama_get_memory(server_ctx.ctx), seq_id, -1, -1);
+    slot->cache_tokens.clear();
+    reset = true;
+  });
+
+  if (reset) {
+    chat_ctx->prefix_cache.erase(seq_id);
+  }
+
+  return reset;
+}
+
+// Make sure a session owns a KV sequence, rebinding the LRU idle session if all
+// are taken. Blocks (releasing the lock) while every sequence is generating.
+// The reserved sequences at the end (Phase 6.17) only go to turns of at least
+// preempt_priority; a session leaving one for a lower-priority turn is offloaded.
+static wasi_nn_error bind_session_sequence(LlamaChatContext *chat_ctx,
+                                           std::unique_lock<std::mutex> &lock,
+                                           graph_execution_context exec_ctx,
+                                           wasi_nn_task_priority priority)
+{
+  const int32_t n_seq = session_sequence_count(chat_ctx);
+  if (n_seq <= 0) {
+    NN_ERR_PRINTF("No KV sequences available for session %d", exec_ctx);
+    return runtime_error;
+  }
+  const auto &server_ctx = chat_ctx->server_ctx;
+  const bool urgent = server_ctx.preempt_priority >= 0 && (int32_t)priority >= server_ctx.preempt_priority;
+  const int32_t n_usable = urgent ? n_seq : std::max(1, n_seq - server_ctx.n_reserved_slots);
+
+  while (true) {
+    auto it = chat_ctx->sessions.find(exec_ctx);
+    if (it == chat_ctx->sessions.end()) {
+      return missing_session_error(chat_ctx, exec_ctx);  // closed or evicted while waiting
+    }
+    if (it->second.seq_id >= 0 && it->second.seq_id < n_usable) {
+      return success;
+    }
+    if (it->second.seq_id >= 0) {
+      NN_INFO_PRINTF("Session %d leaves reserved KV sequence %d for a priority %d turn",
+                     exec_ctx, it->second.seq_id, (int)priority);
+      const llama_seq_id reserved_seq = it->second.seq_id;
+      offload_session_kv(chat_ctx, it->second);
+      it->second.seq_id = -1;
+      reset_sequence(chat_ctx, reserved_seq);
+    }
+
+    std::vector<bool> used(n_seq, false);
+    graph_execution_context victim_ctx = 0;
+    SessionInfo *victim = nullptr;
+    for (auto &pair : chat_ctx->sessions) {
+      SessionInfo &info = pair.second;
+      if (info.seq_id < 0 || info.seq_id >= n_seq) {
+        continue;
+      }
+      used[info.seq_id] = true;
+      if (info.seq_id < n_usable && !info.in_flight &&
+          (!victim || info.last_activity < victim->last_activity)) {
+        victim = &info;
+        victim_ctx = pair.first;
+      }
+    }
+
+    llama_seq_id seq_id = -1;
+    for (int32_t i = 0; i < n_usable; ++i) {
+      if (!used[i]) {
+        seq_id = i;
+        break;
+      }
+    }
+
+    if (seq_id < 0 && victim) {
+      seq_id = victim->seq_id;
+      // Phase 6.9: the victim keeps its cache in the RAM tier instead of losing it
+      offload_session_kv(chat_ctx, *victim);
+      victim->seq_id = -1;
+      NN_INFO_PRINTF("Session %d released KV sequence %d (LRU, %d sequences in use)",
+                     victim_ctx, seq_id, n_seq);
+    }
+
+    if (seq_id >= 0) {
+      if (reset_sequence(chat_ctx, seq_id)) {
+        it->second.seq_id = seq_id;
+        NN_DBG_PRINTF("Session %d bound to KV sequence %d", exec_ctx, seq_id);
+        return success;
+      }
+      // The slot is still finishing a request of a closed session; retry shortly
+      chat_ctx->sequence_available.wait_for(lock, std::chrono::milliseconds(10));
+      continue;
+    }
+
+    // Every sequence is generating; wait for one of them to finish
+    chat_ctx->sequence_available.wait(lock);
+  }
+}
+
+// A regular KV sequence for work that belongs to no session (batch items),
+// skipping those in `taken`. Prefers one no session is bound to. With `evict`,
+// the LRU idle session otherwise gives its sequence up: its KV state is
+// offloaded and its cache state invalidated, so its next turn does not reuse
+// cells the batch overwrites. That call blocks (releasing the lock) while
+// every sequence is bound to a generating session; without `evict` it returns
+// -1 instead. Caller holds sessions_mutex.
+static llama_seq_id claim_unbound_sequence(LlamaChatContext *chat_ctx, std::unique_lock<std::mutex> &lock,
+                                           const std::vector<llama_seq_id> &taken, bool evict)
+{
+  const int32_t n_seq = session_sequence_count(chat_ctx);
+  const int32_t n_regular = std::max(1, n_seq - chat_ctx->server_ctx.n_reserved_slots);
+  if (n_seq <= 0) {
+    return -1;
+  }
+
+  while (true) {
+    std::vector<bool> used(n_seq, false);
+    for (llama_seq_id seq_id : taken) {
+      used[seq_id] = true;
+    }
+    graph_execution_context victim_ctx = 0;
+    SessionInfo *victim = nullptr;
+    for (auto &pair : chat_ctx->sessions) {
+      SessionInfo &info = pair.second;
+      if (info.seq_id < 0 || info.seq_id >= n_seq) {
+        continue;
+      }
+      used[info.seq_id] = true;
+      if (info.seq_id < n_regular && !info.in_flight &&
+          std::find(taken.begin(), taken.end(), info.seq_id) == taken.end() &&
+          (!victim || info.last_activity < victim->last_activity)) {
+        victim = &info;
+        victim_ctx = pair.first;
+      }
+    }
+
+    for (int32_t i = 0; i < n_regular; ++i) {
+      if (!used[i]) {
+        return i;
+      }
+    }
+    if (!evict) {
+      return -1;
+    }
+
+    if (victim) {
+      const llama_seq_id seq_id = victim->seq_id;
+      if (!offload_session_kv(chat_ctx, *victim)) {
+        victim->shift_unknown = true;
+      }
+      victim->seq_id = -1;
+      chat_ctx->prefix_cache.erase(seq_id);
+      reset_sequence(chat_ctx, seq_id);
+      NN_INFO_PRINTF("Session %d released KV sequence %d for batched inference", victim_ctx, seq_id);
+      return seq_id;
+    }
+
+    // Every sequence is generating; wait for one of them to finish
+    chat_ctx->sequence_available.wait(lock);
+  }
+}
+
+// ==============================================================================
+// Phase 5.2: Stable Model Switching Implementation
+// ==============================================================================
+
+// Wait for all active tasks to complete
+static wasi_nn_error wait_for_tasks_completion(LlamaChatContext *chat_ctx, uint32_t timeout_ms = 30000) {
+  if (!chat_ctx || !chat_ctx->task_queue) {
+    return success; // No tasks to wait for
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  auto timeout = std::chrono::milliseconds(timeout_ms);
+
+  NN_INFO_PRINTF("Waiting for active tasks to complete before model switch...");
+
+  while (true) {
+    uint32_t queued = 0, active = 0, capacity = 0;
     chat_ctx->task_queue->get_queue_status(queued, active, capacity);
 
     if (active == 0 && queued == 0) {
@@ -394,6 +1691,7 @@ static void cleanup_all_slots(LlamaChatContext *chat_ctx) {
 
   // Clear all slots
   chat_ctx->server_ctx.slots.clear();
+  chat_ctx->prefix_cache.clear();
 
   // Clear main batch
   if (chat_ctx->server_ctx.batch.token) {
@@ -452,7 +1750,8 @@ static wasi_nn_error safe_model_switch(LlamaChatContext *chat_ctx, const char *f
                      new_params.n_gpu_layers, new_params.n_ctx,
                      new_params.n_batch, new_params.cpuparams.n_threads);
 
-    // Step 4: Clean up all existing slots and contexts
+    // Step 4: Stop the inference engine, then clean up all existing slots and contexts
+    stop_inference_engine(chat_ctx);
     cleanup_all_slots(chat_ctx);
 
     // Step 5: Reset server context state
@@ -480,6 +1779,8 @@ static wasi_nn_error safe_model_switch(LlamaChatContext *chat_ctx, const char *f
       }
 
       WASI_NN_LOG_INFO(chat_ctx, "Previous model restored successfully");
+      chat_ctx->server_ctx.init();
+      start_inference_engine(chat_ctx);
       chat_ctx->model_swapping_in_progress = false;
       return runtime_error;
     }
@@ -488,8 +1789,13 @@ static wasi_nn_error safe_model_switch(LlamaChatContext *chat_ctx, const char *f
         WASI_NN_LOG_ERROR(chat_ctx, "Failed to load LoRA Adapter");
     }
 
-    // Step 7: Reinitialize server context
+    // Step 7: Reinitialize server context and restart the inference engine
     chat_ctx->server_ctx.init();
+    if (start_inference_engine(chat_ctx) != success) {
+      WASI_NN_LOG_ERROR(chat_ctx, "Failed to restart inference engine after model switch");
+      chat_ctx->model_swapping_in_progress = false;
+      return runtime_error;
+    }
 
     // Step 8: Update model information
     chat_ctx->current_model_path = std::string(filename, filename_len);
@@ -518,8 +1824,14 @@ static wasi_nn_error safe_model_switch(LlamaChatContext *chat_ctx, const char *f
     }
 
     // Step 9: Clear all sessions (context will be lost)
-    chat_ctx->sessions.clear();
-    chat_ctx->next_exec_ctx_id = 1;
+    {
+      std::lock_guard<std::mutex> sessions_lock(chat_ctx->sessions_mutex);
+      chat_ctx->sessions.clear();
+      chat_ctx->evicted_sessions.clear();  // handle numbers start over
+      chat_ctx->history_segmentable = true;  // the new template is checked again
+      chat_ctx->history_segments_verified.clear();
+      chat_ctx->next_exec_ctx_id = 1;
+    }
 
     WASI_NN_LOG_INFO(chat_ctx, "Model switch completed successfully");
     WASI_NN_LOG_INFO(chat_ctx, "Model info: name=%s, arch=%s, vocab_size=%ld, ctx_len=%ld",
@@ -539,6 +1851,7 @@ static wasi_nn_error safe_model_switch(LlamaChatContext *chat_ctx, const char *f
       } else {
         WASI_NN_LOG_INFO(chat_ctx, "Previous model restored after exception");
         chat_ctx->server_ctx.init();
+        start_inference_engine(chat_ctx);
       }
     } catch (...) {
       WASI_NN_LOG_ERROR(chat_ctx, "Exception during model restoration");
@@ -605,162 +1918,282 @@ static bool initialize_advanced_logging(LlamaChatContext* chat_ctx) {
   return true;
 }
 
-// Structured logging for task queue operations
-static void log_task_operation(LlamaChatContext* chat_ctx, const std::string& operation,
-                              int task_id, wasi_nn_task_priority priority = WASI_NN_PRIORITY_NORMAL,
-                              const std::string& additional_info = "") {
-  if (!chat_ctx || !chat_ctx->log_initialized) return;
-
-  const char* priority_str = "NORMAL";
-  switch (priority) {
-    case WASI_NN_PRIORITY_LOW: priority_str = "LOW"; break;
-    case WASI_NN_PRIORITY_NORMAL: priority_str = "NORMAL"; break;
-    case WASI_NN_PRIORITY_HIGH: priority_str = "HIGH"; break;
-    case WASI_NN_PRIORITY_URGENT: priority_str = "URGENT"; break;
-  }
-
-  if (additional_info.empty()) {
-    LOG_INF("[TASK] %s - Task %d (Priority: %s)", operation.c_str(), task_id, priority_str);
-  } else {
-    LOG_INF("[TASK] %s - Task %d (Priority: %s) - %s",
-            operation.c_str(), task_id, priority_str, additional_info.c_str());
+// Implementation of wasi_nn_task_queue methods
+void wasi_nn_task_queue::init(uint32_t queue_size, uint32_t reject_at, uint32_t warn_at)
+{
+  max_queue_size = queue_size;
+  reject_threshold = reject_at;
+  warning_threshold = warn_at;
+  for (auto &ring : rings) {
+    ring.reset(new BoundedMpmcRing<std::unique_ptr<wasi_nn_task>>((size_t)queue_size * 2));
   }
 }
 
-// Implementation of wasi_nn_task_queue methods
 bool wasi_nn_task_queue::enqueue_task(wasi_nn_task &&task, LlamaChatContext* ctx)
 {
-  std::unique_lock<std::mutex> lock(queue_mutex);
+  const uint32_t limit = reject_threshold > 0 ? std::min(reject_threshold, max_queue_size) : max_queue_size;
+
+  // Reserve a place, or refuse once the queue is at capacity or at the reject threshold
+  uint32_t size = current_size.load(std::memory_order_relaxed);
+  do {
+    if (!running.load(std::memory_order_relaxed) || size >= limit) {
+      tasks_rejected.fetch_add(1, std::memory_order_relaxed);
+      if (ctx) {
+        WASI_NN_LOG_WARN(ctx, "Task queue full (%u/%u), rejecting task", size, limit);
+      } else {
+        NN_WARN_PRINTF("Task queue full (%u/%u), rejecting task", size, limit);
+      }
+      return false;
+    }
+  } while (!current_size.compare_exchange_weak(size, size + 1));
 
-  // Check if queue is at capacity
-  if (current_size >= max_queue_size) {
-    tasks_rejected++;
+  if (warning_threshold > 0 && size + 1 == warning_threshold) {
     if (ctx) {
-      WASI_NN_LOG_WARN(ctx, "Task queue full (%d/%d), rejecting task %d",
-                       current_size, max_queue_size, task.id);
+      WASI_NN_LOG_WARN(ctx, "Task queue reached warning threshold (%u/%u)", warning_threshold, limit);
     } else {
-      NN_WARN_PRINTF("Task queue full (%d/%d), rejecting task %d",
-                     current_size, max_queue_size, task.id);
+      NN_WARN_PRINTF("Task queue reached warning threshold (%u/%u)", warning_threshold, limit);
     }
-    return false;
   }
 
   // Assign task ID if not set
   if (task.id == -1) {
-    task.id = next_task_id++;
+    task.id = next_task_id.fetch_add(1, std::memory_order_relaxed);
   }
+  const int task_id = task.id;
+  const int level = std::min(std::max((int)task.priority, 0), n_priorities - 1);
 
-  // Add to appropriate priority queue
-  switch (task.priority) {
-    case WASI_NN_PRIORITY_URGENT:
-      high_priority_queue.push_back(std::move(task));
-      break;
-    case WASI_NN_PRIORITY_HIGH:
-    case WASI_NN_PRIORITY_NORMAL:
-      normal_priority_queue.push_back(std::move(task));
-      break;
-    case WASI_NN_PRIORITY_LOW:
-    default:
-      low_priority_queue.push_back(std::move(task));
-      break;
+  // The ring only fills up with tasks whose waiters already gave up on them
+  if (!rings[level]->try_push(std::unique_ptr<wasi_nn_task>(new wasi_nn_task(std::move(task))))) {
+    current_size.fetch_sub(1, std::memory_order_acq_rel);
+    tasks_rejected.fetch_add(1, std::memory_order_relaxed);
+    NN_WARN_PRINTF("Task ring for priority %d is full, rejecting task %d", level, task_id);
+    return false;
   }
+  tasks_queued.fetch_add(1, std::memory_order_relaxed);
 
-  current_size++;
-  tasks_queued++;
+  NN_DBG_PRINTF("Task %d queued with priority %d. Queue size: %u/%u", task_id, level, size + 1, limit);
 
-  // Use advanced logging if available
-  if (ctx) {
-    log_task_operation(ctx, "Task Queued", task.id, task.priority,
-                      "Queue: " + std::to_string(current_size) + "/" + std::to_string(max_queue_size));
-  } else {
-    NN_INFO_PRINTF("Task %d queued with priority %d. Queue size: %d/%d",
-                   task.id, (int)task.priority, current_size, max_queue_size);
+  if (urgent_lane_priority >= 0 && level >= urgent_lane_priority) {
+    urgent_submitted.fetch_add(1);
+    if (urgent_lane_idle.load()) {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      urgent_condition.notify_one();
+    }
   }
 
-  // Notify waiting threads
-  queue_condition.notify_one();
+  // Processors only sleep on the condition once every ring looked empty. The
+  // reservation above and this load pair with the processor's increment of
+  // idle_processors and its check of current_size, so no wakeup is lost.
+  if (idle_processors.load() > 0) {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    queue_condition.notify_one();
+  }
   return true;
 }
 
-bool wasi_nn_task_queue::dequeue_task(wasi_nn_task &task, LlamaChatContext* ctx)
+bool wasi_nn_task_queue::claim_popped(wasi_nn_task &queued)
 {
-  std::unique_lock<std::mutex> lock(queue_mutex);
-
-  // Wait for tasks to become available
-  queue_condition.wait(lock, [this] {
-    return !running ||
-           !high_priority_queue.empty() ||
-           !normal_priority_queue.empty() ||
-           !low_priority_queue.empty();
-  });
+  // Expired or failed by someone else while it waited
+  if (queued.handle && !queued.handle->claim()) {
+    return false;
+  }
+  current_size.fetch_sub(1, std::memory_order_acq_rel);
 
-  if (!running) {
+  // A task that waited past its deadline is answered without running
+  if (std::chrono::steady_clock::now() > queued.timeout_at) {
+    NN_WARN_PRINTF("Task %d expired (created %ldms ago)", queued.id,
+                   (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - queued.created_at).count());
+    tasks_timeout.fetch_add(1, std::memory_order_relaxed);
+    if (queued.handle) {
+      queued.handle->promise.set_value({timeout, ""});
+    }
     return false;
   }
+  return true;
+}
+
+bool wasi_nn_task_queue::pop_next(std::unique_ptr<wasi_nn_task> &next, int min_priority)
+{
+  std::lock_guard<std::mutex> lock(dispatch_mutex);
+
+  // Move everything submitted so far into the per-flow backlogs
+  std::unique_ptr<wasi_nn_task> popped;
+  for (int level = 0; level < n_priorities; ++level) {
+    while (rings[level]->try_pop(popped)) {
+      if (!fair_scheduling) {
+        popped->flow.clear();
+      }
+      auto &flow_backlog = backlog[level][popped->flow];
+      if (flow_backlog.empty()) {
+        // A flow back from idle starts at the current virtual time; idling banks no credit
+        FairFlow &flow = fair_flows[popped->flow];
+        flow.virtual_time = std::max(flow.virtual_time, system_virtual_time);
+      }
+      flow_backlog.push(std::move(popped));
+    }
+  }
 
-  // Clean up expired tasks first
-  cleanup_expired_tasks();
+  for (int level = n_priorities - 1; level >= min_priority; --level) {
+    auto &flows = backlog[level];
+    while (!flows.empty()) {
+      auto best = flows.end();
+      FairFlow *best_flow = nullptr;
+      for (auto it = flows.begin(); it != flows.end(); ++it) {
+        FairFlow &flow = fair_flows[it->first];
+        if (!best_flow || flow.virtual_time < best_flow->virtual_time) {
+          best = it;
+          best_flow = &flow;
+        }
+      }
 
-  // Dequeue from highest priority queue first
-  if (!high_priority_queue.empty()) {
-    task = std::move(high_priority_queue.front());
-    high_priority_queue.pop_front();
-  } else if (!normal_priority_queue.empty()) {
-    task = std::move(normal_priority_queue.front());
-    normal_priority_queue.pop_front();
-  } else if (!low_priority_queue.empty()) {
-    task = std::move(low_priority_queue.front());
-    low_priority_queue.pop_front();
-  } else {
-    return false; // No tasks available
+      next = best->second.pop();
+      if (best->second.empty()) {
+        flows.erase(best);
+      }
+      if (!claim_popped(*next)) {
+        continue;
+      }
+
+      // Charge the expected cost now so concurrent processors see it
+      system_virtual_time = std::max(system_virtual_time, best_flow->virtual_time);
+      next->charged_cost = best_flow->expected_cost;
+      best_flow->virtual_time += next->charged_cost / next->weight;
+      return true;
+    }
+  }
+  return false;
+}
+
+void wasi_nn_task_queue::charge(const wasi_nn_task &task, uint64_t n_tokens)
+{
+  if (!fair_scheduling) {
+    return;
   }
 
-  current_size--;
+  std::lock_guard<std::mutex> lock(dispatch_mutex);
+  FairFlow &flow = fair_flows[task.flow];
+  const double cost = (double)std::max<uint64_t>(n_tokens, 1);
+  flow.virtual_time += (cost - task.charged_cost) / task.weight;
+  flow.expected_cost = 0.5 * flow.expected_cost + 0.5 * cost;
 
-  // Use advanced logging if available
-  if (ctx) {
-    log_task_operation(ctx, "Task Dequeued", task.id, task.priority,
-                      "Queue: " + std::to_string(current_size) + "/" + std::to_string(max_queue_size));
-  } else {
-    NN_INFO_PRINTF("Dequeued task %d with priority %d. Queue size: %d/%d",
-                   task.id, (int)task.priority, current_size, max_queue_size);
+  // Forget idle flows that owe nothing, so closed sessions do not pile up
+  if (fair_flows.size() > 4096) {
+    for (auto it = fair_flows.begin(); it != fair_flows.end();) {
+      bool backlogged = false;
+      for (const auto &flows : backlog) {
+        backlogged = backlogged || flows.count(it->first) > 0;
+      }
+      if (!backlogged && it->second.virtual_time <= system_virtual_time) {
+        it = fair_flows.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+
+bool wasi_nn_task_queue::dequeue_task(wasi_nn_task &task, LlamaChatContext* ctx, bool urgent_lane)
+{
+  std::unique_ptr<wasi_nn_task> next;
+  while (running.load()) {
+    const uint64_t urgent_seen = urgent_submitted.load();
+    if (pop_next(next, urgent_lane ? urgent_lane_priority : WASI_NN_PRIORITY_LOW)) {
+      task = std::move(*next);
+      NN_DBG_PRINTF("Dequeued task %d with priority %d. Queue size: %u/%u",
+                    task.id, (int)task.priority, current_size.load(), max_queue_size);
+      return true;
+    }
+
+    // Lower-priority work is left to the general processors
+    if (urgent_lane) {
+      urgent_lane_idle.store(true);
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        urgent_condition.wait(lock, [this, urgent_seen] {
+          return !running.load() || urgent_submitted.load() != urgent_seen;
+        });
+      }
+      urgent_lane_idle.store(false);
+      continue;
+    }
+
+    // A submitter may sit between reserving its place and pushing the task
+    if (current_size.load() > 0) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    // Every ring is empty: sleep until a submitter finds us idle
+    idle_processors.fetch_add(1);
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      queue_condition.wait(lock, [this] {
+        return !running.load() || current_size.load() > 0;
+      });
+    }
+    idle_processors.fetch_sub(1);
+  }
+
+  return false;
+}
+
+bool wasi_nn_task_queue::expire_task(wasi_nn_task_handle &handle, wasi_nn_error status)
+{
+  if (!handle.claim()) {
+    return false;
   }
 
+  // The task stays in its ring; the processor that pops it drops it
+  current_size.fetch_sub(1, std::memory_order_acq_rel);
+  if (status == timeout) {
+    tasks_timeout.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    tasks_cancelled.fetch_add(1, std::memory_order_relaxed);
+  }
+  handle.promise.set_value({status, ""});
   return true;
 }
 
-void wasi_nn_task_queue::cleanup_expired_tasks()
+void wasi_nn_task_queue::stop()
 {
-  // Note: This method assumes the queue_mutex is already locked
-  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    running = false;
+  }
+  queue_condition.notify_all();
+  urgent_condition.notify_all();
+}
 
-  auto cleanup_queue = [&](std::deque<wasi_nn_task> &queue) {
-    auto it = queue.begin();
-    while (it != queue.end()) {
-      if (now > it->timeout_at) {
-        NN_WARN_PRINTF("Task %d expired (created %ldms ago)",
-                       it->id,
-                       std::chrono::duration_cast<std::chrono::milliseconds>(
-                         now - it->created_at).count());
-        it = queue.erase(it);
-        current_size--;
-        tasks_timeout++;
-      } else {
-        ++it;
+void wasi_nn_task_queue::fail_pending(wasi_nn_error status)
+{
+  std::unique_ptr<wasi_nn_task> queued;
+  for (auto &ring : rings) {
+    while (ring && ring->try_pop(queued)) {
+      if (queued->handle) {
+        expire_task(*queued->handle, status);
       }
     }
-  };
+  }
 
-  cleanup_queue(high_priority_queue);
-  cleanup_queue(normal_priority_queue);
-  cleanup_queue(low_priority_queue);
+  std::lock_guard<std::mutex> lock(dispatch_mutex);
+  for (auto &flows : backlog) {
+    for (auto &pair : flows) {
+      for (auto &task : pair.second.tasks) {
+        if (task->handle) {
+          expire_task(*task->handle, status);
+        }
+      }
+    }
+    flows.clear();
+  }
 }
 
 void wasi_nn_task_queue::get_queue_status(uint32_t &queued, uint32_t &active, uint32_t &capacity)
 {
-  std::unique_lock<std::mutex> lock(queue_mutex);
-  queued = current_size;
-  active = tasks_queued - tasks_completed - tasks_timeout - tasks_rejected;
+  queued = current_size.load();
+  // Rejected tasks never entered the queue, so they are not part of tasks_queued
+  active = tasks_queued.load() - tasks_completed.load() - tasks_timeout.load() - tasks_cancelled.load() - queued;
   capacity = max_queue_size;
 }
 
@@ -768,6 +2201,8 @@ void wasi_nn_task_queue::get_queue_status(uint32_t &queued, uint32_t &active, ui
 // ================================================
 
 // Memory monitoring and pressure detection
+// Anonymous resident memory: mmapped weights and page cache are left out, since
+// dropping KV cells or sessions cannot lower them
 static uint64_t get_current_memory_usage() {
   // Simple implementation using /proc/self/status on Linux
   FILE* file = fopen("/proc/self/status", "r");
@@ -779,7 +2214,7 @@ static uint64_t get_current_memory_usage() {
   uint64_t rss_kb = 0;
 
   while (fgets(line, sizeof(line), file)) {
-    if (sscanf(line, "VmRSS: %lu kB", &rss_kb) == 1) {
+    if (sscanf(line, "RssAnon: %lu kB", &rss_kb) == 1) {
       break;
     }
   }
@@ -788,61 +2223,196 @@ static uint64_t get_current_memory_usage() {
   return rss_kb * 1024; // Convert to bytes
 }
 
-static bool check_memory_pressure(LlamaChatContext* chat_ctx) {
-  if (chat_ctx->max_memory_mb == 0) {
-    return false; // No memory limit set
-  }
+// Pressure levels published by the memory governor
+enum MemoryPressureLevel {
+  MEMORY_PRESSURE_NONE = 0,
+  MEMORY_PRESSURE_ELEVATED = 1,  // trim the KV cache of idle sessions
+  MEMORY_PRESSURE_CRITICAL = 2,  // also evict the least recently used idle sessions
+};
 
-  uint64_t current_mb = chat_ctx->current_memory_usage.load() / (1024 * 1024);
-  uint64_t max_mb = chat_ctx->max_memory_mb;
-  float usage_ratio = (float)current_mb / max_mb;
+// Reads the level the governor last published; no I/O on the inference path
+static bool check_memory_pressure(LlamaChatContext* chat_ctx) {
+  return chat_ctx->memory_pressure_level.load() != MEMORY_PRESSURE_NONE;
+}
 
-  return usage_ratio >= chat_ctx->memory_pressure_threshold;
+// Context shifting needs both the config switch and a context whose memory can shift
+static bool context_shift_available(LlamaChatContext *chat_ctx)
+{
+  return chat_ctx->context_shifting_enabled && chat_ctx->server_ctx.params_base.ctx_shift;
 }
 
-// Context shifting implementation based on server.cpp
-static wasi_nn_error perform_context_shift(LlamaChatContext* chat_ctx, uint32_t session_id) {
-  if (!chat_ctx->context_shifting_enabled) {
-    NN_ERR_PRINTF("Context shifting is disabled");
-    return runtime_error;
+// The "smart" cache strategy evicts the way StreamingLLM does: the first tokens
+// act as attention sinks and always stay, the most recent window stays, and
+// everything between goes. A sequence then settles at sinks plus window however
+// long the conversation runs, so memory and per-token cost stay constant.
+
+// n_keep for the slot parameters, clamped so a shift always has room to discard.
+// The "smart" strategy keeps at least the attention sinks.
+static int context_keep_tokens(LlamaChatContext *chat_ctx, int n_ctx_slot)
+{
+  int n_keep = (int)chat_ctx->n_keep_tokens;
+  if (chat_ctx->cache_strategy == "smart") {
+    n_keep = std::max(n_keep, (int)chat_ctx->kv_sink_tokens);
   }
+  return std::min(n_keep, n_ctx_slot / 2);
+}
 
-  auto& server_ctx = chat_ctx->server_ctx;
-  llama_context* ctx = server_ctx.ctx;
+// First discardable position; the engine's own shift in update_slots() keeps
+// n_keep plus the BOS token, so ours starts at the same place
+static int context_shift_start(LlamaChatContext *chat_ctx, int n_ctx_slot)
+{
+  return context_keep_tokens(chat_ctx, n_ctx_slot) + (chat_ctx->server_ctx.add_bos_token ? 1 : 0);
+}
 
-  if (!ctx) {
-    NN_ERR_PRINTF("No context available for shifting");
+// Recent tokens the "smart" strategy keeps after the first n_keep: kv_window_tokens,
+// or half of the rest of the slot, leaving room for n_reserve new tokens
+static int recent_window_tokens(LlamaChatContext *chat_ctx, int n_ctx_slot, int n_keep, int n_reserve)
+{
+  const int n_window = chat_ctx->kv_window_tokens > 0 ? (int)chat_ctx->kv_window_tokens
+                                                      : (n_ctx_slot - n_keep) / 2;
+  return std::max(0, std::min(n_window, n_ctx_slot - n_keep - n_reserve));
+}
+
+// Tokens to discard after the first n_keep when n_left more are cached and
+// n_reserve new ones must fit: down to the recent window under "smart",
+// otherwise n_discard_tokens or half of the rest. Always at least the overflow.
+static int context_discard_tokens(LlamaChatContext *chat_ctx, int n_ctx_slot, int n_keep, int n_left, int n_reserve)
+{
+  int n_discard;
+  if (chat_ctx->cache_strategy == "smart") {
+    n_discard = n_left - recent_window_tokens(chat_ctx, n_ctx_slot, n_keep, n_reserve);
+  } else {
+    n_discard = chat_ctx->n_discard_tokens > 0 ? (int)chat_ctx->n_discard_tokens : (n_left / 2);
+  }
+  const int n_overflow = n_keep + n_left + n_reserve - n_ctx_slot;
+  return std::min(std::max(n_discard, n_overflow), n_left);
+}
+
+// Number of positions held by a slot's sequence. Engine thread only.
+static int sequence_n_past(server_context &server_ctx, const server_slot &slot)
+{
+  return std::max(0, llama_memory_seq_pos_max(llama_get_memory(server_ctx.ctx), slot.id) + 1);
+}
+
+// Drop positions [p0, p1) of a slot's sequence and move the rest down, keeping
+// the cache_tokens mirror in step the way update_slots() does. Engine thread only.
+static int discard_sequence_range(server_context &server_ctx, server_slot &slot, int p0, int p1)
+{
+  const int n_past = sequence_n_past(server_ctx, slot);
+  p1 = std::min(p1, n_past);
+  if (p0 < 0 || p0 >= p1) {
+    return 0;
+  }
+  const int n_discard = p1 - p0;
+
+  llama_memory_t mem = llama_get_memory(server_ctx.ctx);
+  llama_memory_seq_rm(mem, slot.id, p0, p1);
+  llama_memory_seq_add(mem, slot.id, p1, n_past, -n_discard);
+
+  if ((int)slot.cache_tokens.size() > p0) {
+    llama_tokens new_tokens = slot.cache_tokens.get_text_tokens(); // copy
+    new_tokens.erase(new_tokens.begin() + p0,
+                     new_tokens.begin() + std::min((size_t)p1, new_tokens.size()));
+    slot.cache_tokens.clear();
+    slot.cache_tokens.insert(new_tokens);
+  }
+  return n_discard;
+}
+
+// Drop everything from position p0 on. Engine thread only.
+static int truncate_sequence(server_context &server_ctx, server_slot &slot, int p0)
+{
+  const int n_past = sequence_n_past(server_ctx, slot);
+  if (p0 < 0 || p0 >= n_past) {
+    return 0;
+  }
+  llama_memory_seq_rm(llama_get_memory(server_ctx.ctx), slot.id, p0, -1);
+  if (slot.cache_tokens.size() > (size_t)p0) {
+    slot.cache_tokens.keep_first(p0);
+  }
+  return n_past - p0;
+}
+
+// Mark the sessions decoding into these sequences so their next turn maps the
+// prompt onto the sequence again; caller holds sessions_mutex
+static void invalidate_session_shift(LlamaChatContext *chat_ctx, const std::vector<llama_seq_id> &seq_ids)
+{
+  for (auto &pair : chat_ctx->sessions) {
+    if (std::find(seq_ids.begin(), seq_ids.end(), pair.second.seq_id) != seq_ids.end()) {
+      pair.second.shift_unknown = true;
+    }
+  }
+}
+
+// Context shifting implementation based on server.cpp. Shifts a session's idle
+// sequence only when n_needed more tokens would not fit its slot, using the
+// real sequence length. Caller holds sessions_mutex.
+static wasi_nn_error perform_context_shift(LlamaChatContext* chat_ctx, uint32_t session_id, int n_needed = 1) {
+  if (!context_shift_available(chat_ctx)) {
+    NN_ERR_PRINTF("Context shifting is disabled");
     return runtime_error;
   }
 
-  const int n_ctx = llama_n_ctx(ctx);
-  const int n_keep = chat_ctx->n_keep_tokens;
+  auto& server_ctx = chat_ctx->server_ctx;
+  llama_context* ctx = server_ctx.ctx;
 
-  // In server.cpp, n_past is tracked per slot - here we use a simplified approach
-  // For a full implementation, you would track n_past per session
-  int n_past = n_ctx * 0.8f; // Assume 80% filled as a simplified estimate
-  const int n_left = n_past - n_keep;
+  if (!ctx) {
+    NN_ERR_PRINTF("No context available for shifting");
+    return runtime_error;
+  }
 
-  if (n_left <= 0) {
-    NN_WARN_PRINTF("No tokens to shift (n_past=%d, n_keep=%d)", n_past, n_keep);
+  // Sessions are addressed by execution context, the KV cache by sequence
+  const llama_seq_id seq_id = session_seq_id(chat_ctx, session_id);
+  if (seq_id < 0) {
+    NN_DBG_PRINTF("Session %u has no KV sequence, nothing to shift", session_id);
     return success;
   }
 
-  const int n_discard = chat_ctx->n_discard_tokens > 0 ?
-                        chat_ctx->n_discard_tokens : (n_left / 2);
+  int n_past = 0;
+  int n_keep = 0;
+  int n_discard = 0;
+  bool busy = false;
+  run_on_engine_thread(chat_ctx, [&]() {
+    server_slot *slot = server_ctx.get_slot_by_id(seq_id);
+    if (!slot || slot->is_processing()) {
+      busy = true;
+      return;
+    }
+
+    n_past = sequence_n_past(server_ctx, *slot);
+    if (n_past + n_needed <= slot->n_ctx) {
+      return;
+    }
+
+    n_keep = context_shift_start(chat_ctx, slot->n_ctx);
+    const int n_left = n_past - n_keep;
+    if (n_left <= 0) {
+      return;
+    }
+
+    n_discard = context_discard_tokens(chat_ctx, slot->n_ctx, n_keep, n_left, n_needed);
+    n_discard = discard_sequence_range(server_ctx, *slot, n_keep, n_keep + n_discard);
+  });
 
-  NN_INFO_PRINTF("Performing context shift: n_keep=%d, n_left=%d, n_discard=%d",
-                 n_keep, n_left, n_discard);
+  if (busy) {
+    NN_WARN_PRINTF("Session %u is generating, sequence %d not shifted", session_id, seq_id);
+    return runtime_error;
+  }
+  if (n_discard == 0) {
+    NN_DBG_PRINTF("Session %u fits its context (n_past=%d, n_needed=%d), no shift", session_id, n_past, n_needed);
+    return success;
+  }
 
-  // Perform the actual context shift using llama.cpp memory functions
-  llama_memory_seq_rm(llama_get_memory(ctx), session_id, n_keep, n_keep + n_discard);
-  llama_memory_seq_add(llama_get_memory(ctx), session_id, n_keep + n_discard, n_past, -n_discard);
+  chat_ctx->prefix_cache.erase(seq_id);
+  invalidate_session_shift(chat_ctx, {seq_id});
+  chat_ctx->context_shifts++;
 
-  NN_INFO_PRINTF("Context shift completed successfully");
+  NN_INFO_PRINTF("Context shift for session %u: n_past=%d, n_keep=%d, n_discard=%d",
+                 session_id, n_past, n_keep, n_discard);
   return success;
 }
 
-// Partial KV cache deletion strategies
+// Partial KV cache deletion strategies; caller holds sessions_mutex
 static wasi_nn_error clear_partial_kv_cache(LlamaChatContext* chat_ctx, uint32_t session_id,
                                            const std::string& strategy) {
   if (!chat_ctx->enable_partial_cache_deletion) {
@@ -858,41 +2428,68 @@ static wasi_nn_error clear_partial_kv_cache(LlamaChatContext* chat_ctx, uint32_t
     return runtime_error;
   }
 
-  const int n_ctx = llama_n_ctx(ctx);
-  // Simplified approach - estimate current usage as 80% of context size
-  const int n_past = n_ctx * 0.8f;
-
-  if (strategy == "lru") {
-    // Clear the oldest entries (simplified implementation)
-    const int n_clear = n_past / 4; // Clear 25% of oldest entries
+  if (strategy != "lru" && strategy != "fifo" && strategy != "smart") {
+    NN_ERR_PRINTF("Unknown cache deletion strategy: %s", strategy.c_str());
+    return invalid_argument;
+  }
 
-    if (n_clear > 0) {
-      llama_memory_seq_rm(llama_get_memory(ctx), session_id, 0, n_clear);
-      NN_INFO_PRINTF("Cleared %d oldest KV cache entries using LRU strategy", n_clear);
+  // session_id 0 applies the strategy to every idle session's sequence
+  std::vector<llama_seq_id> seq_ids;
+  if (session_id == 0) {
+    for (const auto &pair : chat_ctx->sessions) {
+      if (pair.second.seq_id >= 0 && !pair.second.in_flight) {
+        seq_ids.push_back(pair.second.seq_id);
+      }
     }
-  } else if (strategy == "fifo") {
-    // Clear the newest entries
-    const int n_clear = n_past / 4;
-
-    if (n_clear > 0) {
-      llama_memory_seq_rm(llama_get_memory(ctx), session_id, n_past - n_clear, n_past);
-      NN_INFO_PRINTF("Cleared %d newest KV cache entries using FIFO strategy", n_clear);
+  } else {
+    const llama_seq_id seq_id = session_seq_id(chat_ctx, session_id);
+    if (seq_id >= 0) {
+      seq_ids.push_back(seq_id);
     }
-  } else if (strategy == "smart") {
-    // Smart deletion based on token importance (simplified)
-    const int n_keep = chat_ctx->n_keep_tokens;
-    const int n_clear = (n_past - n_keep) / 2;
+  }
+
+  run_on_engine_thread(chat_ctx, [&]() {
+    for (llama_seq_id seq_id : seq_ids) {
+      server_slot *slot = server_ctx.get_slot_by_id(seq_id);
+      if (!slot || slot->is_processing()) {
+        continue;
+      }
 
-    if (n_clear > 0) {
-      // Keep important tokens at the beginning and end, clear middle
-      const int clear_start = n_keep + n_clear / 2;
-      llama_memory_seq_rm(llama_get_memory(ctx), session_id, clear_start, clear_start + n_clear);
-      NN_INFO_PRINTF("Cleared %d middle KV cache entries using smart strategy", n_clear);
+      // Positions stay contiguous so the slot's prefix matching remains valid
+      const int n_past = sequence_n_past(server_ctx, *slot);
+      const int n_keep = std::min(context_shift_start(chat_ctx, slot->n_ctx), n_past);
+      if (strategy == "lru") {
+        // Clear the oldest entries after the kept prefix
+        const int n_clear = discard_sequence_range(server_ctx, *slot, n_keep, n_keep + (n_past - n_keep) / 4);
+        if (n_clear > 0) {
+          NN_INFO_PRINTF("Cleared %d oldest KV cache entries of sequence %d using LRU strategy", n_clear, seq_id);
+        }
+      } else if (strategy == "fifo") {
+        // Clear the newest entries
+        const int n_clear = truncate_sequence(server_ctx, *slot, n_past - n_past / 4);
+        if (n_clear > 0) {
+          NN_INFO_PRINTF("Cleared %d newest KV cache entries of sequence %d using FIFO strategy", n_clear, seq_id);
+        }
+      } else if (strategy == "smart") {
+        // Keep the attention sinks and the most recent window, clear the middle;
+        // at least half of what follows the sinks goes so the eviction always frees something
+        const int n_bos = server_ctx.add_bos_token ? 1 : 0;
+        const int n_sink = std::min(std::max(n_keep, (int)chat_ctx->kv_sink_tokens + n_bos), n_past);
+        const int n_window = std::min(recent_window_tokens(chat_ctx, slot->n_ctx, n_sink, 1),
+                                      (n_past - n_sink) / 2);
+        const int n_clear = discard_sequence_range(server_ctx, *slot, n_sink, n_past - n_window);
+        if (n_clear > 0) {
+          NN_INFO_PRINTF("Cleared %d middle KV cache entries of sequence %d using smart strategy "
+                         "(%d sink + %d recent tokens kept)", n_clear, seq_id, n_sink, n_window);
+        }
+      }
     }
-  } else {
-    NN_ERR_PRINTF("Unknown cache deletion strategy: %s", strategy.c_str());
-    return invalid_argument;
+  });
+
+  for (llama_seq_id seq_id : seq_ids) {
+    chat_ctx->prefix_cache.erase(seq_id);
   }
+  invalidate_session_shift(chat_ctx, seq_ids);
 
   return success;
 }
@@ -911,11 +2508,12 @@ static wasi_nn_error optimize_token_cache(LlamaChatContext* chat_ctx, uint32_t s
     return runtime_error;
   }
 
-  const int n_ctx = llama_n_ctx(ctx);
-  // Simplified approach - estimate cached tokens
-  const int n_cached = n_ctx * 0.7f; // Assume 70% cached
+  // Tokens the session's sequence holds, or every sequence for session_id 0
+  const uint64_t n_cached = session_id == 0 ?
+      chat_ctx->kv_accounting.spanned_tokens() :
+      (uint64_t)chat_ctx->kv_accounting.sequence_tokens(session_seq_id(chat_ctx, session_id));
 
-  if (n_cached > (int)chat_ctx->max_cache_tokens) {
+  if (n_cached > chat_ctx->max_cache_tokens) {
     // Perform cache cleanup
     wasi_nn_error result = clear_partial_kv_cache(chat_ctx, session_id,
                                                   chat_ctx->cache_deletion_strategy);
@@ -924,19 +2522,17 @@ static wasi_nn_error optimize_token_cache(LlamaChatContext* chat_ctx, uint32_t s
       return result;
     }
 
-    chat_ctx->cache_hits++;
-    NN_INFO_PRINTF("Token cache optimized: %d tokens cached, hit ratio: %.2f%%",
-                    n_cached,
-                    (float)chat_ctx->cache_hits.load() /
-                    (chat_ctx->cache_hits.load() + chat_ctx->cache_misses.load()) * 100.0f);
-  } else {
-    chat_ctx->cache_misses++;
+    NN_INFO_PRINTF("Token cache optimized: %llu -> %llu tokens cached", (unsigned long long)n_cached,
+                   (unsigned long long)(session_id == 0 ?
+                       chat_ctx->kv_accounting.spanned_tokens() :
+                       (uint64_t)chat_ctx->kv_accounting.sequence_tokens(session_seq_id(chat_ctx, session_id))));
   }
 
   return success;
 }
 
 // Complete KV cache clear (based on server.cpp implementation)
+// session_id 0 clears every idle sequence; otherwise the caller holds sessions_mutex
 static wasi_nn_error clear_kv_cache(LlamaChatContext* chat_ctx, uint32_t session_id) {
   auto& server_ctx = chat_ctx->server_ctx;
   llama_context* ctx = server_ctx.ctx;
@@ -949,15 +2545,34 @@ static wasi_nn_error clear_kv_cache(LlamaChatContext* chat_ctx, uint32_t session
   NN_INFO_PRINTF("Clearing KV cache for session %u", session_id);
 
   if (session_id == 0) {
-    // Clear entire KV cache
-    llama_memory_clear(llama_get_memory(ctx), true);
+    // KV cells and slot token mirrors belong to the engine thread
+    run_on_engine_thread(chat_ctx, [&]() {
+      // Clear every idle slot; in-flight generations keep their sequences
+      for (auto &slot : server_ctx.slots) {
+        if (slot.is_processing()) {
+          continue;
+        }
+        llama_memory_seq_rm(llama_get_memory(ctx), slot.id, -1, -1);
+        slot.cache_tokens.clear();
+        chat_ctx->prefix_cache.erase(slot.id);
+      }
+    });
     NN_INFO_PRINTF("Cleared entire KV cache");
-  } else {
-    // Clear cache for specific session
-    llama_memory_seq_rm(llama_get_memory(ctx), session_id, -1, -1);
-    NN_INFO_PRINTF("Cleared KV cache for session %u", session_id);
+    return success;
+  }
+
+  // Clear cache for specific session; its sequence stays bound to it
+  const llama_seq_id seq_id = session_seq_id(chat_ctx, session_id);
+  if (seq_id < 0) {
+    NN_DBG_PRINTF("Session %u has no KV sequence, nothing to clear", session_id);
+    return success;
+  }
+  if (!reset_sequence(chat_ctx, seq_id)) {
+    NN_WARN_PRINTF("Session %u is generating, KV sequence %d not cleared", session_id, seq_id);
+    return runtime_error;
   }
 
+  NN_INFO_PRINTF("Cleared KV cache for session %u (sequence %d)", session_id, seq_id);
   return success;
 }
 
@@ -965,23 +2580,52 @@ static wasi_nn_error clear_kv_cache(LlamaChatContext* chat_ctx, uint32_t session
 static wasi_nn_error handle_memory_pressure(LlamaChatContext* chat_ctx) {
   NN_WARN_PRINTF("Memory pressure detected, initiating cleanup");
 
-  // Strategy 1: Clear partial caches for all active sessions
-  wasi_nn_error result = clear_partial_kv_cache(chat_ctx, 0, chat_ctx->cache_deletion_strategy);
-  if (result != success) {
-    NN_WARN_PRINTF("Partial cache cleanup failed, trying full cache clear");
+  KvAccounting &kv = chat_ctx->kv_accounting;
+  // Only the host-resident part of the cache counts towards process memory
+  const uint64_t bytes_per_token = kv.host_token_bytes();
+  if (bytes_per_token == 0) {
+    NN_INFO_PRINTF("Memory pressure: the KV cache is in VRAM, trimming it frees no host memory");
+    return success;
+  }
+  const uint64_t max_bytes = chat_ctx->memory_limit_bytes.load();
+  const uint64_t target_bytes = (uint64_t)(max_bytes * chat_ctx->memory_pressure_threshold);
+  const uint64_t current_bytes = chat_ctx->current_memory_usage.load();
+  const uint64_t excess_bytes = current_bytes > target_bytes ? current_bytes - target_bytes : 0;
+
+  // Strategy 1: Trim the idle sessions holding the most KV tokens first, until
+  // the excess over the pressure threshold has been released
+  std::vector<std::pair<int32_t, graph_execution_context>> candidates;
+  for (const auto &pair : chat_ctx->sessions) {
+    const int32_t n_tokens = kv.sequence_tokens(pair.second.seq_id);
+    if (pair.second.seq_id >= 0 && !pair.second.in_flight && n_tokens > 0) {
+      candidates.emplace_back(n_tokens, pair.first);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(), std::greater<>());
+
+  // No wholesale clear when nothing is left to trim: the governor relieves each
+  // pressure episode once, and critical pressure evicts whole sessions instead
+  if (candidates.empty()) {
+    NN_INFO_PRINTF("Memory pressure: no idle KV cache left to trim");
+    return success;
+  }
 
-    // Strategy 2: Clear entire cache if partial cleanup failed
-    result = clear_kv_cache(chat_ctx, 0);
+  uint64_t freed_bytes = 0;
+  for (const auto &candidate : candidates) {
+    wasi_nn_error result = clear_partial_kv_cache(chat_ctx, candidate.second, chat_ctx->cache_deletion_strategy);
     if (result != success) {
-      NN_ERR_PRINTF("Failed to handle memory pressure");
-      return result;
+      NN_WARN_PRINTF("Partial cache cleanup of session %d failed: %d", candidate.second, result);
+      continue;
+    }
+    const int32_t n_left = kv.sequence_tokens(session_seq_id(chat_ctx, candidate.second));
+    freed_bytes += (uint64_t)std::max(0, candidate.first - n_left) * bytes_per_token;
+    if (excess_bytes > 0 && freed_bytes >= excess_bytes) {
+      break;
     }
   }
 
-  // Update memory tracking
-  chat_ctx->current_memory_usage.store(get_current_memory_usage());
-
-  NN_INFO_PRINTF("Memory pressure handling completed");
+  NN_INFO_PRINTF("Memory pressure handling completed: released %.1f MiB of KV cache, %llu tokens still cached",
+                 freed_bytes / (1024.0 * 1024.0), (unsigned long long)kv.spanned_tokens());
   return success;
 }
 
@@ -1056,6 +2700,167 @@ std::string cjson_get_value<std::string>(cJSON *root, const char *key, const std
   return default_value;
 }
 
+// ============================================================================
+// Phase 6.11: Request Memory
+// ============================================================================
+// The cJSON tree of a runtime config is the largest set of short-lived heap
+// objects a request creates. Only JSON parsing is arena-backed: while a
+// RequestArenaScope is open, cJSON on that thread allocates from the thread's
+// RequestArena and its frees are no-ops. One fixed hook set is installed when
+// the library loads and never swapped; everywhere else (other threads, config
+// parsing, session files) it falls through to malloc/free.
+
+static thread_local RequestArena *t_request_arena = nullptr;
+
+static void *request_arena_malloc(size_t size)
+{
+  return t_request_arena ? t_request_arena->allocate(size) : malloc(size);
+}
+
+static void request_arena_free(void *ptr)
+{
+  if (ptr && !(t_request_arena && t_request_arena->owns(ptr))) {
+    free(ptr);
+  }
+}
+
+// Runs before any backend call can use cJSON
+__attribute__((constructor)) static void install_request_arena_hooks()
+{
+  cJSON_Hooks hooks = {request_arena_malloc, request_arena_free};
+  cJSON_InitHooks(&hooks);
+}
+
+// Open the calling thread's arena for one request. Everything allocated from
+// it must be released before the scope closes. Nested scopes share the outer one.
+class RequestArenaScope
+{
+public:
+  explicit RequestArenaScope(LlamaChatContext *ctx) : chat_ctx(ctx)
+  {
+    if (!t_request_arena) {
+      static thread_local RequestArena arena;
+      t_request_arena = &arena;
+      owner = true;
+    }
+  }
+
+  ~RequestArenaScope()
+  {
+    if (!owner) {
+      return;
+    }
+    RequestArena &arena = *t_request_arena;
+    t_request_arena = nullptr;
+    if (chat_ctx) {
+      chat_ctx->arena_requests++;
+      chat_ctx->arena_heap_allocs += arena.heap_allocs;
+      uint64_t peak = chat_ctx->arena_peak_bytes.load();
+      while (arena.bytes_used > peak && !chat_ctx->arena_peak_bytes.compare_exchange_weak(peak, arena.bytes_used)) {
+      }
+    }
+    arena.reset();
+  }
+
+  RequestArenaScope(const RequestArenaScope &) = delete;
+  RequestArenaScope &operator=(const RequestArenaScope &) = delete;
+
+private:
+  LlamaChatContext *chat_ctx;
+  bool owner = false;
+};
+
+// Reuse a scratch buffer's capacity and count the times it had to grow
+template <typename Buffer>
+static void note_scratch_growth(LlamaChatContext *chat_ctx, const Buffer &buffer, size_t capacity_before)
+{
+  if (buffer.capacity() > capacity_before) {
+    chat_ctx->scratch_reallocs++;
+  }
+}
+
+// ============================================================================
+// Phase 6.12: Shared Model Registry
+// ============================================================================
+
+// Registry key for loading params.model, or "" when the load must stay private
+static std::string shared_model_key(const common_params &params)
+{
+  char resolved[PATH_MAX];
+  struct stat file_stat;
+  if (params.model.path.empty() || !realpath(params.model.path.c_str(), resolved) ||
+      stat(resolved, &file_stat) != 0) {
+    return "";
+  }
+  // Overrides change the loaded tensors themselves
+  if (!params.kv_overrides.empty() || !params.tensor_buft_overrides.empty()) {
+    return "";
+  }
+
+  std::ostringstream key;
+  key << resolved << "|size=" << file_stat.st_size << "|mtime=" << file_stat.st_mtime
+      << "|ngl=" << params.n_gpu_layers << "|main_gpu=" << params.main_gpu
+      << "|split=" << (int)params.split_mode << "|mmap=" << params.use_mmap
+      << "|mlock=" << params.use_mlock << "|check=" << params.check_tensors;
+  for (size_t i = 0; i < sizeof(params.tensor_split) / sizeof(params.tensor_split[0]); i++) {
+    if (params.tensor_split[i] != 0.0f) {
+      key << "|ts" << i << "=" << params.tensor_split[i];
+    }
+  }
+  for (ggml_backend_dev_t dev : params.devices) {
+    key << "|dev=" << (dev ? ggml_backend_dev_name(dev) : "none");
+  }
+  return key.str();
+}
+
+// Model provider for server_context: the registry's copy of the model, loaded
+// on first use. nullptr makes the caller load privately (which also reports
+// load errors the usual way).
+static std::shared_ptr<llama_model> acquire_shared_model(LlamaChatContext *chat_ctx, common_params &params)
+{
+  const std::string key = shared_model_key(params);
+  if (key.empty()) {
+    WASI_NN_LOG_DEBUG(chat_ctx, "Model %s is loaded privately", params.model.path.c_str());
+    return nullptr;
+  }
+
+  std::shared_ptr<SharedModelEntry> entry;
+  {
+    std::lock_guard<std::mutex> lock(g_model_registry_mutex);
+    // Forget models nobody uses or is loading; a rewritten file gets a new key
+    for (auto it = g_model_registry.begin(); it != g_model_registry.end();) {
+      if (it->second.use_count() == 1 && it->second->model.expired()) {
+        it = g_model_registry.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    std::shared_ptr<SharedModelEntry> &slot = g_model_registry[key];
+    if (!slot) {
+      slot = std::make_shared<SharedModelEntry>();
+    }
+    entry = slot;
+  }
+
+  std::lock_guard<std::mutex> load_lock(entry->load_mutex);
+  std::shared_ptr<llama_model> model = entry->model.lock();
+  if (model) {
+    WASI_NN_LOG_INFO(chat_ctx, "Reusing loaded model %s (%ld backends)",
+                     params.model.path.c_str(), model.use_count());
+    return model;
+  }
+
+  llama_model *loaded = llama_model_load_from_file(params.model.path.c_str(), common_model_params_to_llama(params));
+  if (!loaded) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Failed to load shared model %s", params.model.path.c_str());
+    return nullptr;
+  }
+  model.reset(loaded, llama_model_free);
+  entry->model = model;
+  WASI_NN_LOG_INFO(chat_ctx, "Loaded model %s into the shared registry", params.model.path.c_str());
+  return model;
+}
+
 // Function to parse runtime parameters from JSON configuration
 static bool parse_runtime_params(const char *config_json, uint32_t config_len,
                                 wasi_nn_runtime_params &runtime_params,
@@ -1068,6 +2873,8 @@ static bool parse_runtime_params(const char *config_json, uint32_t config_len,
     return true; // Not an error, just use defaults
   }
 
+  // The parse tree only lives until this function returns
+  RequestArenaScope arena_scope(chat_ctx);
   cJSON *root = cJSON_ParseWithLength(config_json, config_len);
   if (!root) {
     if (chat_ctx) {
@@ -1140,6 +2947,23 @@ static bool parse_runtime_params(const char *config_json, uint32_t config_len,
     runtime_params.stop_sequences_set = true;
   }
 
+  // Parse tenant (fair scheduling)
+  cJSON *tenant_item = cJSON_GetObjectItem(root, "tenant");
+  if (cJSON_IsString(tenant_item) && strlen(cJSON_GetStringValue(tenant_item)) <= 128) {
+    runtime_params.tenant = cJSON_GetStringValue(tenant_item);
+    runtime_params.tenant_set = true;
+  } else if (tenant_item && chat_ctx) {
+    WASI_NN_LOG_WARN(chat_ctx, "Invalid tenant, must be a string of at most 128 characters, ignoring it");
+  }
+
+  // Parse deadline_ms (per-turn deadline)
+  cJSON *deadline_item = cJSON_GetObjectItem(root, "deadline_ms");
+  if (cJSON_IsNumber(deadline_item) && deadline_item->valuedouble >= 1 && deadline_item->valuedouble <= 600000) {
+    runtime_params.deadline_ms = (uint32_t)deadline_item->valuedouble;
+  } else if (deadline_item && chat_ctx) {
+    WASI_NN_LOG_WARN(chat_ctx, "Invalid deadline_ms, must be between 1-600000, ignoring it");
+  }
+
   // Parse grammar
   cJSON *grammar_item = cJSON_GetObjectItem(root, "grammar");
   if (cJSON_IsString(grammar_item)) {
@@ -1147,6 +2971,25 @@ static bool parse_runtime_params(const char *config_json, uint32_t config_len,
     runtime_params.grammar_set = true;
   }
 
+  // Parse priority ("low", "normal", "high", "urgent" or 0-3)
+  cJSON *priority_item = cJSON_GetObjectItem(root, "priority");
+  if (cJSON_IsString(priority_item)) {
+    static const char *const priority_names[] = {"low", "normal", "high", "urgent"};
+    for (int32_t i = 0; i < 4; i++) {
+      if (strcmp(cJSON_GetStringValue(priority_item), priority_names[i]) == 0) {
+        runtime_params.priority = i;
+      }
+    }
+  } else if (cJSON_IsNumber(priority_item)) {
+    runtime_params.priority = priority_item->valueint;
+  }
+  if (priority_item && (runtime_params.priority < WASI_NN_PRIORITY_LOW || runtime_params.priority > WASI_NN_PRIORITY_URGENT)) {
+    if (chat_ctx) {
+      WASI_NN_LOG_WARN(chat_ctx, "Invalid priority, must be low, normal, high, urgent or 0-3, keeping the session's priority");
+    }
+    runtime_params.priority = -1;
+  }
+
   // Parameter validation
   if (runtime_params.temperature > 0.0f && (runtime_params.temperature < 0.01f || runtime_params.temperature > 10.0f)) {
     if (chat_ctx) {
@@ -1177,21 +3020,12 @@ static bool parse_runtime_params(const char *config_json, uint32_t config_len,
   return true;
 }
 
-// Function to apply runtime parameters to sampling context
-static void apply_runtime_params_to_sampling(common_sampler *&sampler,
+// Function to apply runtime parameters on top of the default sampling parameters.
+// The slot sampler is rebuilt from these when the request is launched on a slot.
+static void apply_runtime_params_to_sampling(common_params_sampling &current_params,
                                             const wasi_nn_runtime_params &runtime_params,
-                                            const llama_model *model,
                                             LlamaChatContext *chat_ctx = nullptr)
 {
-  if (!sampler || !model) {
-    if (chat_ctx) {
-      WASI_NN_LOG_ERROR(chat_ctx, "Invalid sampler context or model for runtime parameter application");
-    }
-    return;
-  }
-
-  // Get current sampling parameters from the chat context
-  common_params_sampling current_params = chat_ctx->server_ctx.params_base.sampling;
   bool params_changed = false;
 
   // Apply core sampling parameters
@@ -1385,27 +3219,11 @@ static void apply_runtime_params_to_sampling(common_sampler *&sampler,
     }
   }
 
-  // If any parameters changed, recreate the sampler
-  if (params_changed) {
-    // Free the old sampler
-    common_sampler_free(sampler);
-
-    // Create new sampler with updated parameters
-    sampler = common_sampler_init(model, current_params);
-
-    if (!sampler) {
-      if (chat_ctx) {
-        WASI_NN_LOG_ERROR(chat_ctx, "Failed to recreate sampler with runtime parameters");
-      }
-      return;
-    }
-
-    if (chat_ctx) {
-      WASI_NN_LOG_INFO(chat_ctx, "Runtime parameters applied to sampler successfully - sampler recreated");
-    }
-  } else {
-    if (chat_ctx) {
-      WASI_NN_LOG_DEBUG(chat_ctx, "No runtime parameters provided or changed, using existing sampler");
+  if (chat_ctx) {
+    if (params_changed) {
+      WASI_NN_LOG_INFO(chat_ctx, "Runtime parameters applied to sampling parameters");
+    } else {
+      WASI_NN_LOG_DEBUG(chat_ctx, "No runtime parameters provided or changed, using defaults");
     }
   }
 }
@@ -1427,6 +3245,18 @@ static void parse_config_to_params(const char *config_json,
   params.n_gpu_layers = 0;
   params.cpuparams.n_threads = 8;
   params.cpuparams_batch.n_threads = 8;
+  params.n_parallel = chat_ctx ? (int32_t)chat_ctx->max_concurrent : 1;
+  params.cont_batching = true;
+  // Sharing a cached prefix copies part of one sequence into another, which
+  // llama.cpp only supports when all sequences live in one KV stream
+  if (chat_ctx && chat_ctx->enable_prefix_cache) {
+    params.kv_unified = true;
+  }
+  // Idle-time compaction replaces the defragmentation llama.cpp runs inside llama_decode()
+  if (chat_ctx && chat_ctx->kv_compaction_enabled && chat_ctx->memory_sample_interval_ms > 0) {
+    params.defrag_thold = -1.0f;
+    WASI_NN_LOG_INFO(chat_ctx, "kv_compaction is on: llama.cpp's defragmentation inside llama_decode() is disabled");
+  }
 
   // Sampling defaults (matching server.cpp defaults)
   params.sampling.temp = 0.7f;
@@ -1458,6 +3288,11 @@ static void parse_config_to_params(const char *config_json,
   params.sampling.mirostat_tau = 5.0f;
   params.sampling.mirostat_eta = 0.1f;
 
+  // The engine shifts full slots during generation only when the memory policy allows it
+  if (chat_ctx) {
+    params.ctx_shift = chat_ctx->context_shifting_enabled;
+  }
+
   if (!config_json)
   {
     if (chat_ctx) {
@@ -1488,6 +3323,15 @@ static void parse_config_to_params(const char *config_json,
     uint32_t threads = cjson_get_value(config_obj, "threads", params.cpuparams.n_threads);
     params.cpuparams.n_threads = threads;
     params.cpuparams_batch.n_threads = threads;
+
+    // Parallel slots (one KV sequence each); the context is split evenly between them
+    params.n_parallel = cjson_get_value(config_obj, "n_parallel", params.n_parallel);
+    if (params.n_parallel < 1 || params.n_parallel > 256) {
+      if (chat_ctx) {
+        WASI_NN_LOG_WARN(chat_ctx, "Invalid n_parallel (%d), must be between 1-256, using 1", params.n_parallel);
+      }
+      params.n_parallel = 1;
+    }
   };
 
   // Parse nested model configuration or legacy flat structure
@@ -1520,6 +3364,65 @@ static void parse_config_to_params(const char *config_json,
           }
       }
   }
+
+  // Parse speculative decoding (draft model) configuration; accepted at the
+  // top level or inside the "model" object
+  cJSON *speculative = cJSON_GetObjectItem(root, "speculative");
+  if (!cJSON_IsObject(speculative) && cJSON_IsObject(model_config)) {
+    speculative = cJSON_GetObjectItem(model_config, "speculative");
+  }
+  if (cJSON_IsObject(speculative))
+  {
+    params.speculative.model.path = cjson_get_value(speculative, "draft_model", params.speculative.model.path);
+    params.speculative.model.path = cjson_get_value(speculative, "model", params.speculative.model.path);  // Alternative name
+    params.speculative.n_max = cjson_get_value(speculative, "n_max", params.speculative.n_max);
+    params.speculative.n_max = cjson_get_value(speculative, "draft_max", params.speculative.n_max);  // server.cpp name
+    params.speculative.n_min = cjson_get_value(speculative, "n_min", params.speculative.n_min);
+    params.speculative.n_min = cjson_get_value(speculative, "draft_min", params.speculative.n_min);  // server.cpp name
+    params.speculative.p_min = cjson_get_value(speculative, "p_min", params.speculative.p_min);
+    params.speculative.n_ctx = cjson_get_value(speculative, "n_ctx", params.speculative.n_ctx);
+    params.speculative.n_gpu_layers = cjson_get_value(speculative, "n_gpu_layers", params.speculative.n_gpu_layers);
+
+    // The draft batch is sized from n_max when the slots are created
+    if (params.speculative.n_max < 0 || params.speculative.n_max > 64) {
+      if (chat_ctx) {
+        WASI_NN_LOG_WARN(chat_ctx, "Invalid speculative n_max (%d), must be between 0-64, using 16",
+                         params.speculative.n_max);
+      }
+      params.speculative.n_max = 16;
+    }
+
+    if (params.speculative.n_min < 0 || params.speculative.n_min > params.speculative.n_max) {
+      if (chat_ctx) {
+        WASI_NN_LOG_WARN(chat_ctx, "Invalid speculative n_min (%d), must be between 0 and n_max (%d), using 0",
+                         params.speculative.n_min, params.speculative.n_max);
+      }
+      params.speculative.n_min = 0;
+    }
+
+    if (params.speculative.p_min < 0.0f || params.speculative.p_min > 1.0f) {
+      if (chat_ctx) {
+        WASI_NN_LOG_WARN(chat_ctx, "Invalid speculative p_min (%.3f), must be between 0.0-1.0, using 0.75",
+                         params.speculative.p_min);
+      }
+      params.speculative.p_min = 0.75f;
+    }
+
+    if (params.speculative.n_ctx < 0) {
+      if (chat_ctx) {
+        WASI_NN_LOG_WARN(chat_ctx, "Invalid speculative n_ctx (%d), using 0 (per-slot target context)",
+                         params.speculative.n_ctx);
+      }
+      params.speculative.n_ctx = 0;
+    }
+
+    if (chat_ctx && !params.speculative.model.path.empty()) {
+      WASI_NN_LOG_INFO(chat_ctx, "Speculative decoding: draft=%s, n_max=%d, n_min=%d, p_min=%.2f",
+                       params.speculative.model.path.c_str(), params.speculative.n_max,
+                       params.speculative.n_min, params.speculative.p_min);
+    }
+  }
+
   // Parse sampling parameters - Legacy flat structure first (backward compatibility)
   params.sampling.temp = cjson_get_value(root, "temp", params.sampling.temp);
   params.sampling.temp = cjson_get_value(root, "temperature", params.sampling.temp);  // OpenAI compatibility
@@ -1756,6 +3659,28 @@ static void parse_memory_config(const char *config_json, LlamaChatContext *chat_
     // Discard tokens
     chat_ctx->n_discard_tokens = cjson_get_value(memory, "n_discard_tokens", chat_ctx->n_discard_tokens);
 
+    // Attention sinks and recent window of the "smart" strategy
+    uint32_t kv_sink_tokens = cjson_get_value(memory, "kv_sink_tokens", chat_ctx->kv_sink_tokens);
+    if (kv_sink_tokens <= 1024)
+    {
+      chat_ctx->kv_sink_tokens = kv_sink_tokens;
+    }
+    else
+    {
+      WASI_NN_LOG_WARN(chat_ctx, "Invalid kv_sink_tokens (%u), must be between 0-1024, using default: %u",
+                       kv_sink_tokens, chat_ctx->kv_sink_tokens);
+    }
+    uint32_t kv_window_tokens = cjson_get_value(memory, "kv_window_tokens", chat_ctx->kv_window_tokens);
+    if (kv_window_tokens == 0 || (kv_window_tokens >= 16 && kv_window_tokens <= 1048576))
+    {
+      chat_ctx->kv_window_tokens = kv_window_tokens;
+    }
+    else
+    {
+      WASI_NN_LOG_WARN(chat_ctx, "Invalid kv_window_tokens (%u), must be 0 or between 16-1048576, using default: %u",
+                       kv_window_tokens, chat_ctx->kv_window_tokens);
+    }
+
     // Memory pressure threshold with validation
     float memory_pressure_threshold = cjson_get_value(memory, "memory_pressure_threshold", chat_ctx->memory_pressure_threshold);
     if (memory_pressure_threshold >= 0.1f && memory_pressure_threshold <= 1.0f)
@@ -1772,6 +3697,19 @@ static void parse_memory_config(const char *config_json, LlamaChatContext *chat_
     // Boolean settings
     chat_ctx->enable_partial_cache_deletion = cjson_get_value(memory, "enable_partial_cache_deletion", chat_ctx->enable_partial_cache_deletion);
     chat_ctx->enable_token_cache_reuse = cjson_get_value(memory, "enable_token_cache_reuse", chat_ctx->enable_token_cache_reuse);
+    chat_ctx->enable_prefix_cache = cjson_get_value(memory, "enable_prefix_cache", chat_ctx->enable_prefix_cache);
+
+    // Minimum shared prefix worth a KV copy
+    uint32_t prefix_cache_min_tokens = cjson_get_value(memory, "prefix_cache_min_tokens", chat_ctx->prefix_cache_min_tokens);
+    if (prefix_cache_min_tokens >= 1 && prefix_cache_min_tokens <= 4096)
+    {
+      chat_ctx->prefix_cache_min_tokens = prefix_cache_min_tokens;
+    }
+    else
+    {
+      WASI_NN_LOG_WARN(chat_ctx, "Invalid prefix_cache_min_tokens (%u), must be between 1-4096, using default: %u",
+                       prefix_cache_min_tokens, chat_ctx->prefix_cache_min_tokens);
+    }
 
     // Cache deletion strategy with validation
     std::string cache_deletion_strategy = cjson_get_value(memory, "cache_deletion_strategy", chat_ctx->cache_deletion_strategy);
@@ -1806,6 +3744,59 @@ static void parse_memory_config(const char *config_json, LlamaChatContext *chat_
                        max_memory_mb, chat_ctx->max_memory_mb);
     }
 
+    // Memory governor
+    uint32_t memory_sample_interval_ms = cjson_get_value(memory, "memory_sample_interval_ms",
+                                                         chat_ctx->memory_sample_interval_ms);
+    if (memory_sample_interval_ms == 0 || (memory_sample_interval_ms >= 50 && memory_sample_interval_ms <= 60000))
+    {
+      chat_ctx->memory_sample_interval_ms = memory_sample_interval_ms;
+    }
+    else
+    {
+      WASI_NN_LOG_WARN(chat_ctx, "Invalid memory_sample_interval_ms (%u), must be 0 or between 50-60000, using default: %u",
+                       memory_sample_interval_ms, chat_ctx->memory_sample_interval_ms);
+    }
+
+    float memory_critical_threshold = cjson_get_value(memory, "memory_critical_threshold",
+                                                      chat_ctx->memory_critical_threshold);
+    if (memory_critical_threshold >= chat_ctx->memory_pressure_threshold && memory_critical_threshold <= 1.0f)
+    {
+      chat_ctx->memory_critical_threshold = memory_critical_threshold;
+    }
+    else
+    {
+      chat_ctx->memory_critical_threshold = std::max(chat_ctx->memory_pressure_threshold,
+                                                     std::min(chat_ctx->memory_critical_threshold, 1.0f));
+      WASI_NN_LOG_WARN(chat_ctx, "Invalid memory_critical_threshold (%.2f), must be between memory_pressure_threshold and 1.0, using: %.2f",
+                       memory_critical_threshold, chat_ctx->memory_critical_threshold);
+    }
+
+    float memory_psi_threshold = cjson_get_value(memory, "memory_psi_threshold", chat_ctx->memory_psi_threshold);
+    if (memory_psi_threshold > 0.0f && memory_psi_threshold <= 100.0f)
+    {
+      chat_ctx->memory_psi_threshold = memory_psi_threshold;
+    }
+    else
+    {
+      WASI_NN_LOG_WARN(chat_ctx, "Invalid memory_psi_threshold (%.1f), must be between 0-100, using default: %.1f",
+                       memory_psi_threshold, chat_ctx->memory_psi_threshold);
+    }
+
+    float memory_hysteresis = cjson_get_value(memory, "memory_hysteresis", chat_ctx->memory_hysteresis);
+    if (memory_hysteresis >= 0.0f && memory_hysteresis <= 0.5f)
+    {
+      chat_ctx->memory_hysteresis = memory_hysteresis;
+    }
+    else
+    {
+      WASI_NN_LOG_WARN(chat_ctx, "Invalid memory_hysteresis (%.2f), must be between 0-0.5, using default: %.2f",
+                       memory_hysteresis, chat_ctx->memory_hysteresis);
+    }
+
+    WASI_NN_LOG_INFO(chat_ctx, "Memory governor: interval=%u ms, critical_threshold=%.2f, psi_threshold=%.1f, hysteresis=%.2f",
+                     chat_ctx->memory_sample_interval_ms, chat_ctx->memory_critical_threshold,
+                     chat_ctx->memory_psi_threshold, chat_ctx->memory_hysteresis);
+
     WASI_NN_LOG_INFO(chat_ctx, "Memory configuration parsed successfully");
   }
   else if (cJSON_GetObjectItem(root, "memory"))
@@ -1865,6 +3856,7 @@ static wasi_nn_error auto_clear_kv_cache_session(LlamaChatContext *chat_ctx, gra
 static wasi_nn_error auto_clear_all_kv_cache(LlamaChatContext *chat_ctx);
 static wasi_nn_error auto_perform_context_shift_session(LlamaChatContext *chat_ctx, graph_execution_context exec_ctx);
 static wasi_nn_error auto_optimize_memory(LlamaChatContext *chat_ctx, graph_execution_context exec_ctx);
+static wasi_nn_error save_session_to_disk(LlamaChatContext *chat_ctx, SessionInfo &session_info);
 
 // Function to safely copy a string into tensor_data (from original)
 void copy_string_to_tensor_data(tensor_data dest, uint32_t dest_size,
@@ -1897,8 +3889,234 @@ __attribute__((visibility("default"))) wasi_nn_error init_backend(void **ctx)
   return init_backend_with_config(ctx, nullptr, 0);
 }
 
-__attribute__((visibility("default"))) wasi_nn_error
-init_backend_with_config(void **ctx, const char *config, uint32_t config_len)
+// ==============================================================================
+// Phase 6.8: Memory Governor
+// ==============================================================================
+// A background thread samples the anonymous memory (memory.stat "anon"),
+// memory.max and memory.pressure of the process's cgroup v2 (RssAnon and
+// max_memory_mb outside a cgroup) and publishes usage, limit and pressure level
+// atomically. Mapped weights and page cache are not counted: evicting KV state
+// cannot release them. Eviction is graduated and happens once per pressure
+// episode: elevated pressure trims the KV cache of idle sessions, critical
+// pressure also evicts the least recently used idle sessions. A level ends only
+// once usage falls memory_hysteresis below its threshold. The inference path
+// only reads the published level.
+
+// cgroup v2 directory of this process, empty when not under a unified hierarchy
+static std::string find_cgroup_dir()
+{
+  std::ifstream cgroup_file("/proc/self/cgroup");
+  std::string line;
+  while (std::getline(cgroup_file, line)) {
+    if (line.compare(0, 3, "0::") == 0) {
+      std::string dir = "/sys/fs/cgroup" + line.substr(3);
+      while (dir.size() > 1 && dir.back() == '/') {
+        dir.pop_back();
+      }
+      struct stat st;
+      return stat((dir + "/memory.current").c_str(), &st) == 0 ? dir : std::string();
+    }
+  }
+  return std::string();
+}
+
+// Read a cgroup value; "max" reads as 0 (no limit)
+static bool read_cgroup_value(const std::string &path, uint64_t &value)
+{
+  std::ifstream file(path);
+  std::string text;
+  if (!(file >> text)) {
+    return false;
+  }
+  value = text == "max" ? 0 : strtoull(text.c_str(), nullptr, 10);
+  return true;
+}
+
+// One "key value" entry of a cgroup stat file such as memory.stat
+static bool read_cgroup_stat(const std::string &path, const char *key, uint64_t &value)
+{
+  std::ifstream file(path);
+  std::string name;
+  uint64_t number = 0;
+  while (file >> name >> number) {
+    if (name == key) {
+      value = number;
+      return true;
+    }
+  }
+  return false;
+}
+
+// avg10 of the "some" and "full" lines of a PSI file
+static void read_psi_avg10(const std::string &path, float &some, float &full)
+{
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    float avg10 = 0.0f;
+    if (sscanf(line.c_str(), "some avg10=%f", &avg10) == 1) {
+      some = avg10;
+    } else if (sscanf(line.c_str(), "full avg10=%f", &avg10) == 1) {
+      full = avg10;
+    }
+  }
+}
+
+// Take one sample, publish it and return the resulting pressure level
+static int update_memory_pressure(LlamaChatContext *chat_ctx, const std::string &cgroup_dir)
+{
+  uint64_t usage = 0;
+  uint64_t limit = 0;
+  float psi_some = 0.0f;
+  float psi_full = 0.0f;
+
+  if (!cgroup_dir.empty() && read_cgroup_stat(cgroup_dir + "/memory.stat", "anon", usage)) {
+    read_cgroup_value(cgroup_dir + "/memory.max", limit);
+    read_psi_avg10(cgroup_dir + "/memory.pressure", psi_some, psi_full);
+  } else {
+    usage = get_current_memory_usage();
+    read_psi_avg10("/proc/pressure/memory", psi_some, psi_full);
+  }
+
+  // A configured max_memory_mb tightens the cgroup limit
+  if (chat_ctx->max_memory_mb > 0) {
+    const uint64_t configured = (uint64_t)chat_ctx->max_memory_mb * 1024 * 1024;
+    limit = limit > 0 ? std::min(limit, configured) : configured;
+  }
+
+  // A level already reached holds until usage drops memory_hysteresis below its
+  // threshold, so usage hovering at a threshold does not start new episodes
+  const int previous = chat_ctx->memory_pressure_level.load();
+  const double usage_ratio = limit > 0 ? (double)usage / limit : 0.0;
+  const double elevated_ratio = chat_ctx->memory_pressure_threshold -
+                                (previous >= MEMORY_PRESSURE_ELEVATED ? chat_ctx->memory_hysteresis : 0.0f);
+  const double critical_ratio = chat_ctx->memory_critical_threshold -
+                                (previous >= MEMORY_PRESSURE_CRITICAL ? chat_ctx->memory_hysteresis : 0.0f);
+  int level = MEMORY_PRESSURE_NONE;
+  if ((limit > 0 && usage_ratio >= elevated_ratio) || psi_some >= chat_ctx->memory_psi_threshold) {
+    level = MEMORY_PRESSURE_ELEVATED;
+  }
+  if ((limit > 0 && usage_ratio >= critical_ratio) || psi_full >= chat_ctx->memory_psi_threshold) {
+    level = MEMORY_PRESSURE_CRITICAL;
+  }
+
+  chat_ctx->current_memory_usage.store(usage);
+  chat_ctx->memory_limit_bytes.store(limit);
+  chat_ctx->memory_psi_some.store(psi_some);
+  chat_ctx->memory_psi_full.store(psi_full);
+  chat_ctx->memory_pressure_level.store(level);
+
+  if (level != previous) {
+    WASI_NN_LOG_INFO(chat_ctx, "Memory pressure level %d -> %d: %.1f MiB of %.1f MiB (%.0f%%), PSI some %.1f full %.1f",
+                     previous, level, usage / (1024.0 * 1024.0), limit / (1024.0 * 1024.0),
+                     usage_ratio * 100.0, psi_some, psi_full);
+  }
+  return level;
+}
+
+// Evict the least recently used half of the idle sessions, leaving a tombstone
+// so the host's next call on an evicted handle gets session_evicted; caller
+// holds sessions_mutex
+static size_t evict_idle_sessions(LlamaChatContext *chat_ctx)
+{
+  std::vector<std::pair<std::chrono::steady_clock::time_point, graph_execution_context>> idle;
+  for (const auto &pair : chat_ctx->sessions) {
+    if (!pair.second.in_flight) {
+      idle.emplace_back(pair.second.last_activity, pair.first);
+    }
+  }
+  std::sort(idle.begin(), idle.end());
+
+  const size_t n_evict = (idle.size() + 1) / 2;
+  for (size_t i = 0; i < n_evict; i++) {
+    SessionInfo &session_info = chat_ctx->sessions.at(idle[i].second);
+    if (chat_ctx->session_save_on_evict && !chat_ctx->session_cache_dir.empty()) {
+      save_session_to_disk(chat_ctx, session_info);
+    }
+    if (session_info.seq_id >= 0) {
+      reset_sequence(chat_ctx, session_info.seq_id);
+    }
+    WASI_NN_LOG_WARN(chat_ctx, "Memory governor: evicting idle session %d", idle[i].second);
+    chat_ctx->sessions.erase(idle[i].second);
+    chat_ctx->evicted_sessions.insert(idle[i].second);
+  }
+  return n_evict;
+}
+
+// Returns false when the context was busy and nothing was done
+static bool relieve_memory_pressure(LlamaChatContext *chat_ctx, int level)
+{
+  // A model load or switch owns the context; the next sample retries
+  std::unique_lock<std::mutex> swap_lock(chat_ctx->model_swap_mutex, std::try_to_lock);
+  if (!swap_lock.owns_lock() || chat_ctx->model_swapping_in_progress || !chat_ctx->server_ctx.ctx) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+  handle_memory_pressure(chat_ctx);
+  if (level >= MEMORY_PRESSURE_CRITICAL) {
+    evict_idle_sessions(chat_ctx);
+  }
+  return true;
+}
+
+static void memory_governor_loop(LlamaChatContext *chat_ctx)
+{
+  const std::string cgroup_dir = find_cgroup_dir();
+  WASI_NN_LOG_INFO(chat_ctx, "Memory governor started: sampling %s every %u ms",
+                   cgroup_dir.empty() ? "RssAnon" : cgroup_dir.c_str(), chat_ctx->memory_sample_interval_ms);
+
+  // Highest level relieved in the current pressure episode. Evicting KV does
+  // not always bring usage down (other allocations may hold it up), so each
+  // level is acted on once until the episode ends instead of on every sample.
+  int relieved_level = MEMORY_PRESSURE_NONE;
+
+  std::unique_lock<std::mutex> lock(chat_ctx->memory_governor_mutex);
+  while (chat_ctx->memory_governor_running) {
+    lock.unlock();
+    const int level = update_memory_pressure(chat_ctx, cgroup_dir);
+    if (level == MEMORY_PRESSURE_NONE) {
+      relieved_level = MEMORY_PRESSURE_NONE;
+    } else if (level > relieved_level && relieve_memory_pressure(chat_ctx, level)) {
+      relieved_level = level;
+    }
+    tier_idle_sessions(chat_ctx, level);
+    compact_idle_kv_cache(chat_ctx);
+    lock.lock();
+
+    chat_ctx->memory_governor_wakeup.wait_for(lock,
+        std::chrono::milliseconds(chat_ctx->memory_sample_interval_ms),
+        [chat_ctx]() { return !chat_ctx->memory_governor_running; });
+  }
+}
+
+static void start_memory_governor(LlamaChatContext *chat_ctx)
+{
+  if (chat_ctx->memory_sample_interval_ms == 0) {
+    WASI_NN_LOG_INFO(chat_ctx, "Memory governor disabled");
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(chat_ctx->memory_governor_mutex);
+  chat_ctx->memory_governor_running = true;
+  chat_ctx->memory_governor_thread = std::thread(memory_governor_loop, chat_ctx);
+}
+
+static void stop_memory_governor(LlamaChatContext *chat_ctx)
+{
+  {
+    std::lock_guard<std::mutex> lock(chat_ctx->memory_governor_mutex);
+    chat_ctx->memory_governor_running = false;
+  }
+  chat_ctx->memory_governor_wakeup.notify_all();
+
+  if (chat_ctx->memory_governor_thread.joinable()) {
+    chat_ctx->memory_governor_thread.join();
+  }
+}
+
+__attribute__((visibility("default"))) wasi_nn_error
+init_backend_with_config(void **ctx, const char *config, uint32_t config_len)
 {
     if (!ctx) {
       NN_ERR_PRINTF("The context pointer provided to init_backend cannot be null.");
@@ -1955,6 +4173,142 @@ init_backend_with_config(void **ctx, const char *config, uint32_t config_len)
         // Boolean settings
         chat_ctx->auto_cleanup_enabled = cjson_get_value(config_obj, "auto_cleanup", chat_ctx->auto_cleanup_enabled);
 
+        // Session persistence
+        std::string session_cache_dir = cjson_get_value(config_obj, "session_cache_dir", chat_ctx->session_cache_dir);
+        while (session_cache_dir.size() > 1 && session_cache_dir.back() == '/') {
+          session_cache_dir.pop_back();
+        }
+        if (!session_cache_dir.empty())
+        {
+          chat_ctx->session_cache_dir = session_cache_dir;
+          WASI_NN_LOG_INFO(chat_ctx, "Session cache directory set to: %s", session_cache_dir.c_str());
+        }
+        chat_ctx->session_save_on_close = cjson_get_value(config_obj, "session_save_on_close", chat_ctx->session_save_on_close);
+        chat_ctx->session_save_on_evict = cjson_get_value(config_obj, "session_save_on_evict", chat_ctx->session_save_on_evict);
+        chat_ctx->session_restore_on_open = cjson_get_value(config_obj, "session_restore_on_open", chat_ctx->session_restore_on_open);
+
+        // History budget and truncation policy
+        uint32_t history_max_tokens = cjson_get_value(config_obj, "history_max_tokens", chat_ctx->history_max_tokens);
+        if (history_max_tokens == 0 || (history_max_tokens >= 256 && history_max_tokens <= 1048576))
+        {
+          chat_ctx->history_max_tokens = history_max_tokens;
+        }
+        else
+        {
+          WASI_NN_LOG_WARN(chat_ctx, "Invalid history_max_tokens (%u), must be 0 or between 256-1048576, using default: %u",
+                           history_max_tokens, chat_ctx->history_max_tokens);
+        }
+        std::string history_truncation = cjson_get_value(config_obj, "history_truncation", chat_ctx->history_truncation);
+        if (history_truncation == "drop_oldest" || history_truncation == "none")
+        {
+          chat_ctx->history_truncation = history_truncation;
+        }
+        else
+        {
+          WASI_NN_LOG_WARN(chat_ctx, "Invalid history_truncation '%s', must be drop_oldest or none, using default: %s",
+                           history_truncation.c_str(), chat_ctx->history_truncation.c_str());
+        }
+
+        // Shared model weights across backends in this process
+        chat_ctx->share_models = cjson_get_value(config_obj, "share_models", chat_ctx->share_models);
+
+        // Idle-time KV compaction
+        chat_ctx->kv_compaction_enabled = cjson_get_value(config_obj, "kv_compaction", chat_ctx->kv_compaction_enabled);
+        uint32_t kv_compaction_idle_ms = cjson_get_value(config_obj, "kv_compaction_idle_ms", chat_ctx->kv_compaction_idle_ms);
+        if (kv_compaction_idle_ms >= 100 && kv_compaction_idle_ms <= 600000)
+        {
+          chat_ctx->kv_compaction_idle_ms = kv_compaction_idle_ms;
+        }
+        else
+        {
+          WASI_NN_LOG_WARN(chat_ctx, "Invalid kv_compaction_idle_ms (%u), must be between 100-600000, using default: %u",
+                           kv_compaction_idle_ms, chat_ctx->kv_compaction_idle_ms);
+        }
+        float kv_compaction_threshold = cjson_get_value(config_obj, "kv_compaction_threshold", chat_ctx->kv_compaction_threshold);
+        if (kv_compaction_threshold >= 0.0f && kv_compaction_threshold <= 1.0f)
+        {
+          chat_ctx->kv_compaction_threshold = kv_compaction_threshold;
+        }
+        else
+        {
+          WASI_NN_LOG_WARN(chat_ctx, "Invalid kv_compaction_threshold (%.2f), must be between 0.0-1.0, using default: %.2f",
+                           kv_compaction_threshold, chat_ctx->kv_compaction_threshold);
+        }
+
+        // KV admission control
+        std::string admission_policy = cjson_get_value(config_obj, "admission_policy", chat_ctx->admission_policy);
+        if (admission_policy == "queue" || admission_policy == "evict" || admission_policy == "reject")
+        {
+          chat_ctx->admission_policy = admission_policy;
+        }
+        else
+        {
+          WASI_NN_LOG_WARN(chat_ctx, "Invalid admission_policy '%s', must be queue, evict or reject, using default: %s",
+                           admission_policy.c_str(), chat_ctx->admission_policy.c_str());
+        }
+        uint32_t admission_timeout_ms = cjson_get_value(config_obj, "admission_timeout_ms", chat_ctx->admission_timeout_ms);
+        if (admission_timeout_ms <= 600000)
+        {
+          chat_ctx->admission_timeout_ms = admission_timeout_ms;
+        }
+        else
+        {
+          WASI_NN_LOG_WARN(chat_ctx, "Invalid admission_timeout_ms (%u), must be between 0-600000, using default: %u",
+                           admission_timeout_ms, chat_ctx->admission_timeout_ms);
+        }
+
+        // Tiered KV offload for idle sessions
+        chat_ctx->kv_offload_enabled = cjson_get_value(config_obj, "kv_offload", chat_ctx->kv_offload_enabled);
+        uint32_t kv_offload_idle_ms = cjson_get_value(config_obj, "kv_offload_idle_ms", chat_ctx->kv_offload_idle_ms);
+        if (kv_offload_idle_ms == 0 || (kv_offload_idle_ms >= 1000 && kv_offload_idle_ms <= 86400000))
+        {
+          chat_ctx->kv_offload_idle_ms = kv_offload_idle_ms;
+        }
+        else
+        {
+          WASI_NN_LOG_WARN(chat_ctx, "Invalid kv_offload_idle_ms (%u), must be 0 or between 1000-86400000, using default: %u",
+                           kv_offload_idle_ms, chat_ctx->kv_offload_idle_ms);
+        }
+        uint32_t kv_offload_ram_mb = cjson_get_value(config_obj, "kv_offload_ram_mb", chat_ctx->kv_offload_ram_mb);
+        if (kv_offload_ram_mb <= 65536)
+        {
+          chat_ctx->kv_offload_ram_mb = kv_offload_ram_mb;
+        }
+        else
+        {
+          WASI_NN_LOG_WARN(chat_ctx, "Invalid kv_offload_ram_mb (%u), must be between 0-65536, using default: %u",
+                           kv_offload_ram_mb, chat_ctx->kv_offload_ram_mb);
+        }
+        std::string kv_offload_dir = cjson_get_value(config_obj, "kv_offload_dir", chat_ctx->kv_offload_dir);
+        while (kv_offload_dir.size() > 1 && kv_offload_dir.back() == '/') {
+          kv_offload_dir.pop_back();
+        }
+        chat_ctx->kv_offload_dir = kv_offload_dir;
+        if (chat_ctx->kv_offload_enabled)
+        {
+          WASI_NN_LOG_INFO(chat_ctx, "KV offload: idle after %u ms, RAM tier %u MiB, compression %s",
+                           chat_ctx->kv_offload_idle_ms, chat_ctx->kv_offload_ram_mb,
+#ifdef WASI_NN_HAVE_ZLIB
+                           "deflate"
+#else
+                           "off"
+#endif
+          );
+        }
+
+        // Concurrent generations (parallel slots) with validation
+        uint32_t max_concurrent = cjson_get_value(config_obj, "max_concurrent", chat_ctx->max_concurrent);
+        if (max_concurrent >= 1 && max_concurrent <= 256)
+        {
+          chat_ctx->max_concurrent = max_concurrent;
+          WASI_NN_LOG_INFO(chat_ctx, "Max concurrent generations set to: %u", max_concurrent);
+        }
+        else if (max_concurrent != chat_ctx->max_concurrent)
+        {
+          WASI_NN_LOG_WARN(chat_ctx, "Invalid max_concurrent (%u), must be between 1-256, using default: %u",
+                           max_concurrent, chat_ctx->max_concurrent);
+        }
+
         // Queue size with validation
         uint32_t queue_size = cjson_get_value(config_obj, "queue_size", chat_ctx->queue_size);
         if (queue_size > 0 && queue_size <= 10000)  // Reasonable range
@@ -1991,6 +4345,24 @@ init_backend_with_config(void **ctx, const char *config, uint32_t config_len)
                                                                chat_ctx->priority_scheduling_enabled);
         chat_ctx->fair_scheduling_enabled = cjson_get_value(config_obj, "fair_scheduling_enabled",
                                                            chat_ctx->fair_scheduling_enabled);
+        chat_ctx->preemption_enabled = cjson_get_value(config_obj, "preemption_enabled",
+                                                      chat_ctx->preemption_enabled);
+        chat_ctx->preemption_reserve_sequence = cjson_get_value(config_obj, "preemption_reserve_sequence",
+                                                               chat_ctx->preemption_reserve_sequence);
+
+        // Fair-queueing weights of named tenants
+        cJSON *tenant_weights = cJSON_GetObjectItem(config_obj, "tenant_weights");
+        if (cJSON_IsObject(tenant_weights)) {
+          cJSON *weight_item = nullptr;
+          cJSON_ArrayForEach(weight_item, tenant_weights) {
+            if (cJSON_IsNumber(weight_item) && weight_item->valuedouble > 0.0 && weight_item->valuedouble <= 1000.0) {
+              chat_ctx->tenant_weights[weight_item->string] = weight_item->valuedouble;
+            } else {
+              WASI_NN_LOG_WARN(chat_ctx, "Invalid weight for tenant '%s', must be between 0-1000, using default: 1",
+                               weight_item->string);
+            }
+          }
+        }
         chat_ctx->auto_queue_cleanup = cjson_get_value(config_obj, "auto_queue_cleanup",
                                                       chat_ctx->auto_queue_cleanup);
 
@@ -2195,33 +4567,38 @@ init_backend_with_config(void **ctx, const char *config, uint32_t config_len)
 
   // Initialize task queue system (Phase 4.2)
   chat_ctx->task_queue = std::make_shared<wasi_nn_task_queue>();
-  chat_ctx->task_queue->max_queue_size = chat_ctx->queue_size;
+  chat_ctx->task_queue->init(chat_ctx->queue_size, chat_ctx->queue_reject_threshold,
+                             chat_ctx->queue_warning_threshold);
+  chat_ctx->task_queue->fair_scheduling = chat_ctx->fair_scheduling_enabled;
 
-  // Start task processing thread if enabled
-  if (chat_ctx->task_processing_enabled) {
-    chat_ctx->task_processor_thread = std::thread([chat_ctx]() {
-      NN_INFO_PRINTF("Task processor thread started");
+  // Phase 6.17: URGENT turns park lower-priority generations at token boundaries
+  // Preemption only starts once the URGENT turn runs in a slot, so it gets a
+  // reserved sequence instead of waiting for a busy one to finish
+  if (chat_ctx->preemption_enabled) {
+    chat_ctx->server_ctx.preempt_priority = WASI_NN_PRIORITY_URGENT;
+    chat_ctx->server_ctx.n_reserved_slots = chat_ctx->preemption_reserve_sequence ? 1 : 0;
+    chat_ctx->task_queue->urgent_lane_priority = WASI_NN_PRIORITY_URGENT;
+  }
 
-      wasi_nn_task task;
-      while (chat_ctx->task_queue->running) {
-        if (chat_ctx->task_queue->dequeue_task(task, chat_ctx)) {
-          // Process the task
-          NN_INFO_PRINTF("Processing task %d for execution context %d",
-                         task.id, task.exec_ctx);
-
-          // For now, just mark as completed
-          // In a full implementation, this would trigger actual inference
-          {
-            std::unique_lock<std::mutex> lock(chat_ctx->task_queue->queue_mutex);
-            chat_ctx->task_queue->tasks_completed++;
-          }
+  // Start task processing threads if enabled; one per slot so queued
+  // compute() requests can occupy every slot of the batching engine
+  if (chat_ctx->task_processing_enabled) {
+    for (uint32_t i = 0; i < chat_ctx->max_concurrent; ++i) {
+      chat_ctx->task_processor_threads.emplace_back(task_processor_loop, chat_ctx, false);
+    }
+    if (chat_ctx->preemption_enabled) {
+      chat_ctx->task_processor_threads.emplace_back(task_processor_loop, chat_ctx, true);
+    }
+  }
 
-          NN_INFO_PRINTF("Task %d completed", task.id);
-        }
-      }
+  // Phase 6.8: Sample memory in the background
+  start_memory_governor(chat_ctx);
 
-      NN_INFO_PRINTF("Task processor thread terminated");
-    });
+  // Phase 6.12: Backends loading the same model share its weights
+  if (chat_ctx->share_models) {
+    chat_ctx->server_ctx.model_provider = [chat_ctx](common_params &params) {
+      return acquire_shared_model(chat_ctx, params);
+    };
   }
 
   NN_INFO_PRINTF("Llama chat backend initialized successfully");
@@ -2235,13 +4612,14 @@ init_backend_with_config(void **ctx, const char *config, uint32_t config_len)
       chat_ctx->max_sessions, chat_ctx->idle_timeout_ms,
       chat_ctx->auto_cleanup_enabled ? "true" : "false");
   WASI_NN_LOG_INFO(chat_ctx,
-      "Queue config: queue_size=%d",
-      chat_ctx->queue_size);
+      "Queue config: queue_size=%d, max_concurrent=%d",
+      chat_ctx->queue_size, chat_ctx->max_concurrent);
   WASI_NN_LOG_INFO(chat_ctx,
-      "Task Queue config: timeout=%dms, priority_scheduling=%s, fair_scheduling=%s",
+      "Task Queue config: timeout=%dms, priority_scheduling=%s, fair_scheduling=%s, preemption=%s",
       chat_ctx->default_task_timeout_ms,
       chat_ctx->priority_scheduling_enabled ? "true" : "false",
-      chat_ctx->fair_scheduling_enabled ? "true" : "false");
+      chat_ctx->fair_scheduling_enabled ? "true" : "false",
+      chat_ctx->preemption_enabled ? "true" : "false");
   WASI_NN_LOG_INFO(chat_ctx,
       "Memory config: context_shifting=%s, cache_strategy=%s, max_cache_tokens=%d",
       chat_ctx->context_shifting_enabled ? "true" : "false",
@@ -2288,7 +4666,23 @@ __attribute__((visibility("default"))) wasi_nn_error deinit_backend(void *ctx)
     return invalid_argument;
 
   // Note: model and ctx are managed by common_init_result's unique_ptrs
-  // They will be automatically cleaned up by the server_context
+  // They will be automatically cleaned up by the server_context; a shared
+  // model is freed with the last backend holding it
+
+  // Neither the governor, the task processors nor the engine may run while the backend is torn down
+  stop_memory_governor(chat_ctx);
+  stop_task_processing(chat_ctx);
+  stop_inference_engine(chat_ctx);
+
+  // Phase 6.5: Open sessions survive a backend restart like closed ones
+  if (chat_ctx->session_save_on_close && !chat_ctx->session_cache_dir.empty()) {
+    std::lock_guard<std::mutex> sessions_lock(chat_ctx->sessions_mutex);
+    for (auto &pair : chat_ctx->sessions) {
+      if (!pair.second.history.empty()) {
+        save_session_to_disk(chat_ctx, pair.second);
+      }
+    }
+  }
 
   llama_backend_free();
   delete chat_ctx;
@@ -2333,7 +4727,11 @@ load_by_name_with_config(void *ctx, const char *filename, uint32_t filename_len,
     return success;
   }
 
-  // Initial model loading (no existing model)
+  // Initial model loading (no existing model). The memory governor and the
+  // idle-time workers are already running; they take model_swap_mutex before
+  // touching the context, so hold it until the context is fully set up.
+  std::lock_guard<std::mutex> swap_lock(chat_ctx->model_swap_mutex);
+
   // Parse config into params
   parse_config_to_params(config, chat_ctx->server_ctx.params_base, chat_ctx);
   chat_ctx->server_ctx.params_base.model.path = filename;
@@ -2350,9 +4748,15 @@ load_by_name_with_config(void *ctx, const char *filename, uint32_t filename_len,
       return runtime_error;
   }
 
-  // Initialize server context
+  // Initialize server context and start the continuous batching engine
   chat_ctx->server_ctx.init();
 
+  wasi_nn_error engine_result = start_inference_engine(chat_ctx);
+  if (engine_result != success) {
+    NN_ERR_PRINTF("Failed to start inference engine");
+    return engine_result;
+  }
+
   // Check context size
   const int n_ctx_train = llama_model_n_ctx_train(chat_ctx->server_ctx.model);
   const int n_ctx = llama_n_ctx(chat_ctx->server_ctx.ctx);
@@ -2398,7 +4802,8 @@ load_by_name_with_config(void *ctx, const char *filename, uint32_t filename_len,
     NN_INFO_PRINTF("LoRA failed to load, Proceeding without it");
   }
 
-  NN_INFO_PRINTF("Model loaded successfully. Context size: %d", n_ctx);
+  NN_INFO_PRINTF("Model loaded successfully. Context size: %d, parallel slots: %d",
+                 n_ctx, chat_ctx->server_ctx.params_base.n_parallel);
   NN_INFO_PRINTF("Model info recorded: name=%s, arch=%s, vocab_size=%ld, ctx_len=%ld",
                  chat_ctx->model_name.c_str(), chat_ctx->model_architecture.c_str(),
                  chat_ctx->model_vocab_size, chat_ctx->model_context_length);
@@ -2406,548 +4811,2339 @@ load_by_name_with_config(void *ctx, const char *filename, uint32_t filename_len,
   return success;
 }
 
-// Auto-cleanup function: removes old/excess sessions
-static void auto_cleanup_sessions(LlamaChatContext *chat_ctx)
+// ==============================================================================
+// Phase 6.5: Session Persistence
+// ==============================================================================
+// A session is written to session_cache_dir as two files: the KV state of its
+// sequence (llama_state_seq_save_file, tokens included) and its chat history as
+// JSON. File names combine the session_id with current_model_version, so state
+// saved under one model is never loaded into another. The KV file is loaded
+// lazily into whichever sequence the session binds on its next turn.
+
+// Path prefix of a session's files (".kv" / ".json" are appended)
+static std::string session_file_base(LlamaChatContext *chat_ctx, const std::string &session_id)
 {
-  if (!chat_ctx->auto_cleanup_enabled)
-    return;
+  std::string name;
+  for (char c : session_id) {
+    name += (isalnum((unsigned char)c) || c == '-' || c == '_') ? c : '_';
+  }
+  if (name.size() > 64) {
+    name.resize(64);
+  }
 
-  auto now = std::chrono::steady_clock::now();
-  auto idle_timeout = std::chrono::milliseconds(chat_ctx->idle_timeout_ms);
+  // FNV-1a keeps ids that sanitize to the same name apart
+  uint64_t hash = 1469598103934665603ULL;
+  for (char c : session_id) {
+    hash = (hash ^ (uint8_t)c) * 1099511628211ULL;
+  }
 
-  // Remove idle sessions
-  for (auto it = chat_ctx->sessions.begin(); it != chat_ctx->sessions.end();)
+  char suffix[96];
+  snprintf(suffix, sizeof(suffix), "-%016llx-%s", (unsigned long long)hash,
+           chat_ctx->current_model_version.empty() ? "unversioned"
+                                                   : chat_ctx->current_model_version.c_str());
+  return chat_ctx->session_cache_dir + "/" + name + suffix;
+}
+
+// Write a file through a temporary name so a crash never leaves half a session behind
+static bool write_file_atomic(const std::string &path, const std::string &data)
+{
+  const std::string tmp_path = path + ".tmp";
   {
-    if ((now - it->second.last_activity) > idle_timeout)
-    {
-      auto idle_time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                         now - it->second.last_activity)
-                         .count();
-      NN_INFO_PRINTF("Auto-cleanup: removing idle session %d (idle for %lldms)",
-                     it->first, (long long)idle_time);
-      it = chat_ctx->sessions.erase(it);
-    }
-    else
-    {
-      ++it;
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out || !out.write(data.data(), data.size())) {
+      std::remove(tmp_path.c_str());
+      return false;
     }
   }
+  return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
 
-  // Remove excess sessions (LRU eviction)
-  if (chat_ctx->sessions.size() >= chat_ctx->max_sessions)
-  {
-    // Sort by last_activity and remove the oldest
-    std::vector<std::pair<graph_execution_context,
-                          std::chrono::steady_clock::time_point>>
-        sorted_sessions;
-    for (const auto &session : chat_ctx->sessions)
-    {
-      sorted_sessions.emplace_back(session.first, session.second.last_activity);
-    }
+// Persist a session's history and KV state; caller holds sessions_mutex
+static wasi_nn_error save_session_to_disk(LlamaChatContext *chat_ctx, SessionInfo &session_info)
+{
+  if (chat_ctx->session_cache_dir.empty()) {
+    NN_ERR_PRINTF("Session persistence is disabled (no session_cache_dir configured)");
+    return invalid_argument;
+  }
+  if (!chat_ctx->server_ctx.ctx) {
+    return runtime_error;
+  }
+  if (mkdir(chat_ctx->session_cache_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    NN_ERR_PRINTF("Cannot create session cache directory %s: %s",
+                  chat_ctx->session_cache_dir.c_str(), strerror(errno));
+    return runtime_error;
+  }
 
-    std::sort(sorted_sessions.begin(), sorted_sessions.end(),
-              [](const auto &a, const auto &b)
-              { return a.second < b.second; });
+  auto &server_ctx = chat_ctx->server_ctx;
+  const std::string base = session_file_base(chat_ctx, session_info.session_id);
+  const std::string kv_path = base + ".kv";
+  const int64_t t_start = ggml_time_us();
+
+  // KV state of the sequence; without one the session re-prefills when it resumes
+  size_t n_tokens = 0;
+  if (session_info.seq_id >= 0 && !session_info.in_flight) {
+    const llama_seq_id seq_id = session_info.seq_id;
+    const std::string kv_tmp_path = kv_path + ".tmp";
+    size_t n_written = 0;
+    run_on_engine_thread(chat_ctx, [&]() {
+      server_slot *slot = server_ctx.get_slot_by_id(seq_id);
+      if (!slot || slot->is_processing() || slot->cache_tokens.empty()) {
+        return;
+      }
+      const llama_tokens &tokens = slot->cache_tokens.get_text_tokens();
+      n_written = llama_state_seq_save_file(server_ctx.ctx, kv_tmp_path.c_str(), seq_id,
+                                            tokens.data(), tokens.size());
+      n_tokens = tokens.size();
+    });
 
-    // Remove oldest sessions to make room
-    size_t sessions_to_remove =
-        chat_ctx->sessions.size() - chat_ctx->max_sessions + 1;
-    for (size_t i = 0; i < sessions_to_remove && i < sorted_sessions.size();
-         ++i)
-    {
-      auto exec_ctx_id = sorted_sessions[i].first;
-      NN_INFO_PRINTF("Auto-cleanup: removing session %d (max sessions reached)",
-                     exec_ctx_id);
-      chat_ctx->sessions.erase(exec_ctx_id);
+    if (n_written == 0 || std::rename(kv_tmp_path.c_str(), kv_path.c_str()) != 0) {
+      std::remove(kv_tmp_path.c_str());
+      n_tokens = 0;
     }
   }
-}
 
-// Original function for WASI-NN compatibility (kept for backward compatibility)
-__attribute__((visibility("default"))) wasi_nn_error init_execution_context(
-    void *ctx, graph g, graph_execution_context *exec_ctx)
-{
-  // Delegate to the session-aware version with a default session ID
-  return init_execution_context_with_session_id(ctx, "default_session", exec_ctx);
+  // A KV file that no longer matches the history must not be restored; one
+  // that was restored but not used yet still matches
+  if (n_tokens == 0 && session_info.restore_kv_path.empty()) {
+    std::remove(kv_path.c_str());
+  }
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddStringToObject(root, "session_id", session_info.session_id.c_str());
+  cJSON_AddStringToObject(root, "model_version", chat_ctx->current_model_version.c_str());
+  cJSON *history = cJSON_AddArrayToObject(root, "chat_history");
+  for (size_t i = 0; i < session_info.history.size(); i++) {
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "role", session_info.history.role(i).c_str());
+    cJSON_AddStringToObject(item, "content", session_info.history.content(i).c_str());
+    cJSON_AddItemToArray(history, item);
+  }
+
+  char *json_text = cJSON_PrintUnformatted(root);
+  const bool written = json_text && write_file_atomic(base + ".json", json_text);
+  cJSON_free(json_text);
+  cJSON_Delete(root);
+
+  if (!written) {
+    NN_ERR_PRINTF("Failed to write session file %s.json", base.c_str());
+    return runtime_error;
+  }
+
+  NN_INFO_PRINTF("Saved session '%s': %zu messages, %zu KV tokens in %.2f ms",
+                 session_info.session_id.c_str(), session_info.history.size(), n_tokens,
+                 (ggml_time_us() - t_start) / 1000.0);
+  return success;
 }
 
-// New function that properly handles session IDs (matches NIF expectations)
-__attribute__((visibility("default"))) wasi_nn_error init_execution_context_with_session_id(
-    void *ctx, const char *session_id, graph_execution_context *exec_ctx)
+// Load a saved session's history; its KV state follows on the next turn.
+// Returns not_found when nothing was saved for this session and model version.
+// Caller holds sessions_mutex.
+static wasi_nn_error restore_session_from_disk(LlamaChatContext *chat_ctx, SessionInfo &session_info)
 {
-  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
-  if (!chat_ctx || !chat_ctx->server_ctx.model)
+  if (chat_ctx->session_cache_dir.empty()) {
+    NN_ERR_PRINTF("Session persistence is disabled (no session_cache_dir configured)");
     return invalid_argument;
+  }
 
-  if (!session_id) {
-    NN_ERR_PRINTF("Session ID cannot be null");
-    return invalid_argument;
+  const std::string base = session_file_base(chat_ctx, session_info.session_id);
+  std::ifstream in(base + ".json", std::ios::binary);
+  if (!in) {
+    return not_found;
   }
+  std::stringstream buffer;
+  buffer << in.rdbuf();
 
-  std::string session_id_str(session_id);
+  cJSON *root = cJSON_Parse(buffer.str().c_str());
+  if (!root) {
+    NN_WARN_PRINTF("Ignoring corrupt session file %s.json", base.c_str());
+    return runtime_error;
+  }
 
-  // Check if session already exists
-  for (auto &pair : chat_ctx->sessions) {
-    if (pair.second.session_id == session_id_str) {
-      *exec_ctx = pair.first;
-      NN_INFO_PRINTF("Reusing existing session '%s' with execution context %d",
-                     session_id, pair.first);
-      return success;
+  const std::string session_id = cjson_get_value(root, "session_id", std::string());
+  const std::string model_version = cjson_get_value(root, "model_version", std::string());
+  if (session_id != session_info.session_id || model_version != chat_ctx->current_model_version) {
+    cJSON_Delete(root);
+    return not_found;
+  }
+
+  // Messages only; they are rendered for the current model on the next turn
+  SessionHistory restored;
+  cJSON *history = cJSON_GetObjectItem(root, "chat_history");
+  cJSON *item;
+  cJSON_ArrayForEach(item, history) {
+    const std::string role = cjson_get_value(item, "role", std::string());
+    if (!role.empty()) {
+      restored.push(role, cjson_get_value(item, "content", std::string()), 0);
+    }
+  }
+  cJSON_Delete(root);
+
+  session_info.history = std::move(restored);
+  // The saved KV state may have been shifted; map it again on the next turn
+  session_info.n_shifted = 0;
+  session_info.shift_unknown = true;
+
+  // The saved state replaces anything offloaded since (Phase 6.9)
+  session_info.kv_tier = KV_TIER_LIVE;
+  session_info.kv_snapshot.reset();
+  session_info.kv_offload_file.reset();
+
+  struct stat kv_stat;
+  session_info.restore_kv_path = stat((base + ".kv").c_str(), &kv_stat) == 0 ? base + ".kv" : "";
+
+  NN_INFO_PRINTF("Restored session '%s': %zu messages%s", session_info.session_id.c_str(),
+                 session_info.history.size(),
+                 session_info.restore_kv_path.empty() ? " (no KV state, will re-prefill)" : "");
+  return success;
+}
+
+// Load a restored session's KV file into its freshly bound sequence; caller holds sessions_mutex
+static void load_session_kv(LlamaChatContext *chat_ctx, SessionInfo &session_info)
+{
+  if (session_info.restore_kv_path.empty() || session_info.seq_id < 0) {
+    return;
+  }
+
+  auto &server_ctx = chat_ctx->server_ctx;
+  const std::string kv_path = std::move(session_info.restore_kv_path);
+  session_info.restore_kv_path.clear();
+
+  const llama_seq_id seq_id = session_info.seq_id;
+  const int64_t t_start = ggml_time_us();
+  llama_tokens tokens;
+  size_t n_read = 0;
+  run_on_engine_thread(chat_ctx, [&]() {
+    server_slot *slot = server_ctx.get_slot_by_id(seq_id);
+    if (!slot || slot->is_processing()) {
+      return;
+    }
+    llama_memory_t mem = llama_get_memory(server_ctx.ctx);
+    llama_memory_seq_rm(mem, seq_id, -1, -1);
+    slot->cache_tokens.clear();
+
+    tokens.resize(slot->n_ctx);
+    size_t n_tokens = 0;
+    n_read = llama_state_seq_load_file(server_ctx.ctx, kv_path.c_str(), seq_id,
+                                       tokens.data(), tokens.size(), &n_tokens);
+    if (n_read == 0) {
+      llama_memory_seq_rm(mem, seq_id, -1, -1);
+      tokens.clear();
+      return;
+    }
+    tokens.resize(n_tokens);
+    slot->cache_tokens.insert(tokens);
+  });
+
+  if (n_read == 0) {
+    NN_WARN_PRINTF("Could not load KV state %s for session '%s', re-prefilling",
+                   kv_path.c_str(), session_info.session_id.c_str());
+    chat_ctx->prefix_cache.erase(seq_id);
+    return;
+  }
+
+  if (chat_ctx->enable_prefix_cache) {
+    chat_ctx->prefix_cache.insert(seq_id, tokens);
+  }
+  NN_INFO_PRINTF("Loaded %zu KV tokens for session '%s' into sequence %d in %.2f ms",
+                 tokens.size(), session_info.session_id.c_str(), seq_id,
+                 (ggml_time_us() - t_start) / 1000.0);
+}
+
+// ============================================================================
+// Phase 6.9: Tiered KV Offload
+// ============================================================================
+// An idle session does not need its cells in the live KV cache. When its
+// sequence is reclaimed for another session, or it has been idle for
+// kv_offload_idle_ms, the sequence state is copied into a host-RAM snapshot
+// (KV_TIER_RAM). The memory governor deflates snapshots in the background and
+// writes the oldest to disk (KV_TIER_DISK) once the RAM tier exceeds
+// kv_offload_ram_mb, or all of them under memory pressure. The next turn loads
+// the state back into the session's new sequence instead of prefilling the
+// conversation again.
+
+// Offload file: magic, format version, then the snapshot fields
+static const char KV_OFFLOAD_MAGIC[4] = {'W', 'N', 'K', 'V'};
+static const uint32_t KV_OFFLOAD_VERSION = 1;
+
+// Deflate a snapshot; returns false when zlib is unavailable or it would not shrink
+static bool compress_kv_snapshot(const KvSnapshot &snapshot, KvSnapshot &compressed)
+{
+#ifdef WASI_NN_HAVE_ZLIB
+  if (snapshot.compressed || snapshot.data.empty()) {
+    return false;
+  }
+  uLongf n_out = compressBound(snapshot.data.size());
+  compressed.data.resize(n_out);
+  // Level 1: KV tensors barely compress further at higher levels but cost much more
+  if (compress2(compressed.data.data(), &n_out, snapshot.data.data(), snapshot.data.size(),
+                Z_BEST_SPEED) != Z_OK || n_out >= snapshot.data.size()) {
+    compressed.data.clear();
+    return false;
+  }
+  compressed.data.resize(n_out);
+  compressed.data.shrink_to_fit();
+  compressed.raw_size = snapshot.raw_size;
+  compressed.compressed = true;
+  compressed.tokens = snapshot.tokens;
+  compressed.model_version = snapshot.model_version;
+  return true;
+#else
+  (void)snapshot;
+  (void)compressed;
+  return false;
+#endif
+}
+
+// Raw sequence state of a snapshot; empty when it cannot be inflated
+static std::vector<uint8_t> inflate_kv_snapshot(const KvSnapshot &snapshot)
+{
+  if (!snapshot.compressed) {
+    return snapshot.data;
+  }
+#ifdef WASI_NN_HAVE_ZLIB
+  std::vector<uint8_t> raw(snapshot.raw_size);
+  uLongf n_raw = raw.size();
+  if (uncompress(raw.data(), &n_raw, snapshot.data.data(), snapshot.data.size()) == Z_OK &&
+      n_raw == snapshot.raw_size) {
+    return raw;
+  }
+#endif
+  return {};
+}
+
+// Bytes held by the RAM tier; caller holds sessions_mutex
+static uint64_t kv_offload_ram_bytes(LlamaChatContext *chat_ctx)
+{
+  uint64_t total = 0;
+  for (const auto &pair : chat_ctx->sessions) {
+    if (pair.second.kv_tier == KV_TIER_RAM && pair.second.kv_snapshot) {
+      total += pair.second.kv_snapshot->data.size();
+    }
+  }
+  return total;
+}
+
+// Forget a session's offloaded state (the file goes with its last reference)
+static void drop_offloaded_kv(SessionInfo &session_info)
+{
+  session_info.kv_tier = KV_TIER_LIVE;
+  session_info.kv_snapshot.reset();
+  session_info.kv_offload_file.reset();
+}
+
+// Move an idle session's sequence state into the RAM tier; caller holds
+// sessions_mutex. The sequence itself is left to the caller, which either
+// hands it to another session or resets it.
+static bool offload_session_kv(LlamaChatContext *chat_ctx, SessionInfo &session_info)
+{
+  if (!chat_ctx->kv_offload_enabled || session_info.seq_id < 0 || session_info.in_flight ||
+      !chat_ctx->server_ctx.ctx) {
+    return false;
+  }
+
+  auto &server_ctx = chat_ctx->server_ctx;
+  const llama_seq_id seq_id = session_info.seq_id;
+  const int64_t t_start = ggml_time_us();
+  auto snapshot = std::make_shared<KvSnapshot>();
+  run_on_engine_thread(chat_ctx, [&]() {
+    server_slot *slot = server_ctx.get_slot_by_id(seq_id);
+    if (!slot || slot->is_processing() || slot->cache_tokens.empty()) {
+      return;
+    }
+    snapshot->data.resize(llama_state_seq_get_size(server_ctx.ctx, seq_id));
+    snapshot->raw_size = llama_state_seq_get_data(server_ctx.ctx, snapshot->data.data(),
+                                                  snapshot->data.size(), seq_id);
+    snapshot->data.resize(snapshot->raw_size);
+    snapshot->tokens = slot->cache_tokens.get_text_tokens();
+  });
+
+  if (snapshot->raw_size == 0) {
+    return false;
+  }
+
+  // Without a disk tier nothing moves snapshots out of RAM, so the budget is
+  // kept by dropping the oldest ones (those sessions simply re-prefill)
+  const uint64_t ram_budget = (uint64_t)chat_ctx->kv_offload_ram_mb * 1024 * 1024;
+  if (!kv_offload_disk_tier(chat_ctx)) {
+    if (snapshot->data.size() > ram_budget) {
+      return false;
+    }
+    uint64_t ram_bytes = kv_offload_ram_bytes(chat_ctx);
+    while (ram_bytes + snapshot->data.size() > ram_budget) {
+      SessionInfo *oldest = nullptr;
+      for (auto &pair : chat_ctx->sessions) {
+        if (pair.second.kv_tier == KV_TIER_RAM &&
+            (!oldest || pair.second.last_activity < oldest->last_activity)) {
+          oldest = &pair.second;
+        }
+      }
+      if (!oldest) {
+        break;
+      }
+      ram_bytes -= oldest->kv_snapshot ? oldest->kv_snapshot->data.size() : 0;
+      drop_offloaded_kv(*oldest);
+    }
+  }
+
+  snapshot->model_version = chat_ctx->current_model_version;
+  const size_t n_tokens = snapshot->tokens.size();
+  const size_t n_bytes = snapshot->data.size();
+  session_info.kv_snapshot = std::move(snapshot);
+  session_info.kv_offload_file.reset();
+  session_info.kv_tier = KV_TIER_RAM;
+
+  NN_INFO_PRINTF("Offloaded %zu KV tokens (%.1f MiB) of session '%s' to RAM in %.2f ms",
+                 n_tokens, n_bytes / (1024.0 * 1024.0), session_info.session_id.c_str(),
+                 (ggml_time_us() - t_start) / 1000.0);
+  return true;
+}
+
+// Directory of the disk tier
+// Snapshots only go to disk when the governor runs and kv_offload_dir is set
+static bool kv_offload_disk_tier(LlamaChatContext *chat_ctx)
+{
+  return chat_ctx->memory_sample_interval_ms > 0 && !chat_ctx->kv_offload_dir.empty();
+}
+
+static void append_bytes(std::string &out, const void *data, size_t size)
+{
+  out.append(static_cast<const char *>(data), size);
+}
+
+// Write a snapshot to a new offload file; returns nullptr on failure
+static std::shared_ptr<OffloadFile> write_kv_offload_file(LlamaChatContext *chat_ctx,
+                                                          const KvSnapshot &snapshot)
+{
+  const std::string &dir = chat_ctx->kv_offload_dir;
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    NN_ERR_PRINTF("Cannot create KV offload directory %s: %s", dir.c_str(), strerror(errno));
+    return nullptr;
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "/kv-%d-%llu.offload", (int)getpid(),
+           (unsigned long long)chat_ctx->kv_offload_serial++);
+
+  const uint64_t n_tokens = snapshot.tokens.size();
+  const uint64_t raw_size = snapshot.raw_size;
+  const uint64_t n_version = snapshot.model_version.size();
+  const uint8_t compressed = snapshot.compressed ? 1 : 0;
+
+  std::string blob;
+  blob.reserve(64 + n_version + n_tokens * sizeof(llama_token) + snapshot.data.size());
+  append_bytes(blob, KV_OFFLOAD_MAGIC, sizeof(KV_OFFLOAD_MAGIC));
+  append_bytes(blob, &KV_OFFLOAD_VERSION, sizeof(KV_OFFLOAD_VERSION));
+  append_bytes(blob, &n_version, sizeof(n_version));
+  blob += snapshot.model_version;
+  append_bytes(blob, &n_tokens, sizeof(n_tokens));
+  append_bytes(blob, snapshot.tokens.data(), n_tokens * sizeof(llama_token));
+  append_bytes(blob, &raw_size, sizeof(raw_size));
+  append_bytes(blob, &compressed, sizeof(compressed));
+  blob.append(reinterpret_cast<const char *>(snapshot.data.data()), snapshot.data.size());
+
+  auto file = std::make_shared<OffloadFile>(dir + name);
+  if (!write_file_atomic(file->path, blob)) {
+    NN_ERR_PRINTF("Failed to write KV offload file %s", file->path.c_str());
+    return nullptr;
+  }
+  return file;
+}
+
+// Read an offload file back into a snapshot
+static bool read_kv_offload_file(const std::string &path, KvSnapshot &snapshot)
+{
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(KV_OFFLOAD_MAGIC)];
+  uint32_t version = 0;
+  uint64_t n_version = 0;
+  if (!in.read(magic, sizeof(magic)) || memcmp(magic, KV_OFFLOAD_MAGIC, sizeof(magic)) != 0 ||
+      !in.read(reinterpret_cast<char *>(&version), sizeof(version)) || version != KV_OFFLOAD_VERSION ||
+      !in.read(reinterpret_cast<char *>(&n_version), sizeof(n_version)) || n_version > 4096) {
+    return false;
+  }
+
+  snapshot.model_version.resize(n_version);
+  uint64_t n_tokens = 0;
+  if (!in.read(&snapshot.model_version[0], n_version) ||
+      !in.read(reinterpret_cast<char *>(&n_tokens), sizeof(n_tokens)) || n_tokens > (1ULL << 24)) {
+    return false;
+  }
+
+  snapshot.tokens.resize(n_tokens);
+  uint64_t raw_size = 0;
+  uint8_t compressed = 0;
+  if (!in.read(reinterpret_cast<char *>(snapshot.tokens.data()), n_tokens * sizeof(llama_token)) ||
+      !in.read(reinterpret_cast<char *>(&raw_size), sizeof(raw_size)) ||
+      !in.read(reinterpret_cast<char *>(&compressed), sizeof(compressed))) {
+    return false;
+  }
+  snapshot.raw_size = raw_size;
+  snapshot.compressed = compressed != 0;
+  snapshot.data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return !snapshot.data.empty();
+}
+
+// Load an offloaded session's state into its freshly bound sequence; caller
+// holds sessions_mutex. Any failure leaves an empty sequence to prefill.
+static void restore_offloaded_kv(LlamaChatContext *chat_ctx, SessionInfo &session_info)
+{
+  if (session_info.kv_tier == KV_TIER_LIVE || session_info.seq_id < 0) {
+    return;
+  }
+
+  const KvTier tier = session_info.kv_tier;
+  std::shared_ptr<const KvSnapshot> snapshot = session_info.kv_snapshot;
+  const std::shared_ptr<OffloadFile> file = session_info.kv_offload_file;
+  drop_offloaded_kv(session_info);
+
+  const int64_t t_start = ggml_time_us();
+  if (tier == KV_TIER_DISK && file) {
+    auto loaded = std::make_shared<KvSnapshot>();
+    if (read_kv_offload_file(file->path, *loaded)) {
+      snapshot = std::move(loaded);
+    }
+  }
+  if (!snapshot || snapshot->model_version != chat_ctx->current_model_version) {
+    NN_WARN_PRINTF("Offloaded KV state of session '%s' is unusable, re-prefilling",
+                   session_info.session_id.c_str());
+    return;
+  }
+
+  const std::vector<uint8_t> state = inflate_kv_snapshot(*snapshot);
+  auto &server_ctx = chat_ctx->server_ctx;
+  const llama_seq_id seq_id = session_info.seq_id;
+  size_t n_read = 0;
+  run_on_engine_thread(chat_ctx, [&]() {
+    server_slot *slot = server_ctx.get_slot_by_id(seq_id);
+    if (!slot || slot->is_processing() || state.empty()) {
+      return;
+    }
+    llama_memory_t mem = llama_get_memory(server_ctx.ctx);
+    llama_memory_seq_rm(mem, seq_id, -1, -1);
+    slot->cache_tokens.clear();
+
+    n_read = llama_state_seq_set_data(server_ctx.ctx, state.data(), state.size(), seq_id);
+    if (n_read == 0) {
+      llama_memory_seq_rm(mem, seq_id, -1, -1);
+      return;
+    }
+    slot->cache_tokens.insert(snapshot->tokens);
+  });
+
+  if (n_read == 0) {
+    NN_WARN_PRINTF("Could not load offloaded KV state of session '%s', re-prefilling",
+                   session_info.session_id.c_str());
+    chat_ctx->prefix_cache.erase(seq_id);
+    return;
+  }
+
+  if (chat_ctx->enable_prefix_cache) {
+    chat_ctx->prefix_cache.insert(seq_id, snapshot->tokens);
+  }
+  chat_ctx->kv_offload_restores++;
+  NN_INFO_PRINTF("Restored %zu KV tokens of session '%s' from %s into sequence %d in %.2f ms",
+                 snapshot->tokens.size(), session_info.session_id.c_str(),
+                 tier == KV_TIER_DISK ? "disk" : "RAM", seq_id, (ggml_time_us() - t_start) / 1000.0);
+}
+
+// Governor tick: offload sessions idle past kv_offload_idle_ms, deflate RAM
+// snapshots and keep the RAM tier within kv_offload_ram_mb (emptied under
+// memory pressure). Compression and file I/O run without sessions_mutex;
+// their result is only published if the session still holds the same snapshot.
+static void tier_idle_sessions(LlamaChatContext *chat_ctx, int pressure_level)
+{
+  if (!chat_ctx->kv_offload_enabled) {
+    return;
+  }
+
+  using snapshot_ref = std::pair<graph_execution_context, std::shared_ptr<const KvSnapshot>>;
+  std::vector<snapshot_ref> to_compress;
+  std::vector<snapshot_ref> to_disk;
+  {
+    std::unique_lock<std::mutex> swap_lock(chat_ctx->model_swap_mutex, std::try_to_lock);
+    if (!swap_lock.owns_lock() || chat_ctx->model_swapping_in_progress || !chat_ctx->server_ctx.ctx) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+
+    const auto now = std::chrono::steady_clock::now();
+    if (chat_ctx->kv_offload_idle_ms > 0) {
+      const auto idle_time = std::chrono::milliseconds(chat_ctx->kv_offload_idle_ms);
+      for (auto &pair : chat_ctx->sessions) {
+        SessionInfo &session_info = pair.second;
+        if (session_info.seq_id >= 0 && !session_info.in_flight &&
+            now - session_info.last_activity >= idle_time &&
+            offload_session_kv(chat_ctx, session_info)) {
+          reset_sequence(chat_ctx, session_info.seq_id);
+          session_info.seq_id = -1;
+        }
+      }
+    }
+
+    // Oldest first, so the budget pass writes out the coldest sessions
+    std::vector<std::pair<std::chrono::steady_clock::time_point, graph_execution_context>> ram_tier;
+    for (const auto &pair : chat_ctx->sessions) {
+      if (pair.second.kv_tier == KV_TIER_RAM && pair.second.kv_snapshot) {
+        ram_tier.emplace_back(pair.second.last_activity, pair.first);
+      }
+    }
+    std::sort(ram_tier.begin(), ram_tier.end());
+
+    const uint64_t ram_budget = pressure_level >= MEMORY_PRESSURE_ELEVATED
+                                    ? 0 : (uint64_t)chat_ctx->kv_offload_ram_mb * 1024 * 1024;
+    uint64_t ram_bytes = kv_offload_ram_bytes(chat_ctx);
+    const bool disk_tier = kv_offload_disk_tier(chat_ctx);
+    for (const auto &entry : ram_tier) {
+      SessionInfo &session_info = chat_ctx->sessions.at(entry.second);
+      const auto &snapshot = session_info.kv_snapshot;
+      if (ram_bytes > ram_budget) {
+        ram_bytes -= snapshot->data.size();
+        if (disk_tier) {
+          to_disk.emplace_back(entry.second, snapshot);
+        } else {
+          drop_offloaded_kv(session_info);  // re-prefills on its next turn
+        }
+      } else if (!snapshot->compressed) {
+        to_compress.emplace_back(entry.second, snapshot);
+      }
+    }
+  }
+
+  for (const auto &entry : to_compress) {
+    auto compressed = std::make_shared<KvSnapshot>();
+    if (!compress_kv_snapshot(*entry.second, *compressed)) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+    auto it = chat_ctx->sessions.find(entry.first);
+    if (it != chat_ctx->sessions.end() && it->second.kv_snapshot == entry.second) {
+      NN_DBG_PRINTF("Compressed KV snapshot of session %d: %zu -> %zu bytes", entry.first,
+                    entry.second->data.size(), compressed->data.size());
+      it->second.kv_snapshot = std::move(compressed);
+    }
+  }
+
+  for (const auto &entry : to_disk) {
+    KvSnapshot compressed;
+    const KvSnapshot &snapshot = compress_kv_snapshot(*entry.second, compressed) ? compressed : *entry.second;
+    std::shared_ptr<OffloadFile> file = write_kv_offload_file(chat_ctx, snapshot);
+    if (!file) {
+      continue;
+    }
+    // A session that resumed or closed meanwhile drops the file here
+    std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+    auto it = chat_ctx->sessions.find(entry.first);
+    if (it != chat_ctx->sessions.end() && it->second.kv_snapshot == entry.second) {
+      it->second.kv_snapshot.reset();
+      it->second.kv_offload_file = std::move(file);
+      it->second.kv_tier = KV_TIER_DISK;
+      NN_INFO_PRINTF("Moved KV snapshot of session %d to disk (%zu bytes)", entry.first,
+                     snapshot.data.size());
+    }
+  }
+}
+
+// ============================================================================
+// Phase 6.14: Idle-Time KV Compaction
+// ============================================================================
+// Partial deletions (history truncation, context shifts, evictions) leave holes
+// between the cells of other sequences. When kv_compaction is on, the backend
+// has been quiet for kv_compaction_idle_ms and the estimated fragmentation is
+// over the threshold, the governor has llama.cpp defragment the cache in place:
+// cells are moved on the device that holds them, so nothing passes through host
+// memory or disk, and cells shared by several sequences stay shared. It runs on
+// the engine thread between decode steps and only while no slot is generating;
+// sessions_mutex is not held, so arriving turns only wait for the move itself.
+
+// Engine thread only. Returns false if a slot was busy.
+static bool compact_kv_cache(LlamaChatContext *chat_ctx)
+{
+  auto &server_ctx = chat_ctx->server_ctx;
+  for (server_slot &slot : server_ctx.slots) {
+    if (slot.is_processing()) {
+      return false;
+    }
+  }
+
+  // The only public way to force llama.cpp's defragmentation and apply it now
+  // rather than inside the next llama_decode()
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+  llama_kv_self_defrag(server_ctx.ctx);
+  llama_kv_self_update(server_ctx.ctx);
+#pragma GCC diagnostic pop
+  return true;
+}
+
+// Governor tick: compact the KV cache once the backend is idle and fragmented
+static void compact_idle_kv_cache(LlamaChatContext *chat_ctx)
+{
+  if (!chat_ctx->kv_compaction_enabled || !chat_ctx->engine_running.load()) {
+    return;
+  }
+  const double fragmentation = chat_ctx->kv_accounting.fragmentation();
+  if (fragmentation < chat_ctx->kv_compaction_threshold || fragmentation == 0.0) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> swap_lock(chat_ctx->model_swap_mutex, std::try_to_lock);
+  if (!swap_lock.owns_lock() || chat_ctx->model_swapping_in_progress || !chat_ctx->server_ctx.ctx) {
+    return;
+  }
+  if (chat_ctx->task_queue) {
+    uint32_t queued = 0, active = 0, capacity = 0;
+    chat_ctx->task_queue->get_queue_status(queued, active, capacity);
+    if (queued > 0 || active > 0) {
+      return;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+    const auto now = std::chrono::steady_clock::now();
+    const auto idle_time = std::chrono::milliseconds(chat_ctx->kv_compaction_idle_ms);
+    for (const auto &pair : chat_ctx->sessions) {
+      if (pair.second.in_flight || now - pair.second.last_activity < idle_time) {
+        return;
+      }
+    }
+  }
+
+  // Sequence positions and sharing are unchanged, so sessions and the prefix
+  // cache stay valid; a turn that started meanwhile makes the engine skip it
+  const int64_t t_start = ggml_time_us();
+  bool compacted = false;
+  run_on_engine_thread(chat_ctx, [&]() {
+    compacted = compact_kv_cache(chat_ctx);
+    if (compacted) {
+      chat_ctx->kv_accounting.compacted();
+    }
+  });
+  if (!compacted) {
+    return;  // a slot became busy; try again on a later tick
+  }
+
+  // Re-estimated from the sequences as they are after the move
+  const double fragmentation_after = chat_ctx->kv_accounting.fragmentation();
+  const double ms = (ggml_time_us() - t_start) / 1000.0;
+  chat_ctx->kv_compactions++;
+  chat_ctx->kv_fragmentation_before.store(fragmentation);
+  chat_ctx->kv_fragmentation_after.store(fragmentation_after);
+  chat_ctx->kv_compaction_ms.store(ms);
+  WASI_NN_LOG_INFO(chat_ctx, "Compacted KV cache: %llu tokens, fragmentation %.1f%% -> %.1f%% in %.2f ms",
+                   (unsigned long long)chat_ctx->kv_accounting.spanned_tokens(), fragmentation * 100.0,
+                   fragmentation_after * 100.0, ms);
+}
+
+// Auto-cleanup function: removes old/excess sessions
+static void auto_cleanup_sessions(LlamaChatContext *chat_ctx)
+{
+  if (!chat_ctx->auto_cleanup_enabled)
+    return;
+
+  auto now = std::chrono::steady_clock::now();
+  auto idle_timeout = std::chrono::milliseconds(chat_ctx->idle_timeout_ms);
+
+  // Remove idle sessions
+  for (auto it = chat_ctx->sessions.begin(); it != chat_ctx->sessions.end();)
+  {
+    if (!it->second.in_flight && (now - it->second.last_activity) > idle_timeout)
+    {
+      auto idle_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         now - it->second.last_activity)
+                         .count();
+      NN_INFO_PRINTF("Auto-cleanup: removing idle session %d (idle for %lldms)",
+                     it->first, (long long)idle_time);
+      if (chat_ctx->session_save_on_evict && !chat_ctx->session_cache_dir.empty()) {
+        save_session_to_disk(chat_ctx, it->second);
+      }
+      it = chat_ctx->sessions.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  // Remove excess sessions (LRU eviction)
+  if (chat_ctx->sessions.size() >= chat_ctx->max_sessions)
+  {
+    // Sort by last_activity and remove the oldest
+    std::vector<std::pair<graph_execution_context,
+                          std::chrono::steady_clock::time_point>>
+        sorted_sessions;
+    for (const auto &session : chat_ctx->sessions)
+    {
+      if (session.second.in_flight)
+        continue;  // never evict a session that is generating
+      sorted_sessions.emplace_back(session.first, session.second.last_activity);
+    }
+
+    std::sort(sorted_sessions.begin(), sorted_sessions.end(),
+              [](const auto &a, const auto &b)
+              { return a.second < b.second; });
+
+    // Remove oldest sessions to make room
+    size_t sessions_to_remove =
+        chat_ctx->sessions.size() - chat_ctx->max_sessions + 1;
+    for (size_t i = 0; i < sessions_to_remove && i < sorted_sessions.size();
+         ++i)
+    {
+      auto exec_ctx_id = sorted_sessions[i].first;
+      NN_INFO_PRINTF("Auto-cleanup: removing session %d (max sessions reached)",
+                     exec_ctx_id);
+      if (chat_ctx->session_save_on_evict && !chat_ctx->session_cache_dir.empty()) {
+        save_session_to_disk(chat_ctx, chat_ctx->sessions.at(exec_ctx_id));
+      }
+      chat_ctx->sessions.erase(exec_ctx_id);
+    }
+  }
+}
+
+// ============================================================================
+// Phase 6.13: Admission Control
+// ============================================================================
+// A turn is checked before its task is posted. What can never fit the slot is
+// refused with too_large; otherwise the KV cells it adds (prompt plus reserved
+// output, minus what its sequence already holds) must fit the KV cache and,
+// with max_memory_mb set, the memory left beside the filled part of the cache.
+// Over budget, "evict" and "queue" take the cells of idle sessions of the same
+// or lower priority (least recently used first); "queue" then waits for
+// running turns to finish. What still does not fit is refused with context_full.
+
+// KV a turn adds on top of what its sequence holds now
+struct KvDemand
+{
+  int32_t n_tokens = 0;  // prompt + reserved output
+  int32_t n_new = 0;     // cells beyond the sequence's current length
+  uint64_t n_bytes = 0;  // n_new in K and V bytes
+};
+
+static KvDemand estimate_kv_demand(LlamaChatContext *chat_ctx, const SessionInfo &session_info,
+                                   size_t n_prompt, int n_reserve)
+{
+  const KvAccounting &kv = chat_ctx->kv_accounting;
+  KvDemand demand;
+  demand.n_tokens = (int32_t)n_prompt + std::max(0, n_reserve);
+  demand.n_new = std::max(0, demand.n_tokens - kv.sequence_tokens(session_info.seq_id));
+  demand.n_bytes = (uint64_t)demand.n_new * kv.token_bytes();
+  return demand;
+}
+
+static bool kv_demand_fits(LlamaChatContext *chat_ctx, const KvDemand &demand)
+{
+  const KvAccounting &kv = chat_ctx->kv_accounting;
+  const uint64_t kv_used = kv.spanned_tokens();
+  if (kv_used + demand.n_new > kv.capacity()) {
+    return false;
+  }
+  // Host memory is only known from the governor's sample; without the
+  // governor the turn is bounded by the KV cells alone
+  if (chat_ctx->max_memory_mb == 0 || chat_ctx->memory_sample_interval_ms == 0) {
+    return true;
+  }
+
+  // The cache is allocated up front, so only its filled part counts as used.
+  // max_memory_mb bounds host memory: KV of offloaded layers is in VRAM.
+  const uint64_t host_bytes_per_token = kv.host_token_bytes();
+  const uint64_t limit = (uint64_t)chat_ctx->max_memory_mb * 1024 * 1024;
+  const uint64_t usage = chat_ctx->current_memory_usage.load();
+  const uint64_t kv_total = (uint64_t)kv.capacity() * host_bytes_per_token;
+  const uint64_t other = usage > kv_total ? usage - kv_total : 0;
+  return other + (kv_used + demand.n_new) * host_bytes_per_token <= limit;
+}
+
+// Release the sequence of the least recently used idle session with a priority
+// at or below max_priority; its cache goes to the offload tiers when enabled
+static bool evict_idle_session(LlamaChatContext *chat_ctx, graph_execution_context exec_ctx,
+                               wasi_nn_task_priority max_priority)
+{
+  graph_execution_context victim_ctx = 0;
+  SessionInfo *victim = nullptr;
+  for (auto &pair : chat_ctx->sessions) {
+    SessionInfo &info = pair.second;
+    if (pair.first == exec_ctx || info.seq_id < 0 || info.in_flight || info.priority > max_priority ||
+        chat_ctx->kv_accounting.sequence_tokens(info.seq_id) == 0) {
+      continue;
+    }
+    if (!victim || info.priority < victim->priority ||
+        (info.priority == victim->priority && info.last_activity < victim->last_activity)) {
+      victim = &info;
+      victim_ctx = pair.first;
+    }
+  }
+  if (!victim) {
+    return false;
+  }
+
+  offload_session_kv(chat_ctx, *victim);
+  if (!reset_sequence(chat_ctx, victim->seq_id)) {
+    return false;
+  }
+  WASI_NN_LOG_INFO(chat_ctx, "Admission evicted session %d from KV sequence %d for session %d",
+                   victim_ctx, victim->seq_id, exec_ctx);
+  victim->seq_id = -1;
+  chat_ctx->admission_evictions++;
+  chat_ctx->sequence_available.notify_all();
+  return true;
+}
+
+// Admit a turn of exec_ctx needing demand (the session is bound and marked
+// in_flight so its sequence is not taken meanwhile). May wait, releasing the
+// lock; the session can be gone when this returns an error.
+static wasi_nn_error admit_kv_demand(LlamaChatContext *chat_ctx, std::unique_lock<std::mutex> &lock,
+                                     graph_execution_context exec_ctx, const KvDemand &demand)
+{
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(chat_ctx->admission_timeout_ms);
+  bool waited = false;
+  while (true) {
+    auto session_it = chat_ctx->sessions.find(exec_ctx);
+    if (session_it == chat_ctx->sessions.end()) {
+      return missing_session_error(chat_ctx, exec_ctx);  // closed or evicted while waiting
+    }
+    if (kv_demand_fits(chat_ctx, demand)) {
+      return success;
+    }
+    if (chat_ctx->admission_policy != "reject" &&
+        evict_idle_session(chat_ctx, exec_ctx, session_it->second.priority)) {
+      continue;
+    }
+    if (chat_ctx->admission_policy != "queue" || std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+
+    if (!waited) {
+      waited = true;
+      chat_ctx->admission_waits++;
+      WASI_NN_LOG_INFO(chat_ctx, "Session %d waits for %d KV cells (%.1f MiB)", exec_ctx, demand.n_new,
+                       demand.n_bytes / (1024.0 * 1024.0));
+    }
+    chat_ctx->sequence_available.wait_until(lock, deadline);
+  }
+
+  chat_ctx->admission_rejections++;
+  const KvAccounting &kv = chat_ctx->kv_accounting;
+  WASI_NN_LOG_WARN(chat_ctx, "Session %d refused: needs %d more KV cells (%.1f MiB), %llu of %u in use",
+                   exec_ctx, demand.n_new, demand.n_bytes / (1024.0 * 1024.0),
+                   (unsigned long long)kv.spanned_tokens(), kv.capacity());
+  return context_full;
+}
+
+// Original function for WASI-NN compatibility (kept for backward compatibility)
+__attribute__((visibility("default"))) wasi_nn_error init_execution_context(
+    void *ctx, graph g, graph_execution_context *exec_ctx)
+{
+  // Delegate to the session-aware version with a default session ID
+  return init_execution_context_with_session_id(ctx, "default_session", exec_ctx);
+}
+
+// New function that properly handles session IDs (matches NIF expectations)
+__attribute__((visibility("default"))) wasi_nn_error init_execution_context_with_session_id(
+    void *ctx, const char *session_id, graph_execution_context *exec_ctx)
+{
+  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
+  if (!chat_ctx || !chat_ctx->server_ctx.model)
+    return invalid_argument;
+
+  if (!session_id) {
+    NN_ERR_PRINTF("Session ID cannot be null");
+    return invalid_argument;
+  }
+
+  std::string session_id_str(session_id);
+
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+
+  // Check if session already exists
+  for (auto &pair : chat_ctx->sessions) {
+    if (pair.second.session_id == session_id_str) {
+      *exec_ctx = pair.first;
+      NN_INFO_PRINTF("Reusing existing session '%s' with execution context %d",
+                     session_id, pair.first);
+      return success;
     }
   }
 
   // Auto-cleanup on entry to free up space before checking session limits
   auto_cleanup_sessions(chat_ctx);
 
-  // Check if we can create a new session (use sessions.size() vs max_sessions)
-  if (chat_ctx->sessions.size() >= chat_ctx->max_sessions)
-  {
-    NN_ERR_PRINTF("Unable to create new session after cleanup. Current: %zu, Max: %d",
-                  chat_ctx->sessions.size(), chat_ctx->max_sessions);
+  // Check if we can create a new session (use sessions.size() vs max_sessions)
+  if (chat_ctx->sessions.size() >= chat_ctx->max_sessions)
+  {
+    NN_ERR_PRINTF("Unable to create new session after cleanup. Current: %zu, Max: %d",
+                  chat_ctx->sessions.size(), chat_ctx->max_sessions);
+    return runtime_error;
+  }
+
+  // Phase 6.13: with "reject", a backend at its memory limit takes no new sessions
+  if (chat_ctx->admission_policy == "reject" && !kv_demand_fits(chat_ctx, KvDemand())) {
+    chat_ctx->admission_rejections++;
+    NN_ERR_PRINTF("Refusing new session '%s': memory is at max_memory_mb (%u MB)",
+                  session_id, chat_ctx->max_memory_mb);
+    return too_large;
+  }
+
+  // Threadpools and slot samplers are owned by the inference engine; nothing to set up here
+
+  // Create new session with provided session ID
+  graph_execution_context new_exec_ctx = chat_ctx->next_exec_ctx_id++;
+  SessionInfo session_info;
+  session_info.session_id = session_id_str;  // Use the provided session ID
+  session_info.last_activity = std::chrono::steady_clock::now();
+
+  // Resume a conversation saved under this session ID and model version
+  if (chat_ctx->session_restore_on_open && !chat_ctx->session_cache_dir.empty()) {
+    restore_session_from_disk(chat_ctx, session_info);
+  }
+
+  chat_ctx->sessions[new_exec_ctx] = std::move(session_info);
+
+  *exec_ctx = new_exec_ctx;
+
+  NN_INFO_PRINTF(
+      "Execution context %d initialized for session '%s'. Total sessions: %zu, Max sessions: %d",
+      new_exec_ctx, session_id, chat_ctx->sessions.size(), chat_ctx->max_sessions);
+
+  return success;
+}
+
+__attribute__((visibility("default"))) wasi_nn_error
+close_execution_context(void *ctx, graph_execution_context exec_ctx)
+{
+  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
+  if (!chat_ctx)
+    return invalid_argument;
+
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+
+  auto it = chat_ctx->sessions.find(exec_ctx);
+  if (it != chat_ctx->sessions.end())
+  {
+    NN_INFO_PRINTF("Closing execution context %d for session '%s'", exec_ctx,
+                   it->second.session_id.c_str());
+
+    // Phase 6.5: Keep the conversation on disk so the user can resume it later
+    if (chat_ctx->session_save_on_close && !chat_ctx->session_cache_dir.empty() &&
+        !it->second.history.empty()) {
+      save_session_to_disk(chat_ctx, it->second);
+    }
+
+    // Phase 4.3: Auto-clear KV cache for this session before closing
+    auto_clear_kv_cache_session(chat_ctx, exec_ctx);
+
+    chat_ctx->sessions.erase(it);
+    chat_ctx->sequence_available.notify_all();
+
+    // Phase 4.3: Check if we should do global memory optimization after session close
+    if (chat_ctx->sessions.empty()) {
+      // All sessions closed, good time for global cleanup
+      auto_clear_all_kv_cache(chat_ctx);
+    }
+
+    return success;
+  }
+
+  // The host releases a handle the memory governor already evicted
+  if (chat_ctx->evicted_sessions.erase(exec_ctx)) {
+    return success;
+  }
+
+  return invalid_argument;
+}
+
+// ============================================================================
+// Phase 6.10: Session History Store
+// ============================================================================
+// A new message is rendered together with the system message and the message
+// before it only, and the text it adds is tokenized on its own, so a turn costs
+// O(new message) however long the conversation is. Templates that do not render
+// messages independently (the extended render does not start with the base
+// one) fall back to rendering and tokenizing the whole conversation. Passing
+// that prefix test is not proof: a template may move content between turns
+// (the built-in Gemma template folds the system prompt into the next user
+// turn), so the first append of each kind is also compared with a whole
+// render, and a mismatch turns segmented renders off for the template.
+
+static std::string render_chat_messages(LlamaChatContext *chat_ctx, const std::vector<common_chat_msg> &messages,
+                                        bool add_generation_prompt)
+{
+  common_chat_templates_inputs inputs;
+  inputs.messages = messages;
+  inputs.add_generation_prompt = add_generation_prompt;
+  return common_chat_templates_apply(chat_ctx->server_ctx.chat_templates.get(), inputs).prompt;
+}
+
+// Append a message and its rendered tokens; a user message also renders the generation prompt
+static void append_history_message(LlamaChatContext *chat_ctx, SessionHistory &history,
+                                   const std::string &role, const std::string &content)
+{
+  const llama_context *ctx = chat_ctx->server_ctx.ctx;
+  const bool add_generation_prompt = role == "user";
+
+  common_chat_msg msg;
+  msg.role = role;
+  msg.content = content;
+
+  if (history.empty()) {
+    history.tokens = common_tokenize(ctx, render_chat_messages(chat_ctx, {msg}, add_generation_prompt), true, true);
+    history.segmented = true;
+    history.push(role, content, 0);
+    return;
+  }
+
+  if (history.segmented && chat_ctx->history_segmentable) {
+    const bool has_system = history.role(0) == "system" && history.size() > 1;
+    const std::string &prev_role = history.role(history.size() - 1);
+    std::vector<common_chat_msg> context;
+    if (has_system) {
+      context.push_back(history.message(0));
+    }
+    context.push_back(history.message(history.size() - 1));
+    const std::string base = render_chat_messages(chat_ctx, context, prev_role == "user");
+    context.push_back(msg);
+    const std::string extended = render_chat_messages(chat_ctx, context, add_generation_prompt);
+
+    if (extended.size() >= base.size() && extended.compare(0, base.size(), base) == 0) {
+      llama_tokens delta = common_tokenize(ctx, extended.substr(base.size()), false, true);
+
+      const std::string kind = (has_system ? "system:" : ":") + prev_role + ":" + role;
+      if (!chat_ctx->history_segments_verified.count(kind)) {
+        std::vector<common_chat_msg> messages = history.messages();
+        messages.push_back(msg);
+        const llama_tokens full = common_tokenize(ctx, render_chat_messages(chat_ctx, messages, add_generation_prompt),
+                                                  true, true);
+        const bool same = full.size() == history.tokens.size() + delta.size() &&
+                          std::equal(history.tokens.begin(), history.tokens.end(), full.begin()) &&
+                          std::equal(delta.begin(), delta.end(), full.begin() + history.tokens.size());
+        if (same) {
+          chat_ctx->history_segments_verified.insert(kind);
+        } else {
+          chat_ctx->history_segmentable = false;
+          WASI_NN_LOG_WARN(chat_ctx, "Chat template does not render messages independently (%s append), "
+                           "rendering whole conversations from now on", kind.c_str());
+        }
+      }
+
+      if (chat_ctx->history_segmentable) {
+        const size_t token_begin = history.tokens.size();
+        history.tokens.insert(history.tokens.end(), delta.begin(), delta.end());
+        history.push(role, content, token_begin);
+        return;
+      }
+    }
+  }
+
+  // Whole-conversation render; spans are lost until the next rebuild
+  history.push(role, content, history.tokens.size());
+  history.tokens = common_tokenize(ctx, render_chat_messages(chat_ctx, history.messages(), add_generation_prompt),
+                                   true, true);
+  history.segmented = false;
+}
+
+// Render the history again from its messages: after a restore, a model switch,
+// or an edit of a history that has no token spans. The session's KV sequence
+// is re-mapped on the next turn.
+static void rebuild_session_history(LlamaChatContext *chat_ctx, SessionInfo &session_info)
+{
+  SessionHistory &history = session_info.history;
+  const std::vector<common_chat_msg> messages = history.messages();
+  history.clear();
+  for (const auto &msg : messages) {
+    append_history_message(chat_ctx, history, msg.role, msg.content);
+  }
+  history.rendered = true;
+  history.model_version = chat_ctx->current_model_version;
+
+  if (session_info.n_shifted > 0) {
+    session_info.n_shifted = 0;
+    session_info.shift_unknown = true;
+  }
+  NN_DBG_PRINTF("Rebuilt history of session '%s': %zu messages, %zu tokens%s",
+                session_info.session_id.c_str(), history.size(), history.tokens.size(),
+                history.segmented ? "" : " (whole-conversation template)");
+}
+
+// Make the history's tokens current before a turn; caller holds sessions_mutex
+static void prepare_session_history(LlamaChatContext *chat_ctx, SessionInfo &session_info)
+{
+  const SessionHistory &history = session_info.history;
+  if (!history.rendered || history.model_version != chat_ctx->current_model_version) {
+    rebuild_session_history(chat_ctx, session_info);
+  }
+}
+
+// Drop the unanswered last message of a failed turn
+static void pop_history_message(LlamaChatContext *chat_ctx, SessionInfo &session_info)
+{
+  session_info.history.pop_back();
+  if (!session_info.history.rendered) {
+    rebuild_session_history(chat_ctx, session_info);
+  }
+}
+
+// Keep the history within history_max_tokens by dropping the oldest turns (a
+// user message and the replies to it), never the leading system message or the
+// newest message. Tokens dropped from inside the context-shift window only
+// shrink the window; otherwise they are discarded from the KV sequence as well
+// when it holds them, so the rest of the conversation stays cached.
+// Caller holds sessions_mutex.
+static void truncate_session_history(LlamaChatContext *chat_ctx, SessionInfo &session_info)
+{
+  SessionHistory &history = session_info.history;
+  const size_t budget = chat_ctx->history_max_tokens;
+  if (budget == 0 || chat_ctx->history_truncation != "drop_oldest" || history.tokens.size() <= budget) {
+    return;
+  }
+
+  // Without spans a message's share of the tokens is estimated from its text
+  auto message_tokens = [&](size_t i) -> size_t {
+    const auto &entry = history.entries[i];
+    if (history.segmented) {
+      return entry.token_end - entry.token_begin;
+    }
+    return history.text.empty() ? 0 : entry.text_len * history.tokens.size() / history.text.size();
+  };
+
+  const size_t first = history.role(0) == "system" ? 1 : 0;
+  const size_t n_excess = history.tokens.size() - budget;
+  size_t last = first;
+  size_t n_drop = 0;
+  while (last + 1 < history.size() && n_drop < n_excess) {
+    do {
+      n_drop += message_tokens(last);
+      last++;
+    } while (last + 1 < history.size() && history.role(last) != "user");
+  }
+  if (last == first) {
+    return;
+  }
+
+  // The BOS the first tokenize added opens the span of the first message but
+  // belongs to the whole prompt, so it stays when that message is dropped
+  const bool segmented = history.segmented;
+  size_t n_bos = 0;
+  if (segmented && history.entries[first].token_begin == 0) {
+    const llama_token bos = llama_vocab_bos(chat_ctx->server_ctx.vocab);
+    while (n_bos < history.entries[first].token_end && history.tokens[n_bos] == bos) {
+      n_bos++;
+    }
+  }
+
+  llama_tokens dropped;
+  const int p0 = (int)(history.entries[first].token_begin + n_bos);
+  const int p1 = (int)history.entries[last - 1].token_end;
+  if (segmented) {
+    dropped.assign(history.tokens.begin() + p0, history.tokens.begin() + p1);
+  }
+  history.erase(first, last, n_bos);
+  if (!segmented) {
+    rebuild_session_history(chat_ctx, session_info);
+  }
+
+  WASI_NN_LOG_INFO(chat_ctx, "History of session '%s' over budget: dropped %zu oldest messages, %zu tokens left",
+                   session_info.session_id.c_str(), last - first, history.tokens.size());
+
+  auto &server_ctx = chat_ctx->server_ctx;
+  const llama_seq_id seq_id = session_info.seq_id;
+  const server_slot *bound_slot = server_ctx.get_slot_by_id(seq_id);
+  if (!segmented || !bound_slot || session_info.shift_unknown) {
+    return;
+  }
+
+  const int n_keep = context_shift_start(chat_ctx, bound_slot->n_ctx);
+  if (session_info.n_shifted > 0) {
+    if (p0 >= n_keep && p1 <= n_keep + session_info.n_shifted) {
+      // Already out of the sequence
+      session_info.n_shifted -= p1 - p0;
+    } else {
+      session_info.shift_unknown = true;
+    }
+    return;
+  }
+
+  bool discarded = false;
+  run_on_engine_thread(chat_ctx, [&]() {
+    server_slot *slot = server_ctx.get_slot_by_id(seq_id);
+    if (!slot || slot->is_processing()) {
+      return;
+    }
+    const llama_tokens &cached = slot->cache_tokens.get_text_tokens();
+    if (cached.size() >= (size_t)p1 && std::equal(dropped.begin(), dropped.end(), cached.begin() + p0)) {
+      discarded = discard_sequence_range(server_ctx, *slot, p0, p1) > 0;
+    }
+  });
+  if (discarded) {
+    chat_ctx->prefix_cache.erase(seq_id);
+  }
+}
+
+// Seed a session's sequence with the longest prompt prefix already decoded in
+// another sequence (Phase 6.4). Runs before the task is posted, so the slot's
+// own prefix matching then prefills only the remainder. Caller holds sessions_mutex.
+static void share_cached_prefix(LlamaChatContext *chat_ctx, llama_seq_id seq_id,
+                                const llama_tokens &prompt_tokens)
+{
+  if (!chat_ctx->enable_prefix_cache || !chat_ctx->enable_token_cache_reuse ||
+      !chat_ctx->server_ctx.params_base.kv_unified) {
+    return;  // partial copies between separate KV streams are not supported
+  }
+
+  const size_t n_min = chat_ctx->prefix_cache_min_tokens;
+  const size_t n_own = chat_ctx->prefix_cache.common_prefix(seq_id, prompt_tokens);
+  const PrefixCache::Match match = chat_ctx->prefix_cache.find(prompt_tokens, seq_id);
+
+  size_t n_copied = 0;
+  if (match.seq_id >= 0 && match.n_tokens >= n_min && match.n_tokens > n_own) {
+    auto &server_ctx = chat_ctx->server_ctx;
+    run_on_engine_thread(chat_ctx, [&]() {
+      server_slot *dst = server_ctx.get_slot_by_id(seq_id);
+      server_slot *src = server_ctx.get_slot_by_id(match.seq_id);
+      if (!dst || !src || dst->is_processing()) {
+        return;
+      }
+      llama_memory_t mem = llama_get_memory(server_ctx.ctx);
+
+      // The tree may be stale; trust only what the source slot still holds
+      auto common_prefix = [&prompt_tokens](const llama_tokens &tokens, size_t n_limit) {
+        n_limit = std::min(n_limit, tokens.size());
+        size_t n = 0;
+        while (n < n_limit && tokens[n] == prompt_tokens[n]) {
+          n++;
+        }
+        return n;
+      };
+
+      const llama_pos src_pos_max = llama_memory_seq_pos_max(mem, match.seq_id);
+      const size_t n_shared = common_prefix(src->cache_tokens.get_text_tokens(),
+                                            std::min(match.n_tokens, (size_t)std::max(0, src_pos_max + 1)));
+      const size_t n_dst = common_prefix(dst->cache_tokens.get_text_tokens(), prompt_tokens.size());
+      if (n_shared < n_min || n_shared <= n_dst) {
+        return;
+      }
+
+      // With a unified KV cache the copied cells are shared, not duplicated
+      llama_memory_seq_rm(mem, seq_id, -1, -1);
+      llama_memory_seq_cp(mem, match.seq_id, seq_id, 0, (llama_pos)n_shared);
+
+      dst->cache_tokens.clear();
+      dst->cache_tokens.insert(llama_tokens(prompt_tokens.begin(), prompt_tokens.begin() + n_shared));
+      n_copied = n_shared;
+    });
+  }
+
+  if (n_copied > 0) {
+    chat_ctx->prefix_cache_hits++;
+    chat_ctx->prefix_cache_tokens_shared += n_copied;
+    WASI_NN_LOG_DEBUG(chat_ctx, "Prefix cache hit: copied %zu tokens from sequence %d into sequence %d",
+                      n_copied, match.seq_id, seq_id);
+  } else if (n_own < n_min) {
+    chat_ctx->prefix_cache_misses++;
+  }
+}
+
+// Map a session's prompt onto its KV sequence and make it fit the slot (Phase 6.6).
+// Tokens dropped by earlier context shifts are dropped from the prompt as well,
+// so the slot's prefix matching still reuses the shifted sequence. When the
+// prompt plus n_reserve generated tokens would overflow the slot, a further
+// window after the kept prefix is discarded from both the sequence and the
+// prompt. The tokens to send are written to tokens, whose capacity is reused.
+// Caller holds sessions_mutex.
+static void fit_session_context(LlamaChatContext *chat_ctx, SessionInfo &session_info,
+                                const llama_tokens &prompt_tokens, int n_reserve, llama_tokens &tokens)
+{
+  auto &server_ctx = chat_ctx->server_ctx;
+  const llama_seq_id seq_id = session_info.seq_id;
+  const server_slot *bound_slot = server_ctx.get_slot_by_id(seq_id);
+  if (!context_shift_available(chat_ctx) || !bound_slot) {
+    tokens.assign(prompt_tokens.begin(), prompt_tokens.end());
+    return;
+  }
+
+  const int n_ctx_slot = bound_slot->n_ctx;
+  const size_t n_keep = context_shift_start(chat_ctx, n_ctx_slot);
+  n_reserve = std::min(std::max(n_reserve, 1), n_ctx_slot / 2);
+
+  // Under "smart" a sequence may only grow to sinks plus window plus this turn,
+  // so it settles there instead of filling the slot first
+  int n_capacity = n_ctx_slot;
+  if (chat_ctx->cache_strategy == "smart") {
+    n_capacity = std::min(n_ctx_slot, (int)n_keep + recent_window_tokens(chat_ctx, n_ctx_slot, (int)n_keep, n_reserve) + n_reserve);
+  }
+
+  auto apply_window = [&](size_t n_shifted) {
+    if (n_shifted == 0 || prompt_tokens.size() <= n_keep + n_shifted) {
+      tokens.assign(prompt_tokens.begin(), prompt_tokens.end());
+      return;
+    }
+    tokens.assign(prompt_tokens.begin(), prompt_tokens.begin() + n_keep);
+    tokens.insert(tokens.end(), prompt_tokens.begin() + n_keep + n_shifted, prompt_tokens.end());
+  };
+
+  size_t n_shifted = session_info.n_shifted;
+  if (prompt_tokens.size() <= n_keep + n_shifted) {
+    n_shifted = 0;
+  }
+  apply_window(n_shifted);
+
+  if (!session_info.shift_unknown && (int)tokens.size() + n_reserve <= n_capacity) {
+    return;
+  }
+
+  int n_past = 0;
+  int n_discard = 0;
+  run_on_engine_thread(chat_ctx, [&]() {
+    server_slot *slot = server_ctx.get_slot_by_id(seq_id);
+    if (!slot || slot->is_processing()) {
+      return;
+    }
+    const llama_tokens &cached = slot->cache_tokens.get_text_tokens();
+
+    if (session_info.shift_unknown && cached.size() > n_keep && prompt_tokens.size() > n_keep &&
+        std::equal(cached.begin(), cached.begin() + n_keep, prompt_tokens.begin())) {
+      // Locate what the sequence holds after the kept prefix within the prompt
+      const size_t n_probe = std::min<size_t>(32, cached.size() - n_keep);
+      auto it = std::search(prompt_tokens.begin() + n_keep, prompt_tokens.end(),
+                            cached.begin() + n_keep, cached.begin() + n_keep + n_probe);
+      if (it != prompt_tokens.end()) {
+        n_shifted = it - (prompt_tokens.begin() + n_keep);
+        apply_window(n_shifted);
+      }
+    }
+
+    const int n_overflow = (int)tokens.size() + n_reserve - n_capacity;
+    const int n_left = (int)tokens.size() - (int)n_keep;
+    if (n_overflow <= 0 || n_left <= 0) {
+      return;
+    }
+
+    n_discard = context_discard_tokens(chat_ctx, n_ctx_slot, (int)n_keep, n_left, n_reserve);
+
+    // Only the part of the sequence that matches the prompt is worth shifting
+    size_t n_common = 0;
+    while (n_common < cached.size() && n_common < tokens.size() && cached[n_common] == tokens[n_common]) {
+      n_common++;
+    }
+    n_past = sequence_n_past(server_ctx, *slot);
+    if (n_common > n_keep) {
+      truncate_sequence(server_ctx, *slot, (int)n_common);
+      discard_sequence_range(server_ctx, *slot, (int)n_keep, (int)n_keep + n_discard);
+    }
+
+    n_shifted += n_discard;
+    apply_window(n_shifted);
+  });
+
+  session_info.n_shifted = (int32_t)n_shifted;
+  session_info.shift_unknown = false;
+
+  if (n_discard > 0) {
+    chat_ctx->prefix_cache.erase(seq_id);
+    chat_ctx->context_shifts++;
+    WASI_NN_LOG_INFO(chat_ctx, "Context shift for session %s: n_past=%d, n_keep=%zu, n_discard=%d, "
+                     "%zu of %zu prompt tokens kept", session_info.session_id.c_str(), n_past, n_keep,
+                     n_discard, tokens.size(), prompt_tokens.size());
+  }
+}
+
+// Build the slot parameters for one completion request: model defaults from
+// params_base with the per-request runtime overrides applied on top
+// (mirrors server_task::params_from_json_cmpl)
+static slot_params build_slot_params(LlamaChatContext *chat_ctx,
+                                     const wasi_nn_runtime_params *runtime_params)
+{
+  const common_params &params_base = chat_ctx->server_ctx.params_base;
+
+  slot_params params;
+  params.stream = false;
+  params.cache_prompt = chat_ctx->enable_token_cache_reuse;
+  params.n_keep = params_base.n_keep;
+  if (!chat_ctx->server_ctx.slots.empty()) {
+    // The engine shifts at the same place as fit_session_context()
+    const int n_ctx_slot = chat_ctx->server_ctx.slots.front().n_ctx;
+    params.n_keep = context_keep_tokens(chat_ctx, n_ctx_slot);
+    params.n_discard = (int32_t)chat_ctx->n_discard_tokens;
+    if (chat_ctx->cache_strategy == "smart") {
+      // The engine shifts a full slot (n_ctx - 1 tokens) down to sinks plus the recent window
+      const int n_keep = context_shift_start(chat_ctx, n_ctx_slot);
+      params.n_discard = std::max(1, context_discard_tokens(chat_ctx, n_ctx_slot, n_keep,
+                                                             n_ctx_slot - 1 - n_keep, 1));
+    }
+  } else {
+    params.n_discard = (int32_t)chat_ctx->n_discard_tokens;
+  }
+  params.n_predict = params_base.n_predict;
+  params.sampling = params_base.sampling;
+  params.speculative = params_base.speculative;
+  params.antiprompt = params_base.antiprompt;
+  params.lora = params_base.lora_adapters;
+
+  if (runtime_params) {
+    apply_runtime_params_to_sampling(params.sampling, *runtime_params, chat_ctx);
+
+    if (runtime_params->max_tokens > 0) {
+      params.n_predict = runtime_params->max_tokens;
+      WASI_NN_LOG_DEBUG(chat_ctx, "Using runtime max_tokens: %d", params.n_predict);
+    }
+
+    if (runtime_params->stop_sequences_set) {
+      params.antiprompt = runtime_params->stop_sequences;
+      WASI_NN_LOG_DEBUG(chat_ctx, "Applied %zu runtime stop sequences", params.antiprompt.size());
+    }
+  }
+
+  // EOG tokens are masked rather than checked, so stop strings and limits still apply
+  if (params.sampling.ignore_eos) {
+    params.sampling.logit_bias.insert(params.sampling.logit_bias.end(),
+                                      params_base.sampling.logit_bias_eog.begin(),
+                                      params_base.sampling.logit_bias_eog.end());
+  }
+
+  return params;
+}
+
+// Map a server task error onto the WASI-NN error space
+static wasi_nn_error server_error_to_wasi_nn(const server_task_result_error *error)
+{
+  if (!error) {
     return runtime_error;
   }
 
-  // Initialize sampler if not already done (from main.cpp)
-  // Setup threadpools if not already done
-  wasi_nn_error result = setup_threadpools(chat_ctx);
-  if (result != success)
+  switch (error->err_type) {
+    case ERROR_TYPE_INVALID_REQUEST:
+      return invalid_argument;
+    case ERROR_TYPE_NOT_SUPPORTED:
+      return unsupported_operation;
+    case ERROR_TYPE_TIMEOUT:
+      return timeout;
+    case ERROR_TYPE_CANCELLED:
+      return cancelled;
+    default:
+      return runtime_error;
+  }
+}
+
+// Statuses that come with (possibly partial) output for the caller
+static bool has_turn_output(wasi_nn_error status)
+{
+  return status == success || status == timeout || status == cancelled;
+}
+
+// The caller is submitting a new turn: earlier cancel requests do not apply to it
+static void reset_cancel_request(LlamaChatContext *chat_ctx, graph_execution_context exec_ctx)
+{
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+  auto session_it = chat_ctx->sessions.find(exec_ctx);
+  if (session_it != chat_ctx->sessions.end()) {
+    session_it->second.cancel_requested->store(false);
+  }
+}
+
+// Deadline of a turn on the engine clock (ggml_time_us), 0 = none
+static int64_t engine_deadline_us(std::chrono::steady_clock::time_point deadline)
+{
+  const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+      deadline - std::chrono::steady_clock::now());
+  return ggml_time_us() + std::max<int64_t>(1, remaining.count());
+}
+
+// Run one chat turn for a session on the continuous batching engine.
+// The whole conversation is rendered and tokenized, then posted as a completion
+// task; the engine reuses the slot's cached prefix and decodes this session
+// together with every other active one. A turn that reaches t_deadline_us
+// (ggml_time_us clock, 0 = none) stops at the next token boundary and returns
+// `timeout` with the partial response, which is kept as the assistant turn;
+// a turn stopped by cancel_inference() does the same with `cancelled`.
+static wasi_nn_error run_inference_for_session_with_params(LlamaChatContext *chat_ctx,
+                                                          graph_execution_context exec_ctx,
+                                                          const std::string &user_input,
+                                                          const wasi_nn_runtime_params *runtime_params,
+                                                          std::string &response,
+                                                          const std::function<bool(const std::string &)> &on_piece = nullptr,
+                                                          int64_t t_deadline_us = 0)
+{
+  auto &server_ctx = chat_ctx->server_ctx;
+
+  if (!server_ctx.chat_templates.get()) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Chat templates not initialized for prompt generation");
+    return runtime_error;
+  }
+
+  if (!chat_ctx->engine_running.load()) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Inference engine is not running");
+    return runtime_error;
+  }
+
+  server_task task(SERVER_TASK_TYPE_COMPLETION);
+  task.params = build_slot_params(chat_ctx, runtime_params);
+  task.params.t_deadline_us = t_deadline_us;
+  llama_tokens sent_tokens;
+  size_t sent_capacity = 0;
   {
-    return result;
+    std::unique_lock<std::mutex> lock(chat_ctx->sessions_mutex);
+
+    if (chat_ctx->sessions.find(exec_ctx) == chat_ctx->sessions.end()) {
+      WASI_NN_LOG_ERROR(chat_ctx, "Invalid execution context %d", exec_ctx);
+      return missing_session_error(chat_ctx, exec_ctx);
+    }
+
+    // Cancelled while it waited in the task queue
+    if (chat_ctx->sessions.at(exec_ctx).cancel_requested->load()) {
+      WASI_NN_LOG_INFO(chat_ctx, "Session %d turn cancelled before it started", exec_ctx);
+      return cancelled;
+    }
+
+    // The turn's priority decides which sequences it may bind
+    if (runtime_params && runtime_params->priority >= 0) {
+      chat_ctx->sessions.at(exec_ctx).priority = (wasi_nn_task_priority)runtime_params->priority;
+    }
+    wasi_nn_error bind_result = bind_session_sequence(chat_ctx, lock, exec_ctx,
+                                                      chat_ctx->sessions.at(exec_ctx).priority);
+    if (bind_result != success) {
+      WASI_NN_LOG_ERROR(chat_ctx, "Failed to bind a KV sequence for session %d", exec_ctx);
+      return bind_result;
+    }
+
+    SessionInfo &session_info = chat_ctx->sessions.at(exec_ctx);
+    session_info.last_activity = std::chrono::steady_clock::now();
+    if (runtime_params && runtime_params->tenant_set) {
+      session_info.tenant = runtime_params->tenant;
+    }
+    task.params.priority = session_info.priority;
+    task.params.cancel_flag = session_info.cancel_requested;
+
+    // A restored session brings its KV state back instead of re-prefilling
+    load_session_kv(chat_ctx, session_info);
+    restore_offloaded_kv(chat_ctx, session_info);
+
+    // Render only the new message, then keep the history within its budget
+    prepare_session_history(chat_ctx, session_info);
+    append_history_message(chat_ctx, session_info.history, "user", user_input);
+    truncate_session_history(chat_ctx, session_info);
+    const llama_tokens &prompt_tokens = session_info.history.tokens;
+
+    WASI_NN_LOG_DEBUG(chat_ctx, "Processing prompt for session %d: %zu tokens, %zu messages",
+                      exec_ctx, prompt_tokens.size(), session_info.history.size());
+
+    // Follow earlier context shifts and make room for this turn's output
+    const int n_ctx_slot = server_ctx.get_slot_by_id(session_info.seq_id)->n_ctx;
+    const int n_reserve = task.params.n_predict > 0 ? task.params.n_predict : n_ctx_slot / 4;
+    sent_tokens.swap(session_info.scratch_tokens);
+    sent_capacity = sent_tokens.capacity();
+    fit_session_context(chat_ctx, session_info, prompt_tokens, n_reserve, sent_tokens);
+
+    // Phase 6.13: settle whether the turn fits before any compute is spent
+    wasi_nn_error admit_result = success;
+    if ((int)sent_tokens.size() >= n_ctx_slot ||
+        (task.params.n_predict > 0 && (int)sent_tokens.size() + task.params.n_predict > n_ctx_slot &&
+         !context_shift_available(chat_ctx))) {
+      WASI_NN_LOG_ERROR(chat_ctx, "Session %d turn needs %zu prompt + %d output tokens, the slot holds %d",
+                        exec_ctx, sent_tokens.size(), std::max(0, task.params.n_predict), n_ctx_slot);
+      chat_ctx->admission_rejections++;
+      admit_result = too_large;
+    } else {
+      const KvDemand demand = estimate_kv_demand(chat_ctx, session_info, sent_tokens.size(), n_reserve);
+      session_info.in_flight = true;
+      admit_result = admit_kv_demand(chat_ctx, lock, exec_ctx, demand);
+    }
+    if (admit_result != success) {
+      auto session_it = chat_ctx->sessions.find(exec_ctx);
+      if (session_it != chat_ctx->sessions.end()) {
+        SessionInfo &refused = session_it->second;
+        refused.in_flight = false;
+        if (!refused.history.empty() && refused.history.role(refused.history.size() - 1) == "user") {
+          pop_history_message(chat_ctx, refused);
+        }
+        refused.scratch_tokens.swap(sent_tokens);
+      }
+      chat_ctx->sequence_available.notify_all();
+      return admit_result;
+    }
+
+    // Start from a prefix another session already decoded (e.g. a shared system prompt)
+    share_cached_prefix(chat_ctx, session_info.seq_id, sent_tokens);
+
+    // The slot matches these against the tokens already in the session's KV
+    // sequence and only decodes the suffix past the common prefix. The task
+    // gets its own copy: sent_tokens is still needed for the prefix cache and
+    // goes back to the session as scratch once the turn is done.
+    task.prompt_tokens = server_tokens(sent_tokens);
+
+    // Decode on the slot that owns this session's KV sequence
+    task.id_selected_slot = session_info.seq_id;
+    session_info.in_flight = true;
   }
 
-  // Initialize samplers for all slots (crucial for inference)
-  for (auto &slot : chat_ctx->server_ctx.slots) {
-    if (slot.smpl != nullptr) {
-      common_sampler_free(slot.smpl);
+  task.index = 0;
+  task.params.stream = static_cast<bool>(on_piece);
+  task.id = server_ctx.queue_tasks.get_new_id();
+
+  const int id_task = task.id;
+  server_ctx.queue_results.add_waiting_task_id(id_task);
+  server_ctx.queue_tasks.post(std::move(task));
+
+  // In streaming mode partial results carry text that is already UTF-8 complete
+  // and has stop-sequence prefixes held back; the final result only adds the rest
+  server_task_result_ptr result;
+  size_t n_streamed = 0;
+  bool aborted = false;
+  while (true) {
+    result = server_ctx.queue_results.recv(id_task);
+    if (!result || result->is_error() || result->is_stop()) {
+      break;
     }
-    slot.smpl = common_sampler_init(chat_ctx->server_ctx.model, slot.params.sampling);
-    if (slot.smpl == nullptr) {
-      NN_ERR_PRINTF("Failed to initialize sampler for slot %d", slot.id);
-      return runtime_error;
+
+    auto *partial = dynamic_cast<server_task_result_cmpl_partial *>(result.get());
+    if (!partial || partial->content.empty()) {
+      continue;
+    }
+
+    response += partial->content;
+    n_streamed = response.size();
+    if (!on_piece(partial->content)) {
+      // Caller has what it needs; free the slot instead of decoding the rest
+      WASI_NN_LOG_INFO(chat_ctx, "Streaming aborted by callback for session %d after %zu bytes",
+                       exec_ctx, n_streamed);
+      server_task cancel(SERVER_TASK_TYPE_CANCEL);
+      cancel.id = server_ctx.queue_tasks.get_new_id();
+      cancel.id_target = id_task;
+      server_ctx.queue_tasks.post(std::move(cancel), true);
+      aborted = true;
+      break;
+    }
+  }
+  server_ctx.queue_results.remove_waiting_task_id(id_task);
+
+  wasi_nn_error err = success;
+  int32_t n_prompt_tokens = 0;
+  int32_t n_prompt_prefilled = 0;
+  result_timings timings;
+  bool truncated = false;
+  wasi_nn_error stop_status = success;  // timeout / cancelled, with the partial answer kept
+  if (aborted) {
+    // Keep what was delivered; the partial answer becomes the assistant turn
+  } else if (!result) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Inference engine stopped before task %d completed", id_task);
+    err = runtime_error;
+  } else if (result->is_error()) {
+    auto *error = dynamic_cast<server_task_result_error *>(result.get());
+    WASI_NN_LOG_ERROR(chat_ctx, "Inference task %d failed: %s", id_task,
+                      error ? error->err_msg.c_str() : "unknown error");
+    err = server_error_to_wasi_nn(error);
+  } else {
+    auto *final_result = dynamic_cast<server_task_result_cmpl_final *>(result.get());
+    if (!final_result) {
+      WASI_NN_LOG_ERROR(chat_ctx, "Unexpected result type for task %d", id_task);
+      err = runtime_error;
+    } else {
+      if (on_piece && final_result->content.size() > n_streamed) {
+        // Flush text held back for a stop sequence that never completed
+        on_piece(final_result->content.substr(n_streamed));
+      }
+      response = final_result->content;
+      n_prompt_tokens = final_result->n_prompt_tokens;
+      n_prompt_prefilled = final_result->timings.prompt_n;
+      timings = final_result->timings;
+      truncated = final_result->truncated;
+      if (final_result->stop == STOP_TYPE_DEADLINE || final_result->stop == STOP_TYPE_CANCELLED) {
+        stop_status = final_result->stop == STOP_TYPE_DEADLINE ? timeout : cancelled;
+        WASI_NN_LOG_WARN(chat_ctx, "Session %d turn %s after %d tokens, returning partial output", exec_ctx,
+                         stop_status == timeout ? "passed its deadline" : "was cancelled", timings.predicted_n);
+      }
     }
   }
 
-  // Create new session with provided session ID
-  graph_execution_context new_exec_ctx = chat_ctx->next_exec_ctx_id++;
-  SessionInfo session_info;
-  session_info.session_id = session_id_str;  // Use the provided session ID
-  session_info.last_activity = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+  chat_ctx->sequence_available.notify_all();
 
-  chat_ctx->sessions[new_exec_ctx] = std::move(session_info);
+  auto session_it = chat_ctx->sessions.find(exec_ctx);
+  if (session_it == chat_ctx->sessions.end()) {
+    // Session was closed while generating; nothing to record
+    return err;
+  }
+  session_it->second.in_flight = false;
 
-  *exec_ctx = new_exec_ctx;
+  SessionInfo &session_info = session_it->second;
+  if (err != success) {
+    // Drop the unanswered user turn so the history stays well-formed
+    if (!session_info.history.empty() && session_info.history.role(session_info.history.size() - 1) == "user") {
+      pop_history_message(chat_ctx, session_info);
+    }
+    return err;
+  }
 
-  NN_INFO_PRINTF(
-      "Execution context %d initialized for session '%s'. Total sessions: %zu, Max sessions: %d",
-      new_exec_ctx, session_id, chat_ctx->sessions.size(), chat_ctx->max_sessions);
+  session_info.n_tokens_processed += std::max(0, n_prompt_prefilled) + std::max(0, timings.predicted_n);
+  if (n_prompt_tokens > 0) {
+    const int32_t n_reused = std::max(0, n_prompt_tokens - n_prompt_prefilled);
+    session_info.n_prompt_tokens_total += n_prompt_tokens;
+    session_info.n_prompt_tokens_reused += n_reused;
+    WASI_NN_LOG_DEBUG(chat_ctx, "Session %d prompt: %d tokens, %d reused from KV cache, %d prefilled",
+                      exec_ctx, n_prompt_tokens, n_reused, n_prompt_prefilled);
+  }
 
-  return success;
+  // The engine shifted the sequence while generating; re-map it next turn
+  if (truncated) {
+    session_info.shift_unknown = true;
+    chat_ctx->context_shifts++;
+    WASI_NN_LOG_DEBUG(chat_ctx, "Session %d context was shifted during generation", exec_ctx);
+  }
+
+  // The sequence now holds this prompt; offer it to other sessions
+  if (chat_ctx->enable_prefix_cache && session_info.seq_id >= 0 && !truncated) {
+    chat_ctx->prefix_cache.insert(session_info.seq_id, sent_tokens);
+  }
+
+  // Hand the token buffer back for the next turn
+  note_scratch_growth(chat_ctx, sent_tokens, sent_capacity);
+  session_info.scratch_tokens.swap(sent_tokens);
+
+  session_info.speculative.add(timings);
+  chat_ctx->speculative_stats.add(timings);
+  if (timings.draft_n > 0) {
+    WASI_NN_LOG_DEBUG(chat_ctx, "Session %d speculative: %d/%d draft tokens accepted (%.1f%%)",
+                      exec_ctx, timings.draft_n_accepted, timings.draft_n,
+                      100.0f * timings.draft_n_accepted / timings.draft_n);
+  }
+
+  // Add assistant response to chat history
+  append_history_message(chat_ctx, session_info.history, "assistant", response);
+  session_info.last_activity = std::chrono::steady_clock::now();
+
+  return stop_status;
 }
 
 __attribute__((visibility("default"))) wasi_nn_error
-close_execution_context(void *ctx, graph_execution_context exec_ctx)
+run_inference(void *ctx, graph_execution_context exec_ctx, uint32_t index,
+              tensor *input_tensor, tensor_data output_tensor,
+              uint32_t *output_tensor_size,
+              const char *runtime_config, uint32_t config_len)
 {
   LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
-  if (!chat_ctx)
+  if (!chat_ctx || !chat_ctx->server_ctx.ctx)
+  {
     return invalid_argument;
+  }
 
-  auto it = chat_ctx->sessions.find(exec_ctx);
-  if (it != chat_ctx->sessions.end())
+  // --- START FIX ---
+  // 1. Capture the provided capacity of the output buffer before it's used.
+  const uint32_t output_buffer_capacity = (output_tensor_size != nullptr) ? *output_tensor_size : 0;
+  // --- END FIX ---
+
+  char *prompt_text = (char *)input_tensor->data;
+  if (!prompt_text)
   {
-    NN_INFO_PRINTF("Closing execution context %d for session '%s'", exec_ctx,
-                   it->second.session_id.c_str());
+    return invalid_argument;
+  }
 
-    // Phase 4.3: Auto-clear KV cache for this session before closing
-    auto_clear_kv_cache_session(chat_ctx, exec_ctx);
+  try
+  {
+    // Parse runtime parameters if provided
+    wasi_nn_runtime_params runtime_params;
+    bool params_valid = true;
 
-    chat_ctx->sessions.erase(it);
+    if (runtime_config && config_len > 0) {
+      params_valid = parse_runtime_params(runtime_config, config_len, runtime_params, chat_ctx);
+      if (!params_valid) {
+        WASI_NN_LOG_ERROR(chat_ctx, "Failed to parse runtime configuration, using defaults");
+        // Continue with default parameters rather than failing
+      } else {
+        WASI_NN_LOG_INFO(chat_ctx, "Runtime configuration applied successfully");
+      }
+    }
+    const bool use_runtime_params = params_valid && (runtime_config && config_len > 0);
 
-    // Phase 4.3: Check if we should do global memory optimization after session close
-    if (chat_ctx->sessions.empty()) {
-      // All sessions closed, good time for global cleanup
-      auto_clear_all_kv_cache(chat_ctx);
+    // Phase 6.3: while task processors run, the turn waits its turn in the task queue
+    if (!chat_ctx->task_processor_threads.empty()) {
+      wasi_nn_task task;
+      task.exec_ctx = exec_ctx;
+      task.prompt = prompt_text;
+      {
+        std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+        auto session_it = chat_ctx->sessions.find(exec_ctx);
+        if (session_it == chat_ctx->sessions.end()) {
+          return missing_session_error(chat_ctx, exec_ctx);
+        }
+        task.priority = session_it->second.priority;
+        task.flow = session_it->second.tenant;
+        session_it->second.cancel_requested->store(false);
+      }
+      if (use_runtime_params) {
+        if (runtime_params.priority >= 0) {
+          task.priority = (wasi_nn_task_priority)runtime_params.priority;
+        }
+        if (runtime_params.tenant_set) {
+          task.flow = runtime_params.tenant;
+        }
+        task.runtime_params = std::make_shared<wasi_nn_runtime_params>(std::move(runtime_params));
+      }
+
+      std::shared_ptr<wasi_nn_task_handle> handle;
+      wasi_nn_error submit_result = submit_task(chat_ctx, std::move(task), handle);
+      if (submit_result != success) {
+        return submit_result;
+      }
+      {
+        std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+        auto session_it = chat_ctx->sessions.find(exec_ctx);
+        if (session_it != chat_ctx->sessions.end()) {
+          session_it->second.queued_task = handle;
+        }
+      }
+
+      const wasi_nn_task_result &task_result = wait_for_task(chat_ctx, *handle);
+      if (!has_turn_output(task_result.status)) {
+        return task_result.status;
+      }
+      copy_string_to_tensor_data(output_tensor, output_buffer_capacity, task_result.output);
+      *output_tensor_size = task_result.output.length();
+      return task_result.status;
     }
 
-    return success;
-  }
+    // Run inference on the continuous batching engine; the reply buffer is
+    // reused by this thread's next request
+    static thread_local std::string response_scratch;
+    std::string &response = response_scratch;
+    response.clear();
+    const size_t response_capacity = response.capacity();
+    const int64_t t_deadline_us = use_runtime_params && runtime_params.deadline_ms > 0
+        ? ggml_time_us() + (int64_t)runtime_params.deadline_ms * 1000 : 0;
+    reset_cancel_request(chat_ctx, exec_ctx);
+    wasi_nn_error result = run_inference_for_session_with_params(
+        chat_ctx, exec_ctx, prompt_text, use_runtime_params ? &runtime_params : nullptr, response,
+        nullptr, t_deadline_us);
+    note_scratch_growth(chat_ctx, response, response_capacity);
+    if (!has_turn_output(result)) {
+      return result;
+    }
 
-  return invalid_argument;
+    // --- START FIX ---
+    // 2. Use the captured buffer capacity for a safe copy. This prevents writing past
+    //    the end of the buffer if the response is larger than the allocated space.
+    copy_string_to_tensor_data(output_tensor, output_buffer_capacity, response);
+
+    // 3. Report back the actual number of characters in the response string.
+    //    If the response was truncated, the caller can detect it by comparing
+    //    this value with the original buffer capacity.
+    *output_tensor_size = response.length();
+    // --- END FIX ---
+
+    WASI_NN_LOG_DEBUG(chat_ctx, "Generated response: %s", response.c_str());
+    return result;
+  }
+  catch (const std::exception &e)
+  {
+    WASI_NN_LOG_ERROR(chat_ctx, "Inference failed: %s", e.what());
+    return runtime_error;
+  }
 }
 
-// Helper function to run inference loop (extracted from main.cpp)
-static std::string run_inference_for_session(LlamaChatContext *chat_ctx,
-                                             graph_execution_context exec_ctx,
-                                             const std::string &user_input)
+__attribute__((visibility("default"))) wasi_nn_error
+run_inference_stream(void *ctx, graph_execution_context exec_ctx, uint32_t index,
+                     tensor *input_tensor, const char *runtime_config, uint32_t config_len,
+                     wasi_nn_stream_callback callback, void *user_data)
 {
-  // Find session
-  auto session_it = chat_ctx->sessions.find(exec_ctx);
-  if (session_it == chat_ctx->sessions.end())
+  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
+  if (!chat_ctx || !chat_ctx->server_ctx.ctx || !input_tensor || !callback)
   {
-    return "Error: Invalid session";
+    return invalid_argument;
   }
 
-  SessionInfo &session_info = session_it->second;
-  auto &chat_msgs = session_info.chat_history;
-
-  // Update last activity
-  session_info.last_activity = std::chrono::steady_clock::now();
+  char *prompt_text = (char *)input_tensor->data;
+  if (!prompt_text)
+  {
+    return invalid_argument;
+  }
 
-  // Chat formatting function (from main.cpp)
-  auto chat_add_and_format = [&](const std::string &role,
-                                 const std::string &content)
+  try
   {
-    common_chat_msg new_msg;
-    new_msg.role = role;
-    new_msg.content = content;
+    // Parse runtime parameters if provided
+    wasi_nn_runtime_params runtime_params;
+    bool params_valid = true;
+
+    if (runtime_config && config_len > 0) {
+      params_valid = parse_runtime_params(runtime_config, config_len, runtime_params, chat_ctx);
+      if (!params_valid) {
+        WASI_NN_LOG_ERROR(chat_ctx, "Failed to parse runtime configuration, using defaults");
+      }
+    }
 
-    // Check if chat templates are available
-    if (!chat_ctx->server_ctx.chat_templates.get()) {
-      NN_ERR_PRINTF("Chat templates not initialized");
-      return std::string("Error: Chat templates not available");
+    auto on_piece = [callback, user_data](const std::string &piece) {
+      return callback(piece.data(), (uint32_t)piece.size(), user_data);
+    };
+
+    static thread_local std::string response_scratch;
+    std::string &response = response_scratch;
+    response.clear();
+    const size_t response_capacity = response.capacity();
+    const bool use_runtime_params = params_valid && (runtime_config && config_len > 0);
+    const int64_t t_deadline_us = use_runtime_params && runtime_params.deadline_ms > 0
+        ? ggml_time_us() + (int64_t)runtime_params.deadline_ms * 1000 : 0;
+    reset_cancel_request(chat_ctx, exec_ctx);
+    wasi_nn_error result = run_inference_for_session_with_params(
+        chat_ctx, exec_ctx, prompt_text, use_runtime_params ? &runtime_params : nullptr,
+        response, on_piece, t_deadline_us);
+    note_scratch_growth(chat_ctx, response, response_capacity);
+    if (result != success) {
+      return result;
     }
 
-    auto formatted = common_chat_format_single(
-        chat_ctx->server_ctx.chat_templates.get(), chat_msgs, new_msg, role == "user",
-        false // use_jinja
-    );
+    WASI_NN_LOG_DEBUG(chat_ctx, "Streamed response (%zu bytes): %s", response.size(), response.c_str());
+    return success;
+  }
+  catch (const std::exception &e)
+  {
+    WASI_NN_LOG_ERROR(chat_ctx, "Streaming inference failed: %s", e.what());
+    return runtime_error;
+  }
+}
 
-    chat_msgs.push_back(new_msg);
-    NN_DBG_PRINTF("Formatted message: '%s'", formatted.c_str());
-    return formatted;
-  };
+// Run several independent single-turn prompts in one call. All items are posted
+// to the engine together, so their prefills share one multi-sequence llama_batch
+// and their generations advance in lockstep. Items are not added to any session
+// history; exec_ctx only identifies the calling session.
+__attribute__((visibility("default"))) wasi_nn_error
+run_inference_batch(void *ctx, graph_execution_context exec_ctx, uint32_t batch_size,
+                    tensor *input_tensors, tensor_data *output_tensors, uint32_t *output_tensor_sizes,
+                    const char **runtime_configs, const uint32_t *config_lens)
+{
+  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
+  if (!chat_ctx || !chat_ctx->server_ctx.ctx || !input_tensors || !output_tensors ||
+      !output_tensor_sizes || batch_size == 0)
+  {
+    return invalid_argument;
+  }
+
+  auto &server_ctx = chat_ctx->server_ctx;
+  if (!server_ctx.chat_templates.get() || !chat_ctx->engine_running.load()) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Inference engine is not ready for batched inference");
+    return runtime_error;
+  }
 
-  // Add user message and get formatted prompt
-  std::string prompt = chat_add_and_format("user", user_input);
+  try
+  {
+    std::vector<server_task> tasks;
+    tasks.reserve(batch_size);
+    {
+      std::unique_lock<std::mutex> lock(chat_ctx->sessions_mutex);
+
+      auto session_it = chat_ctx->sessions.find(exec_ctx);
+      if (session_it == chat_ctx->sessions.end()) {
+        WASI_NN_LOG_ERROR(chat_ctx, "Invalid execution context %d", exec_ctx);
+        return missing_session_error(chat_ctx, exec_ctx);
+      }
+      session_it->second.last_activity = std::chrono::steady_clock::now();
+
+      // Items run only on sequences no session is bound to, so session caches
+      // are never overwritten behind their back. Unbound ones come first; one
+      // idle session is evicted when there are none.
+      std::vector<llama_seq_id> free_slots;
+      const llama_seq_id first_seq = claim_unbound_sequence(chat_ctx, lock, free_slots, true);
+      if (first_seq < 0) {
+        WASI_NN_LOG_ERROR(chat_ctx, "No KV sequence available for batched inference");
+        return runtime_error;
+      }
+      free_slots.push_back(first_seq);
+      while (free_slots.size() < batch_size) {
+        const llama_seq_id seq_id = claim_unbound_sequence(chat_ctx, lock, free_slots, false);
+        if (seq_id < 0) {
+          break;
+        }
+        free_slots.push_back(seq_id);
+      }
 
-  NN_DBG_PRINTF("Processing prompt for session %d: %s", exec_ctx,
-                prompt.c_str());
+      for (uint32_t i = 0; i < batch_size; ++i) {
+        const char *prompt_text = (const char *)input_tensors[i].data;
+        if (!prompt_text) {
+          WASI_NN_LOG_ERROR(chat_ctx, "Batch item %u has no input", i);
+          return invalid_argument;
+        }
 
-  // Clear KV cache for session isolation (as per user's requirement)
-  llama_memory_clear(llama_get_memory(chat_ctx->server_ctx.ctx), true);
+        wasi_nn_runtime_params runtime_params;
+        bool has_params = false;
+        if (runtime_configs && config_lens && runtime_configs[i] && config_lens[i] > 0) {
+          has_params = parse_runtime_params(runtime_configs[i], config_lens[i], runtime_params, chat_ctx);
+          if (!has_params) {
+            WASI_NN_LOG_ERROR(chat_ctx, "Failed to parse runtime configuration for batch item %u, using defaults", i);
+          }
+        }
 
-  // Tokenize the complete conversation history
-  common_chat_templates_inputs inputs;
-  inputs.messages = chat_msgs;
-  inputs.add_generation_prompt = true;
+        common_chat_msg user_msg;
+        user_msg.role = "user";
+        user_msg.content = prompt_text;
 
-  // Check if chat templates are available before using them
-  if (!chat_ctx->server_ctx.chat_templates.get()) {
-    NN_ERR_PRINTF("Chat templates not initialized for prompt generation");
-    return "Error: Chat templates not available";
-  }
+        common_chat_templates_inputs inputs;
+        inputs.messages = {user_msg};
+        inputs.add_generation_prompt = true;
 
-  std::string full_prompt =
-      common_chat_templates_apply(chat_ctx->server_ctx.chat_templates.get(), inputs)
-          .prompt;
+        std::string prompt = common_chat_templates_apply(server_ctx.chat_templates.get(), inputs).prompt;
+        llama_tokens prompt_tokens = common_tokenize(server_ctx.ctx, prompt, true, true);
 
-  // Tokenize
-  std::vector<llama_token> tokens =
-      common_tokenize(chat_ctx->server_ctx.ctx, full_prompt, true, true);
+        server_task task(SERVER_TASK_TYPE_COMPLETION);
+        task.id = server_ctx.queue_tasks.get_new_id();
+        task.index = (int)i;
+        task.prompt_tokens = server_tokens(prompt_tokens);
+        task.params = build_slot_params(chat_ctx, has_params ? &runtime_params : nullptr);
+        task.id_selected_slot = free_slots[i % free_slots.size()];
+        tasks.push_back(std::move(task));
+      }
+    }
 
-  // Generate response (simplified version of main.cpp's loop)
-  std::string response;
+    std::unordered_map<int, uint32_t> task_index;
+    std::unordered_set<int> id_tasks;
+    for (const auto &task : tasks) {
+      task_index[task.id] = (uint32_t)task.index;
+      id_tasks.insert(task.id);
+    }
 
-  // Process input tokens
-  llama_batch batch = llama_batch_get_one(tokens.data(), tokens.size());
+    WASI_NN_LOG_INFO(chat_ctx, "Running batched inference: %u prompts", batch_size);
 
-  if (llama_decode(chat_ctx->server_ctx.ctx, batch))
-  {
-    NN_ERR_PRINTF("Failed to decode input tokens");
-    return "Error: Failed to process input";
-  }
+    server_ctx.queue_results.add_waiting_tasks(tasks);
+    server_ctx.queue_tasks.post(std::move(tasks));
 
-  // Generate tokens one by one
-  for (int i = 0; i < chat_ctx->server_ctx.params_base.n_predict; ++i)
-  {
-    // Verify that slots[0] and its sampler are valid
-    if (chat_ctx->server_ctx.slots.empty() || chat_ctx->server_ctx.slots[0].smpl == nullptr) {
-      NN_ERR_PRINTF("Invalid slot or sampler state");
-      return "Error: Invalid sampler state";
-    }
+    std::vector<std::string> responses(batch_size);
+    wasi_nn_error err = success;
+    size_t n_finished = 0;
+    while (n_finished < id_tasks.size()) {
+      server_task_result_ptr result = server_ctx.queue_results.recv(id_tasks);
+      if (!result) {
+        WASI_NN_LOG_ERROR(chat_ctx, "Inference engine stopped during batched inference");
+        err = runtime_error;
+        break;
+      }
 
-    llama_token new_token =
-        common_sampler_sample(chat_ctx->server_ctx.slots[0].smpl, chat_ctx->server_ctx.ctx, -1);
+      n_finished++;
+      const uint32_t i = task_index[result->id];
+      if (result->is_error()) {
+        auto *error = dynamic_cast<server_task_result_error *>(result.get());
+        WASI_NN_LOG_ERROR(chat_ctx, "Batch item %u failed: %s", i,
+                          error ? error->err_msg.c_str() : "unknown error");
+        if (err == success) {
+          err = server_error_to_wasi_nn(error);
+        }
+        continue;
+      }
 
-    if (llama_vocab_is_eog(chat_ctx->server_ctx.vocab, new_token))
-    {
-      break;
+      auto *final_result = dynamic_cast<server_task_result_cmpl_final *>(result.get());
+      if (final_result) {
+        responses[i] = final_result->content;
+        std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+        chat_ctx->speculative_stats.add(final_result->timings);
+      }
     }
+    server_ctx.queue_results.remove_waiting_task_ids(id_tasks);
 
-    // Convert token to text
-    char buf[256];
-    int n = llama_token_to_piece(chat_ctx->server_ctx.vocab, new_token, buf, sizeof(buf),
-                                 0, true);
-    if (n > 0)
-    {
-      response.append(buf, n);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      const uint32_t capacity = output_tensor_sizes[i];
+      copy_string_to_tensor_data(output_tensors[i], capacity, responses[i]);
+      output_tensor_sizes[i] = responses[i].length();
     }
 
-    // Prepare next batch
-    batch = llama_batch_get_one(&new_token, 1);
-    if (llama_decode(chat_ctx->server_ctx.ctx, batch))
-    {
-      NN_ERR_PRINTF("Failed to decode generated token");
-      break;
-    }
+    return err;
   }
-
-  // Add assistant response to chat history
-  chat_add_and_format("assistant", response);
-
-  return response;
-}
-
-// Enhanced helper function to run inference with runtime parameter support
-static std::string run_inference_for_session_with_params(LlamaChatContext *chat_ctx,
-                                                        graph_execution_context exec_ctx,
-                                                        const std::string &user_input,
-                                                        const wasi_nn_runtime_params *runtime_params = nullptr)
-{
-  // Find session
-  auto session_it = chat_ctx->sessions.find(exec_ctx);
-  if (session_it == chat_ctx->sessions.end())
+  catch (const std::exception &e)
   {
-    return "Error: Invalid session";
+    WASI_NN_LOG_ERROR(chat_ctx, "Batched inference failed: %s", e.what());
+    return runtime_error;
   }
+}
 
-  SessionInfo &session_info = session_it->second;
-  auto &chat_msgs = session_info.chat_history;
-
-  // Update last activity
-  session_info.last_activity = std::chrono::steady_clock::now();
-
-  // Determine max_tokens for this generation
-  int max_tokens = chat_ctx->server_ctx.params_base.n_predict;
-  if (runtime_params && runtime_params->max_tokens > 0) {
-    max_tokens = runtime_params->max_tokens;
-    WASI_NN_LOG_DEBUG(chat_ctx, "Using runtime max_tokens: %d", max_tokens);
+__attribute__((visibility("default"))) wasi_nn_error
+get_speculative_stats(void *ctx, graph_execution_context exec_ctx,
+                      wasi_nn_speculative_stats *stats)
+{
+  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
+  if (!chat_ctx || !stats) {
+    return invalid_argument;
   }
 
-  // Store original sampling parameters for restoration
-  common_params original_params = chat_ctx->server_ctx.params_base;
-
-  // Chat formatting function (from main.cpp)
-  auto chat_add_and_format = [&](const std::string &role,
-                                 const std::string &content)
+  SpeculativeStats counters;
   {
-    common_chat_msg new_msg;
-    new_msg.role = role;
-    new_msg.content = content;
-
-    // Check if chat templates are available
-    if (!chat_ctx->server_ctx.chat_templates.get()) {
-      NN_ERR_PRINTF("Chat templates not initialized");
-      return std::string("Error: Chat templates not available");
+    std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+    if (exec_ctx == 0) {
+      counters = chat_ctx->speculative_stats;
+    } else {
+      auto session_it = chat_ctx->sessions.find(exec_ctx);
+      if (session_it == chat_ctx->sessions.end()) {
+        WASI_NN_LOG_ERROR(chat_ctx, "Invalid execution context %d", exec_ctx);
+        return missing_session_error(chat_ctx, exec_ctx);
+      }
+      counters = session_it->second.speculative;
     }
-
-    auto formatted = common_chat_format_single(
-        chat_ctx->server_ctx.chat_templates.get(), chat_msgs, new_msg, role == "user",
-        false // use_jinja
-    );
-
-    chat_msgs.push_back(new_msg);
-    return formatted;
-  };
-
-  // Add user message and get formatted prompt
-  std::string prompt = chat_add_and_format("user", user_input);
-
-  WASI_NN_LOG_DEBUG(chat_ctx, "Processing prompt for session %d: %s", exec_ctx, prompt.c_str());
-
-  // Only clear KV cache if this is a new session (empty chat history)
-  // This preserves conversation context for ongoing sessions
-  if (chat_msgs.size() <= 1) {  // Only user message just added
-    WASI_NN_LOG_DEBUG(chat_ctx, "New session detected, clearing KV cache for session %d", exec_ctx);
-    llama_memory_clear(llama_get_memory(chat_ctx->server_ctx.ctx), true);
-  } else {
-    WASI_NN_LOG_DEBUG(chat_ctx, "Continuing session %d with %zu messages, preserving KV cache",
-                       exec_ctx, chat_msgs.size());
   }
 
-  // Tokenize the complete conversation history
-  common_chat_templates_inputs inputs;
-  inputs.messages = chat_msgs;
-  inputs.add_generation_prompt = true;
-
-  // Check if chat templates are available before using them
-  if (!chat_ctx->server_ctx.chat_templates.get()) {
-    NN_ERR_PRINTF("Chat templates not initialized for prompt generation");
-    return "Error: Chat templates not available";
+  *stats = {};
+  stats->enabled = chat_ctx->server_ctx.model_dft != nullptr;
+  stats->n_draft_tokens = counters.n_draft_tokens;
+  stats->n_draft_accepted = counters.n_draft_accepted;
+  stats->n_generated_tokens = counters.n_generated_tokens;
+  if (counters.n_draft_tokens > 0) {
+    stats->acceptance_rate = (double)counters.n_draft_accepted / counters.n_draft_tokens;
   }
 
-  std::string full_prompt =
-      common_chat_templates_apply(chat_ctx->server_ctx.chat_templates.get(), inputs)
-          .prompt;
-
-  // Tokenize
-  std::vector<llama_token> tokens =
-      common_tokenize(chat_ctx->server_ctx.ctx, full_prompt, true, true);
-
-  // Apply runtime parameters to sampler if provided
-  if (runtime_params && !chat_ctx->server_ctx.slots.empty() && chat_ctx->server_ctx.slots[0].smpl) {
-    apply_runtime_params_to_sampling(chat_ctx->server_ctx.slots[0].smpl, *runtime_params,
-                                    chat_ctx->server_ctx.model, chat_ctx);
+  // Every accepted draft token is a target-model decode step that did not happen
+  if (counters.n_generated_tokens > counters.n_draft_accepted) {
+    stats->speedup = (double)counters.n_generated_tokens /
+                     (counters.n_generated_tokens - counters.n_draft_accepted);
+  } else {
+    stats->speedup = 1.0;
   }
 
-  // Apply stop sequences if provided
-  std::vector<std::string> original_antiprompt;
-  if (runtime_params && runtime_params->stop_sequences_set) {
-    // Temporarily replace antiprompt with runtime stop sequences
-    original_antiprompt = chat_ctx->server_ctx.params_base.antiprompt;
-    chat_ctx->server_ctx.params_base.antiprompt = runtime_params->stop_sequences;
-    WASI_NN_LOG_DEBUG(chat_ctx, "Applied %zu runtime stop sequences", runtime_params->stop_sequences.size());
+  if (counters.generation_ms > 0.0) {
+    stats->tokens_per_second = 1000.0 * counters.n_generated_tokens / counters.generation_ms;
   }
 
-  // Generate response (simplified version of main.cpp's loop)
-  std::string response;
-
-  // Process input tokens in batches
-  const int n_batch = chat_ctx->server_ctx.params_base.n_batch;  // Or wherever n_batch is stored
-  size_t n_tokens_processed = 0;
-  while (n_tokens_processed < tokens.size()) {
-      size_t n_tokens_batch = std::min(static_cast<size_t>(n_batch), tokens.size() - n_tokens_processed);
-
-      llama_batch batch = llama_batch_get_one(tokens.data() + n_tokens_processed, n_tokens_batch);
+  return success;
+}
 
-      if (llama_decode(chat_ctx->server_ctx.ctx, batch)) {
-          NN_ERR_PRINTF("Failed to decode input tokens batch");
-          return "Error: Failed to process input";
-      }
+__attribute__((visibility("default"))) wasi_nn_error
+get_backend_stats(void *ctx, graph_execution_context exec_ctx,
+                  wasi_nn_backend_stats *stats)
+{
+  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
+  if (!chat_ctx || !stats) {
+    return invalid_argument;
+  }
 
-      n_tokens_processed += n_tokens_batch;
+  // An engine round trip publishes the sequence lengths as of this call
+  if (chat_ctx->server_ctx.ctx) {
+    run_on_engine_thread(chat_ctx, []() {});
   }
 
-  // Generate tokens one by one with runtime parameter support
-  for (int i = 0; i < max_tokens; ++i)
+  *stats = {};
+  const KvAccounting &kv = chat_ctx->kv_accounting;
   {
-    // Verify that slots[0] and its sampler are valid
-    if (chat_ctx->server_ctx.slots.empty() || chat_ctx->server_ctx.slots[0].smpl == nullptr) {
-      NN_ERR_PRINTF("Invalid slot or sampler state");
-      return "Error: Invalid sampler state";
-    }
-
-    llama_token new_token =
-        common_sampler_sample(chat_ctx->server_ctx.slots[0].smpl, chat_ctx->server_ctx.ctx, -1);
-
-    // Check for EOS token (with runtime ignore_eos support)
-    bool should_stop_eos = llama_vocab_is_eog(chat_ctx->server_ctx.vocab, new_token);
-    if (runtime_params && runtime_params->ignore_eos_set) {
-      should_stop_eos = should_stop_eos && !runtime_params->ignore_eos;
-    }
-
-    if (should_stop_eos) {
-    //   WASI_NN_LOG_DEBUG(chat_ctx, "Generation stopped at EOS token");
-      break;
-    }
-
-    // Convert token to text
-    char buf[256];
-    int n = llama_token_to_piece(chat_ctx->server_ctx.vocab, new_token, buf, sizeof(buf),
-                                 0, true);
-    if (n > 0)
-    {
-      response.append(buf, n);
-    }
-
-    // Check for stop sequences if provided
-    if (runtime_params && runtime_params->stop_sequences_set) {
-      for (const auto& stop_seq : runtime_params->stop_sequences) {
-        if (response.find(stop_seq) != std::string::npos) {
-          WASI_NN_LOG_DEBUG(chat_ctx, "Generation stopped by stop sequence: %s", stop_seq.c_str());
-          // Remove the stop sequence from the response
-          size_t pos = response.find(stop_seq);
-          if (pos != std::string::npos) {
-            response = response.substr(0, pos);
-          }
-          goto generation_complete;
-        }
+    std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+    for (const auto &pair : chat_ctx->sessions) {
+      stats->n_sessions++;
+      if (pair.second.seq_id >= 0) {
+        stats->n_sessions_bound++;
+      }
+      if (pair.second.kv_tier == KV_TIER_RAM) {
+        stats->n_sessions_kv_ram++;
+      } else if (pair.second.kv_tier == KV_TIER_DISK) {
+        stats->n_sessions_kv_disk++;
+      }
+      if (exec_ctx == 0) {
+        stats->n_prompt_tokens += pair.second.n_prompt_tokens_total;
+        stats->n_prompt_tokens_reused += pair.second.n_prompt_tokens_reused;
       }
     }
+    stats->kv_offload_ram_bytes = kv_offload_ram_bytes(chat_ctx);
 
-    // Prepare next batch
-    llama_batch batch = llama_batch_get_one(&new_token, 1);
-    if (llama_decode(chat_ctx->server_ctx.ctx, batch))
-    {
-      NN_ERR_PRINTF("Failed to decode generated token");
-      break;
+    if (exec_ctx == 0) {
+      stats->kv_tokens_spanned = kv.spanned_tokens();
+    } else {
+      auto session_it = chat_ctx->sessions.find(exec_ctx);
+      if (session_it == chat_ctx->sessions.end()) {
+        WASI_NN_LOG_ERROR(chat_ctx, "Invalid execution context %d", exec_ctx);
+        return missing_session_error(chat_ctx, exec_ctx);
+      }
+      stats->kv_tokens_spanned = kv.sequence_tokens(session_it->second.seq_id);
+      stats->n_prompt_tokens = session_it->second.n_prompt_tokens_total;
+      stats->n_prompt_tokens_reused = session_it->second.n_prompt_tokens_reused;
     }
   }
 
-generation_complete:
-  // Restore original antiprompt if we modified it
-  if (runtime_params && runtime_params->stop_sequences_set) {
-    chat_ctx->server_ctx.params_base.antiprompt = original_antiprompt;
+  stats->n_slots = (uint32_t)chat_ctx->server_ctx.slots.size();
+  stats->kv_cells_total = kv.capacity();
+  stats->kv_bytes_per_token = kv.token_bytes();
+  stats->kv_bytes_spanned = stats->kv_tokens_spanned * stats->kv_bytes_per_token;
+  stats->kv_bytes_total = (uint64_t)stats->kv_cells_total * stats->kv_bytes_per_token;
+  if (stats->kv_cells_total > 0) {
+    stats->kv_usage = (double)stats->kv_tokens_spanned / stats->kv_cells_total;
+  }
+
+  stats->prefix_cache_hits = chat_ctx->prefix_cache_hits.load();
+  stats->prefix_cache_misses = chat_ctx->prefix_cache_misses.load();
+  stats->prefix_cache_tokens_shared = chat_ctx->prefix_cache_tokens_shared.load();
+
+  // The governor keeps these current; sample here only when it is disabled
+  if (chat_ctx->memory_sample_interval_ms == 0) {
+    chat_ctx->current_memory_usage.store(get_current_memory_usage());
+  }
+  stats->memory_usage_bytes = chat_ctx->current_memory_usage.load();
+  stats->memory_limit_bytes = chat_ctx->memory_limit_bytes.load();
+  stats->memory_pressure_level = (uint32_t)chat_ctx->memory_pressure_level.load();
+  stats->kv_offload_restores = chat_ctx->kv_offload_restores.load();
+  stats->model_shared_refs = (uint32_t)chat_ctx->server_ctx.model_shared.use_count();
+  stats->admission_waits = chat_ctx->admission_waits.load();
+  stats->admission_evictions = chat_ctx->admission_evictions.load();
+  stats->admission_rejections = chat_ctx->admission_rejections.load();
+  stats->kv_fragmentation = kv.fragmentation();
+  stats->kv_compactions = chat_ctx->kv_compactions.load();
+  stats->kv_fragmentation_before_compaction = chat_ctx->kv_fragmentation_before.load();
+  stats->kv_fragmentation_after_compaction = chat_ctx->kv_fragmentation_after.load();
+  stats->kv_compaction_ms = chat_ctx->kv_compaction_ms.load();
+  stats->context_shifts = chat_ctx->context_shifts.load();
+  if (chat_ctx->task_queue) {
+    uint32_t queued = 0, active = 0, capacity = 0;
+    chat_ctx->task_queue->get_queue_status(queued, active, capacity);
+    stats->tasks_pending = queued;
+    stats->tasks_active = active;
+    stats->tasks_completed = chat_ctx->task_queue->tasks_completed;
+    stats->tasks_timed_out = chat_ctx->task_queue->tasks_timeout;
+    stats->tasks_cancelled = chat_ctx->task_queue->tasks_cancelled;
+    stats->tasks_rejected = chat_ctx->task_queue->tasks_rejected;
   }
+  stats->tasks_preempted = chat_ctx->server_ctx.n_preemptions.load();
 
-  // Add assistant response to chat history
-  chat_add_and_format("assistant", response);
+  stats->arena_requests = chat_ctx->arena_requests.load();
+  stats->arena_heap_allocs = chat_ctx->arena_heap_allocs.load();
+  stats->arena_peak_bytes = chat_ctx->arena_peak_bytes.load();
+  stats->scratch_reallocs = chat_ctx->scratch_reallocs.load();
 
-  return response;
+  return success;
 }
 
 __attribute__((visibility("default"))) wasi_nn_error
-run_inference(void *ctx, graph_execution_context exec_ctx, uint32_t index,
-              tensor *input_tensor, tensor_data output_tensor,
-              uint32_t *output_tensor_size,
-              const char *runtime_config, uint32_t config_len)
+save_session_state(void *ctx, graph_execution_context exec_ctx)
 {
   LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
-  if (!chat_ctx || !chat_ctx->server_ctx.ctx)
-  {
+  if (!chat_ctx || !chat_ctx->server_ctx.model) {
     return invalid_argument;
   }
 
-  // --- START FIX ---
-  // 1. Capture the provided capacity of the output buffer before it's used.
-  const uint32_t output_buffer_capacity = (output_tensor_size != nullptr) ? *output_tensor_size : 0;
-  // --- END FIX ---
-
-  char *prompt_text = (char *)input_tensor->data;
-  if (!prompt_text)
-  {
-    return invalid_argument;
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+  auto session_it = chat_ctx->sessions.find(exec_ctx);
+  if (session_it == chat_ctx->sessions.end()) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Invalid execution context %d", exec_ctx);
+    return missing_session_error(chat_ctx, exec_ctx);
+  }
+  if (session_it->second.in_flight) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Cannot save session %d while it is generating", exec_ctx);
+    return runtime_error;
   }
 
-  try
-  {
-    // Parse runtime parameters if provided
-    wasi_nn_runtime_params runtime_params;
-    bool params_valid = true;
-
-    if (runtime_config && config_len > 0) {
-      params_valid = parse_runtime_params(runtime_config, config_len, runtime_params, chat_ctx);
-      if (!params_valid) {
-        WASI_NN_LOG_ERROR(chat_ctx, "Failed to parse runtime configuration, using defaults");
-        // Continue with default parameters rather than failing
-      } else {
-        WASI_NN_LOG_INFO(chat_ctx, "Runtime configuration applied successfully");
-      }
-    }
-
-    // Run inference with enhanced function
-    std::string response = run_inference_for_session_with_params(
-        chat_ctx, exec_ctx, prompt_text,
-        (params_valid && (runtime_config && config_len > 0)) ? &runtime_params : nullptr);
-
-    // --- START FIX ---
-    // 2. Use the captured buffer capacity for a safe copy. This prevents writing past
-    //    the end of the buffer if the response is larger than the allocated space.
-    copy_string_to_tensor_data(output_tensor, output_buffer_capacity, response);
+  return save_session_to_disk(chat_ctx, session_it->second);
+}
 
-    // 3. Report back the actual number of characters in the response string.
-    //    If the response was truncated, the caller can detect it by comparing
-    //    this value with the original buffer capacity.
-    *output_tensor_size = response.length();
-    // --- END FIX ---
+__attribute__((visibility("default"))) wasi_nn_error
+restore_session_state(void *ctx, graph_execution_context exec_ctx)
+{
+  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
+  if (!chat_ctx || !chat_ctx->server_ctx.model) {
+    return invalid_argument;
+  }
 
-    WASI_NN_LOG_DEBUG(chat_ctx, "Generated response: %s", response.c_str());
-    return success;
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+  auto session_it = chat_ctx->sessions.find(exec_ctx);
+  if (session_it == chat_ctx->sessions.end()) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Invalid execution context %d", exec_ctx);
+    return missing_session_error(chat_ctx, exec_ctx);
   }
-  catch (const std::exception &e)
-  {
-    WASI_NN_LOG_ERROR(chat_ctx, "Inference failed: %s", e.what());
+  SessionInfo &session_info = session_it->second;
+  const bool compute_pending = session_info.pending_task &&
+      session_info.pending_task->future.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+  if (session_info.in_flight || compute_pending) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Cannot restore session %d while it has work in progress", exec_ctx);
     return runtime_error;
   }
+
+  wasi_nn_error result = restore_session_from_disk(chat_ctx, session_info);
+  if (result == not_found) {
+    WASI_NN_LOG_WARN(chat_ctx, "No saved state for session '%s' under model version %s",
+                     session_info.session_id.c_str(), chat_ctx->current_model_version.c_str());
+  }
+  return result;
 }
 
 // Placeholder implementations for compatibility
@@ -2965,6 +7161,138 @@ load_by_name(void *ctx, const char *filename, uint32_t filename_len, graph *g)
   return load_by_name_with_config(ctx, filename, filename_len, nullptr, 0, g);
 }
 
+// ==============================================================================
+// Phase 6.3: Asynchronous set_input / compute / get_output
+// ==============================================================================
+// compute() turns the staged input into a wasi_nn_task and returns at once; the
+// task processor threads run it on the batching engine and fulfil the task's
+// promise, which get_output() waits on. run_inference() submits the same kind of
+// task and waits for it, so both paths share the queue's priority order, its
+// reject threshold and the default task timeout.
+
+// Run one queued task to completion and publish its result
+static void execute_task(LlamaChatContext *chat_ctx, wasi_nn_task &task)
+{
+  wasi_nn_task_result result;
+
+  // Phase 6.16: a turn with its own deadline stops decoding once the caller gave up on it
+  const int64_t t_deadline_us = task.runtime_params && task.runtime_params->deadline_ms > 0
+      ? engine_deadline_us(task.timeout_at) : 0;
+
+  try {
+    result.status = run_inference_for_session_with_params(chat_ctx, task.exec_ctx, task.prompt,
+                                                          task.runtime_params.get(), result.output,
+                                                          nullptr, t_deadline_us);
+  } catch (const std::exception &e) {
+    WASI_NN_LOG_ERROR(chat_ctx, "Task %d failed: %s", task.id, e.what());
+    result.status = runtime_error;
+  }
+
+  if (task.handle) {
+    task.handle->promise.set_value(std::move(result));
+  }
+}
+
+// Queue a turn for the task processors. A task still waiting after its
+// deadline (deadline_ms, else the default task timeout) completes with
+// `timeout`; once started it runs to the end unless deadline_ms was given.
+static wasi_nn_error submit_task(LlamaChatContext *chat_ctx, wasi_nn_task &&task,
+                                 std::shared_ptr<wasi_nn_task_handle> &handle)
+{
+  task.timeout_ms = task.runtime_params && task.runtime_params->deadline_ms > 0
+      ? task.runtime_params->deadline_ms : chat_ctx->default_task_timeout_ms;
+  task.timeout_at = task.created_at + std::chrono::milliseconds(task.timeout_ms);
+  task.handle = std::make_shared<wasi_nn_task_handle>();
+  task.handle->timeout_at = task.timeout_at;
+
+  // Phase 6.15: turns of one tenant share a flow, other sessions get their own
+  if (task.flow.empty()) {
+    task.flow = "session:" + std::to_string(task.exec_ctx);
+  } else {
+    auto weight_it = chat_ctx->tenant_weights.find(task.flow);
+    if (weight_it != chat_ctx->tenant_weights.end()) {
+      task.weight = weight_it->second;
+    }
+    task.flow = "tenant:" + task.flow;
+  }
+
+  std::shared_ptr<wasi_nn_task_handle> submitted = task.handle;
+  if (!chat_ctx->task_queue->enqueue_task(std::move(task), chat_ctx)) {
+    return runtime_error;
+  }
+
+  handle = std::move(submitted);
+  return success;
+}
+
+// Wait for a submitted task. The waiter expires its own task at the deadline,
+// so no one scans the queue for stale entries; a task already running is
+// waited for until it finishes.
+static const wasi_nn_task_result &wait_for_task(LlamaChatContext *chat_ctx, wasi_nn_task_handle &handle)
+{
+  if (handle.future.wait_until(handle.timeout_at) == std::future_status::timeout) {
+    chat_ctx->task_queue->expire_task(handle, timeout);
+  }
+  return handle.future.get();
+}
+
+// Tokens a session has prefilled and generated so far, 0 once it is closed
+static uint64_t session_tokens_processed(LlamaChatContext *chat_ctx, graph_execution_context exec_ctx)
+{
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+  auto session_it = chat_ctx->sessions.find(exec_ctx);
+  return session_it == chat_ctx->sessions.end() ? 0 : session_it->second.n_tokens_processed;
+}
+
+static void task_processor_loop(LlamaChatContext *chat_ctx, bool urgent_lane)
+{
+  NN_INFO_PRINTF("Task processor thread started%s", urgent_lane ? " (urgent lane)" : "");
+
+  wasi_nn_task task;
+  while (chat_ctx->task_queue->running) {
+    if (chat_ctx->task_queue->dequeue_task(task, chat_ctx, urgent_lane)) {
+      NN_INFO_PRINTF("Processing task %d for execution context %d",
+                     task.id, task.exec_ctx);
+
+      const uint64_t tokens_before = session_tokens_processed(chat_ctx, task.exec_ctx);
+      execute_task(chat_ctx, task);
+      chat_ctx->task_queue->tasks_completed++;
+
+      // A session closed meanwhile reports nothing; charge what is known
+      const uint64_t tokens_after = session_tokens_processed(chat_ctx, task.exec_ctx);
+      chat_ctx->task_queue->charge(task, tokens_after > tokens_before ? tokens_after - tokens_before : 0);
+
+      NN_INFO_PRINTF("Task %d completed", task.id);
+    }
+  }
+
+  NN_INFO_PRINTF("Task processor thread terminated");
+}
+
+// Stop the task processors; queued tasks that never ran complete with an error
+static void stop_task_processing(LlamaChatContext *chat_ctx)
+{
+  if (!chat_ctx || !chat_ctx->task_queue) {
+    return;
+  }
+
+  auto &task_queue = chat_ctx->task_queue;
+  task_queue->stop();
+
+  // Running tasks are blocked on the engine; stopping it releases them
+  stop_inference_engine(chat_ctx);
+
+  for (auto &worker : chat_ctx->task_processor_threads) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  chat_ctx->task_processor_threads.clear();
+
+  // Release get_output() callers still waiting on tasks that never ran
+  task_queue->fail_pending(runtime_error);
+}
+
 __attribute__((visibility("default"))) wasi_nn_error
 set_input(void *ctx, graph_execution_context exec_ctx, uint32_t index,
           tensor *wasi_nn_tensor)
@@ -2973,11 +7301,6 @@ set_input(void *ctx, graph_execution_context exec_ctx, uint32_t index,
   if (!chat_ctx || !wasi_nn_tensor)
     return invalid_argument;
 
-  // Find the session
-  auto session_it = chat_ctx->sessions.find(exec_ctx);
-  if (session_it == chat_ctx->sessions.end())
-    return invalid_argument;
-
   // Get the input prompt from tensor data
   const char *prompt_str = (const char *)wasi_nn_tensor->data;
   if (!prompt_str)
@@ -2995,13 +7318,19 @@ set_input(void *ctx, graph_execution_context exec_ctx, uint32_t index,
   size_t prompt_len = strnlen(prompt_str, tensor_size);
   std::string prompt(prompt_str, prompt_len);
 
-  // Store the prompt for later processing in compute()
-  // For now, we'll store it in the session (could be optimized)
-  session_it->second.session_id = prompt; // Temporary storage
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+
+  // Find the session
+  auto session_it = chat_ctx->sessions.find(exec_ctx);
+  if (session_it == chat_ctx->sessions.end())
+    return missing_session_error(chat_ctx, exec_ctx);
+
+  // Stage the prompt for the next compute()
+  session_it->second.pending_input = std::move(prompt);
 
   NN_INFO_PRINTF("Input set for execution context %d: %.100s%s",
-                 exec_ctx, prompt.c_str(),
-                 prompt.length() > 100 ? "..." : "");
+                 exec_ctx, session_it->second.pending_input.c_str(),
+                 session_it->second.pending_input.length() > 100 ? "..." : "");
 
   return success;
 }
@@ -3010,9 +7339,16 @@ __attribute__((visibility("default"))) wasi_nn_error
 compute(void *ctx, graph_execution_context exec_ctx)
 {
   LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
-  if (!chat_ctx)
+  if (!chat_ctx || !chat_ctx->task_queue)
     return invalid_argument;
 
+  if (chat_ctx->task_processor_threads.empty()) {
+    NN_ERR_PRINTF("Task processing is disabled, compute() is unavailable");
+    return unsupported_operation;
+  }
+
+  std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+
   // Phase 4.3: Automatic memory optimization before processing
   wasi_nn_error opt_result = auto_optimize_memory(chat_ctx, exec_ctx);
   if (opt_result != success) {
@@ -3023,24 +7359,41 @@ compute(void *ctx, graph_execution_context exec_ctx)
   // Find the session
   auto session_it = chat_ctx->sessions.find(exec_ctx);
   if (session_it == chat_ctx->sessions.end())
+    return missing_session_error(chat_ctx, exec_ctx);
+
+  SessionInfo &session_info = session_it->second;
+  if (session_info.pending_input.empty()) {
+    NN_ERR_PRINTF("No input set for execution context %d", exec_ctx);
     return invalid_argument;
+  }
 
-  // For simplified version, process immediately without concurrency limits
-  NN_INFO_PRINTF("Processing compute request immediately for execution context %d", exec_ctx);
+  if (session_info.pending_task &&
+      session_info.pending_task->future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    NN_ERR_PRINTF("Execution context %d already has a compute in progress", exec_ctx);
+    return runtime_error;
+  }
 
   // Update last activity time
-  session_it->second.last_activity = std::chrono::steady_clock::now();
+  session_info.last_activity = std::chrono::steady_clock::now();
+
+  wasi_nn_task task;
+  task.exec_ctx = exec_ctx;
+  task.priority = session_info.priority;
+  task.flow = session_info.tenant;
+  task.prompt = session_info.pending_input;
+  session_info.cancel_requested->store(false);
 
-  // Phase 4.3: Auto context shift if needed (context window approaching limit)
-  auto_perform_context_shift_session(chat_ctx, exec_ctx);
+  std::shared_ptr<wasi_nn_task_handle> handle;
+  wasi_nn_error submit_result = submit_task(chat_ctx, std::move(task), handle);
+  if (submit_result != success) {
+    return submit_result;
+  }
 
-  // For Phase 4.2, we're mainly implementing the queuing mechanism
-  // The actual inference processing remains the same as before
-  // This would typically involve:
-  // 1. Creating server tasks
-  // 2. Processing through the server context
-  // 3. Managing the llama context and sampling
+  session_info.queued_task = handle;
+  session_info.pending_task = std::move(handle);
+  session_info.pending_input.clear();
 
+  NN_DBG_PRINTF("Compute queued for execution context %d", exec_ctx);
   return success;
 }
 
@@ -3048,6 +7401,72 @@ __attribute__((visibility("default"))) wasi_nn_error
 get_output(void *ctx, graph_execution_context exec_ctx, uint32_t index,
            tensor_data output_tensor, uint32_t *output_tensor_size)
 {
+  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
+  if (!chat_ctx || !output_tensor_size)
+    return invalid_argument;
+
+  std::shared_ptr<wasi_nn_task_handle> pending_task;
+  {
+    std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+
+    auto session_it = chat_ctx->sessions.find(exec_ctx);
+    if (session_it == chat_ctx->sessions.end())
+      return missing_session_error(chat_ctx, exec_ctx);
+
+    pending_task = session_it->second.pending_task;
+  }
+
+  if (!pending_task) {
+    NN_ERR_PRINTF("get_output called before compute for execution context %d", exec_ctx);
+    return invalid_argument;
+  }
+
+  // Blocks until the task processor has produced the result
+  const wasi_nn_task_result &result = wait_for_task(chat_ctx, *pending_task);
+  if (!has_turn_output(result.status)) {
+    return result.status;
+  }
+
+  // A turn cut off by its deadline or a cancel still hands back what it generated
+  const uint32_t output_buffer_capacity = *output_tensor_size;
+  copy_string_to_tensor_data(output_tensor, output_buffer_capacity, result.output);
+  *output_tensor_size = result.output.length();
+
+  return result.status;
+}
+
+// ==============================================================================
+// Phase 6.18: Cancellation of in-progress turns
+// ==============================================================================
+// Like SERVER_TASK_TYPE_CANCEL, but the interrupted call still gets an answer:
+// the engine slot checks the session's flag at every decode step and between
+// prompt chunks, stops, and reports the text generated so far. A turn that no
+// processor has started yet is answered at once.
+__attribute__((visibility("default"))) wasi_nn_error
+cancel_inference(void *ctx, graph_execution_context exec_ctx)
+{
+  LlamaChatContext *chat_ctx = (LlamaChatContext *)ctx;
+  if (!chat_ctx) {
+    return invalid_argument;
+  }
+
+  std::shared_ptr<wasi_nn_task_handle> queued;
+  {
+    std::lock_guard<std::mutex> lock(chat_ctx->sessions_mutex);
+    auto session_it = chat_ctx->sessions.find(exec_ctx);
+    if (session_it == chat_ctx->sessions.end()) {
+      WASI_NN_LOG_ERROR(chat_ctx, "Invalid execution context %d", exec_ctx);
+      return missing_session_error(chat_ctx, exec_ctx);
+    }
+    session_it->second.cancel_requested->store(true);
+    queued = session_it->second.queued_task.lock();
+  }
+
+  if (queued && chat_ctx->task_queue && chat_ctx->task_queue->expire_task(*queued, cancelled)) {
+    WASI_NN_LOG_INFO(chat_ctx, "Cancelled queued turn of session %d", exec_ctx);
+  } else {
+    WASI_NN_LOG_INFO(chat_ctx, "Cancel requested for session %d", exec_ctx);
+  }
   return success;
 }
 
@@ -3101,7 +7520,7 @@ auto_perform_context_shift_session(LlamaChatContext *chat_ctx, graph_execution_c
     return invalid_argument;
   }
 
-  if (!chat_ctx->context_shifting_enabled) {
+  if (!context_shift_available(chat_ctx)) {
     NN_DBG_PRINTF("Context shifting is disabled for session %u", exec_ctx);
     return success; // Not an error, just disabled
   }
@@ -3127,14 +7546,11 @@ auto_optimize_memory(LlamaChatContext *chat_ctx, graph_execution_context exec_ct
 
   NN_DBG_PRINTF("Auto-optimizing memory for session %u", exec_ctx);
 
-  // Check for memory pressure and handle it
+  // Memory pressure is relieved by the governor, once per pressure episode;
+  // trimming again on every turn would only repeat the same cleanup
   if (check_memory_pressure(chat_ctx)) {
-    NN_INFO_PRINTF("Memory pressure detected, performing automatic cleanup");
-    wasi_nn_error result = handle_memory_pressure(chat_ctx);
-    if (result != success) {
-      NN_WARN_PRINTF("Failed to handle memory pressure: %d", result);
-      // Don't fail the inference, just log warning
-    }
+    NN_DBG_PRINTF("Memory pressure level %d, relief left to the governor",
+                  chat_ctx->memory_pressure_level.load());
   }
 
   // Optimize token cache (non-critical)
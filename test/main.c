@@ -12,11 +12,36 @@ extern int test_enhanced_model_config();
 extern int test_basic_inference();
 extern int test_advanced_sampling();
 extern int test_dynamic_runtime_parameters();
+extern int test_concurrent_inference();
+extern int test_streaming_inference();
+extern int test_async_compute_pipeline();
+extern int test_batched_inference();
+extern int test_speculative_decoding();
+extern int test_queued_task_execution();
+extern int test_task_submission_contention();
+extern int test_fair_scheduling();
+extern int test_deadline_cancellation();
+extern int test_urgent_preemption();
+extern int test_cancel_inference();
+extern int test_cancel_queued_turn();
 
 // Session tests
 extern int test_session_management();
 extern int test_auto_session_cleanup();
 extern int test_concurrency_management();
+extern int test_interleaved_session_sequences();
+extern int test_shared_prefix_cache();
+extern int test_session_persistence();
+extern int test_context_shift_long_conversation();
+extern int test_backend_stats();
+extern int test_memory_governor_eviction();
+extern int test_kv_offload_tiers();
+extern int test_sink_window_streaming();
+extern int test_history_token_budget();
+extern int test_request_arena_reuse();
+extern int test_shared_model_registry();
+extern int test_kv_admission_control();
+extern int test_idle_kv_compaction();
 
 // Logging tests
 extern int test_logging_configuration();
@@ -65,11 +90,36 @@ int main() {
     RUN_TEST("Basic Inference Test", test_basic_inference);
     RUN_TEST("Advanced Sampling Parameters", test_advanced_sampling);
     RUN_TEST("Dynamic Runtime Parameters", test_dynamic_runtime_parameters);
+    RUN_TEST("Concurrent Inference (Continuous Batching)", test_concurrent_inference);
+    RUN_TEST("Streaming Inference with Early Abort", test_streaming_inference);
+    RUN_TEST("Asynchronous Compute Pipeline", test_async_compute_pipeline);
+    RUN_TEST("Batched Multi-Prompt Inference", test_batched_inference);
+    RUN_TEST("Speculative Decoding with Draft Model", test_speculative_decoding);
+    RUN_TEST("Queued Task Execution", test_queued_task_execution);
+    RUN_TEST("Task Submission Contention", test_task_submission_contention);
+    RUN_TEST("Weighted Fair Scheduling", test_fair_scheduling);
+    RUN_TEST("Deadline Cancellation with Partial Output", test_deadline_cancellation);
+    RUN_TEST("URGENT Preemption at Token Boundaries", test_urgent_preemption);
+    RUN_TEST("Cancellation of In-Progress Inference", test_cancel_inference);
+    RUN_TEST("Cancellation of a Queued Turn", test_cancel_queued_turn);
 
     TEST_SECTION("Session Management Tests (test_session.c)");
     RUN_TEST("Session Management and Chat History", test_session_management);
     RUN_TEST("Auto Session Cleanup Validation", test_auto_session_cleanup);
     RUN_TEST("Concurrency Management", test_concurrency_management);
+    RUN_TEST("Interleaved Session KV Sequences", test_interleaved_session_sequences);
+    RUN_TEST("Shared Prefix Cache Across Sessions", test_shared_prefix_cache);
+    RUN_TEST("Session Persistence and Warm Resume", test_session_persistence);
+    RUN_TEST("Context Shift in a Long Conversation", test_context_shift_long_conversation);
+    RUN_TEST("KV Cache Accounting and Backend Stats", test_backend_stats);
+    RUN_TEST("Memory Governor Eviction Under Pressure", test_memory_governor_eviction);
+    RUN_TEST("Tiered KV Offload For Idle Sessions", test_kv_offload_tiers);
+    RUN_TEST("Attention-Sink Window Streaming Benchmark", test_sink_window_streaming);
+    RUN_TEST("Session History Token Budget", test_history_token_budget);
+    RUN_TEST("Request Arena Reuse", test_request_arena_reuse);
+    RUN_TEST("Shared Model Registry", test_shared_model_registry);
+    RUN_TEST("KV Admission Control", test_kv_admission_control);
+    RUN_TEST("Idle-Time KV Compaction", test_idle_kv_compaction);
 
     TEST_SECTION("Advanced Logging System Tests (test_logging.c)");
     RUN_TEST("Basic Logging Configuration", test_logging_configuration);
@@ -16,6 +16,13 @@ init_execution_context_func_t wasi_init_execution_context = NULL;
 init_execution_context_with_session_id_func_t wasi_init_execution_context_with_session_id = NULL;
 close_execution_context_func_t wasi_close_execution_context = NULL;
 run_inference_func_t wasi_run_inference = NULL;
+run_inference_stream_func_t wasi_run_inference_stream = NULL;
+run_inference_batch_func_t wasi_run_inference_batch = NULL;
+get_speculative_stats_func_t wasi_get_speculative_stats = NULL;
+get_backend_stats_func_t wasi_get_backend_stats = NULL;
+session_state_func_t wasi_save_session_state = NULL;
+session_state_func_t wasi_restore_session_state = NULL;
+cancel_inference_func_t wasi_cancel_inference = NULL;
 set_input_func_t wasi_set_input = NULL;
 compute_func_t wasi_compute = NULL;
 get_output_func_t wasi_get_output = NULL;
@@ -52,6 +59,13 @@ int setup_library(void) {
     *(void **)(&wasi_init_execution_context_with_session_id) = dlsym(handle, "init_execution_context_with_session_id");
     *(void **)(&wasi_close_execution_context) = dlsym(handle, "close_execution_context");
     *(void **)(&wasi_run_inference) = dlsym(handle, "run_inference");
+    *(void **)(&wasi_run_inference_stream) = dlsym(handle, "run_inference_stream");
+    *(void **)(&wasi_run_inference_batch) = dlsym(handle, "run_inference_batch");
+    *(void **)(&wasi_get_speculative_stats) = dlsym(handle, "get_speculative_stats");
+    *(void **)(&wasi_get_backend_stats) = dlsym(handle, "get_backend_stats");
+    *(void **)(&wasi_save_session_state) = dlsym(handle, "save_session_state");
+    *(void **)(&wasi_restore_session_state) = dlsym(handle, "restore_session_state");
+    *(void **)(&wasi_cancel_inference) = dlsym(handle, "cancel_inference");
     *(void **)(&wasi_set_input) = dlsym(handle, "set_input");
     *(void **)(&wasi_compute) = dlsym(handle, "compute");
     *(void **)(&wasi_get_output) = dlsym(handle, "get_output");
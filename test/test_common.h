@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <dlfcn.h>
 #include <unistd.h>
 #include <pthread.h>
@@ -69,7 +70,9 @@ typedef enum {
     runtime_error = 4,
     unsupported_operation = 5,
     too_large = 6,
-    not_found = 7
+    not_found = 7,
+    cancelled = 104,
+    session_evicted = 105
 } wasi_nn_error;
 
 typedef uint32_t graph;
@@ -109,6 +112,72 @@ typedef wasi_nn_error (*close_execution_context_func_t)(void *ctx, graph_executi
 typedef wasi_nn_error (*run_inference_func_t)(void *ctx, graph_execution_context exec_ctx, uint32_t index,
                                             tensor *input_tensor, tensor_data output_tensor, uint32_t *output_tensor_size,
                                             const char *runtime_config, uint32_t config_len);
+typedef bool (*stream_callback_t)(const char *piece, uint32_t piece_len, void *user_data);
+typedef wasi_nn_error (*run_inference_stream_func_t)(void *ctx, graph_execution_context exec_ctx, uint32_t index,
+                                                   tensor *input_tensor, const char *runtime_config, uint32_t config_len,
+                                                   stream_callback_t callback, void *user_data);
+typedef wasi_nn_error (*run_inference_batch_func_t)(void *ctx, graph_execution_context exec_ctx, uint32_t batch_size,
+                                                  tensor *input_tensors, tensor_data *output_tensors, uint32_t *output_tensor_sizes,
+                                                  const char **runtime_configs, const uint32_t *config_lens);
+typedef struct {
+    bool enabled;
+    uint64_t n_draft_tokens;
+    uint64_t n_draft_accepted;
+    uint64_t n_generated_tokens;
+    double acceptance_rate;
+    double speedup;
+    double tokens_per_second;
+} wasi_nn_speculative_stats;
+typedef wasi_nn_error (*get_speculative_stats_func_t)(void *ctx, graph_execution_context exec_ctx,
+                                                    wasi_nn_speculative_stats *stats);
+typedef struct {
+    uint32_t n_sessions;
+    uint32_t n_sessions_bound;
+    uint32_t n_slots;
+    uint32_t kv_cells_total;
+    uint64_t kv_tokens_spanned;
+    uint64_t kv_bytes_per_token;
+    uint64_t kv_bytes_spanned;
+    uint64_t kv_bytes_total;
+    double kv_usage;
+    uint64_t n_prompt_tokens;
+    uint64_t n_prompt_tokens_reused;
+    uint64_t prefix_cache_hits;
+    uint64_t prefix_cache_misses;
+    uint64_t prefix_cache_tokens_shared;
+    uint64_t memory_usage_bytes;
+    uint64_t memory_limit_bytes;
+    uint32_t memory_pressure_level;
+    uint32_t n_sessions_kv_ram;
+    uint32_t n_sessions_kv_disk;
+    uint64_t kv_offload_ram_bytes;
+    uint64_t kv_offload_restores;
+    uint64_t arena_requests;
+    uint64_t arena_heap_allocs;
+    uint64_t arena_peak_bytes;
+    uint64_t scratch_reallocs;
+    uint32_t model_shared_refs;
+    uint64_t admission_waits;
+    uint64_t admission_evictions;
+    uint64_t admission_rejections;
+    double kv_fragmentation;
+    uint64_t kv_compactions;
+    double kv_fragmentation_before_compaction;
+    double kv_fragmentation_after_compaction;
+    double kv_compaction_ms;
+    uint64_t context_shifts;
+    uint32_t tasks_pending;
+    uint64_t tasks_completed;
+    uint64_t tasks_timed_out;
+    uint64_t tasks_rejected;
+    uint64_t tasks_preempted;
+    uint32_t tasks_active;
+    uint64_t tasks_cancelled;
+} wasi_nn_backend_stats;
+typedef wasi_nn_error (*get_backend_stats_func_t)(void *ctx, graph_execution_context exec_ctx,
+                                                wasi_nn_backend_stats *stats);
+typedef wasi_nn_error (*session_state_func_t)(void *ctx, graph_execution_context exec_ctx);
+typedef wasi_nn_error (*cancel_inference_func_t)(void *ctx, graph_execution_context exec_ctx);
 typedef wasi_nn_error (*set_input_func_t)(void *ctx, graph_execution_context exec_ctx, uint32_t index, tensor *input_tensor);
 typedef wasi_nn_error (*compute_func_t)(void *ctx, graph_execution_context exec_ctx);
 typedef wasi_nn_error (*get_output_func_t)(void *ctx, graph_execution_context exec_ctx, uint32_t index, 
@@ -124,6 +193,13 @@ extern init_execution_context_func_t wasi_init_execution_context;
 extern init_execution_context_with_session_id_func_t wasi_init_execution_context_with_session_id;
 extern close_execution_context_func_t wasi_close_execution_context;
 extern run_inference_func_t wasi_run_inference;
+extern run_inference_stream_func_t wasi_run_inference_stream;
+extern run_inference_batch_func_t wasi_run_inference_batch;
+extern get_speculative_stats_func_t wasi_get_speculative_stats;
+extern get_backend_stats_func_t wasi_get_backend_stats;
+extern session_state_func_t wasi_save_session_state;
+extern session_state_func_t wasi_restore_session_state;
+extern cancel_inference_func_t wasi_cancel_inference;
 extern set_input_func_t wasi_set_input;
 extern compute_func_t wasi_compute;
 extern get_output_func_t wasi_get_output;
@@ -152,11 +228,36 @@ int test_enhanced_model_config(void);
 int test_basic_inference(void);
 int test_advanced_sampling(void);
 int test_dynamic_runtime_parameters(void);
+int test_concurrent_inference(void);
+int test_streaming_inference(void);
+int test_async_compute_pipeline(void);
+int test_batched_inference(void);
+int test_speculative_decoding(void);
+int test_queued_task_execution(void);
+int test_task_submission_contention(void);
+int test_fair_scheduling(void);
+int test_deadline_cancellation(void);
+int test_urgent_preemption(void);
+int test_cancel_inference(void);
+int test_cancel_queued_turn(void);
 
 // Session tests
 int test_session_management(void);
 int test_auto_session_cleanup(void);
 int test_concurrency_management(void);
+int test_interleaved_session_sequences(void);
+int test_shared_prefix_cache(void);
+int test_session_persistence(void);
+int test_context_shift_long_conversation(void);
+int test_backend_stats(void);
+int test_memory_governor_eviction(void);
+int test_kv_offload_tiers(void);
+int test_sink_window_streaming(void);
+int test_history_token_budget(void);
+int test_request_arena_reuse(void);
+int test_shared_model_registry(void);
+int test_kv_admission_control(void);
+int test_idle_kv_compaction(void);
 
 // Logging tests
 int test_logging_configuration(void);
@@ -321,3 +321,954 @@ int test_dynamic_runtime_parameters() {
 
     return 1;
 }
+
+// Thread data for concurrent inference testing
+typedef struct {
+    int thread_id;
+    void *backend_ctx;
+    graph_execution_context exec_ctx;
+    const char *prompt;
+    wasi_nn_error result;
+    uint32_t output_size;
+    char output[512];
+} inference_thread_data_t;
+
+static void* concurrent_inference_thread(void* arg) {
+    inference_thread_data_t* data = (inference_thread_data_t*)arg;
+    // Greedy, so the sequential run below generates the same tokens
+    const char *runtime_config = "{\"max_tokens\":32,\"temperature\":0.0}";
+
+    tensor input_tensor;
+    setup_tensor(&input_tensor, data->prompt);
+
+    data->output_size = sizeof(data->output) - 1;
+    data->result = wasi_run_inference(data->backend_ctx, data->exec_ctx, 0, &input_tensor,
+                                      (uint8_t*)data->output, &data->output_size,
+                                      runtime_config, strlen(runtime_config));
+    if (data->output_size < sizeof(data->output)) {
+        data->output[data->output_size] = '\0';
+    }
+
+    return NULL;
+}
+
+// Test 9: Concurrent inference on the continuous batching engine
+int test_concurrent_inference() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"max_concurrent\":4}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config =
+        "{"
+        "  \"model\": {"
+        "    \"n_gpu_layers\": 49,"
+        "    \"ctx_size\": 4096,"
+        "    \"batch_size\": 512,"
+        "    \"n_parallel\": 4,"
+        "    \"threads\": 4"
+        "  }"
+        "}";
+
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    const char *prompts[] = {
+        "What is the capital of France?",
+        "Name three primary colors.",
+        "What is 2 + 2?",
+        "Describe the sky in one sentence."
+    };
+    const int num_threads = 4;
+    pthread_t threads[num_threads];
+    inference_thread_data_t thread_data[num_threads];
+
+    for (int i = 0; i < num_threads; i++) {
+        memset(&thread_data[i], 0, sizeof(thread_data[i]));
+        thread_data[i].thread_id = i;
+        thread_data[i].backend_ctx = backend_ctx;
+        thread_data[i].prompt = prompts[i];
+        err = wasi_init_execution_context(backend_ctx, g, &thread_data[i].exec_ctx);
+        ASSERT_SUCCESS(err, "Execution context initialization failed");
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < num_threads; i++) {
+        int result = pthread_create(&threads[i], NULL, concurrent_inference_thread, &thread_data[i]);
+        ASSERT(result == 0, "Failed to create thread");
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+                        (end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+    for (int i = 0; i < num_threads; i++) {
+        ASSERT_SUCCESS(thread_data[i].result, "Concurrent inference failed");
+        ASSERT(thread_data[i].output_size > 0, "No output generated in concurrent inference");
+        printf("✅ Session %d response (%u chars): %.60s%s\n",
+               thread_data[i].thread_id, thread_data[i].output_size, thread_data[i].output,
+               thread_data[i].output_size > 60 ? "..." : "");
+    }
+
+    printf("✅ %d concurrent sessions completed in %.1f ms\n", num_threads, elapsed_ms);
+
+    // The same turns one after another, on fresh sessions so nothing is reused
+    // from the KV cache. The concurrent run paid the warm-up, so this is the
+    // favourable case for the sequential side.
+    double sequential_ms = 0.0;
+    for (int i = 0; i < num_threads; i++) {
+        wasi_close_execution_context(backend_ctx, thread_data[i].exec_ctx);
+        err = wasi_init_execution_context(backend_ctx, g, &thread_data[i].exec_ctx);
+        ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        concurrent_inference_thread(&thread_data[i]);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        sequential_ms += (end.tv_sec - start.tv_sec) * 1000.0 +
+                         (end.tv_nsec - start.tv_nsec) / 1000000.0;
+        ASSERT_SUCCESS(thread_data[i].result, "Sequential inference failed");
+    }
+
+    printf("✅ Same turns run sequentially in %.1f ms\n", sequential_ms);
+    ASSERT(elapsed_ms < sequential_ms,
+           "Concurrent sessions should share decode steps and finish before the sequential runs");
+
+    // Cleanup
+    for (int i = 0; i < num_threads; i++) {
+        wasi_close_execution_context(backend_ctx, thread_data[i].exec_ctx);
+    }
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+// Collects streamed pieces and optionally aborts after a number of them
+typedef struct {
+    char text[1024];
+    uint32_t length;
+    int pieces;
+    int abort_after;
+} stream_state_t;
+
+static bool collect_stream_piece(const char *piece, uint32_t piece_len, void *user_data) {
+    stream_state_t *state = (stream_state_t *)user_data;
+
+    if (state->length + piece_len < sizeof(state->text)) {
+        memcpy(state->text + state->length, piece, piece_len);
+        state->length += piece_len;
+        state->text[state->length] = '\0';
+    }
+    state->pieces++;
+
+    return state->abort_after <= 0 || state->pieces < state->abort_after;
+}
+
+// Test 10: Streaming inference with callback and early abort
+int test_streaming_inference() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    err = wasi_init_backend(&backend_ctx);
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":2048,\"n_predict\":64}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context(backend_ctx, g, &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    // Full stream
+    tensor input_tensor;
+    setup_tensor(&input_tensor, "Count from one to ten in words.");
+
+    stream_state_t full = {0};
+    const char *runtime_config = "{\"max_tokens\":48}";
+    err = wasi_run_inference_stream(backend_ctx, exec_ctx, 0, &input_tensor,
+                                    runtime_config, strlen(runtime_config),
+                                    collect_stream_piece, &full);
+    ASSERT_SUCCESS(err, "Streaming inference failed");
+    ASSERT(full.pieces > 1, "Response was not delivered incrementally");
+    ASSERT(full.length > 0, "No streamed output received");
+
+    printf("✅ Streamed %d pieces (%u bytes): %.80s%s\n",
+           full.pieces, full.length, full.text, full.length > 80 ? "..." : "");
+
+    // Abort after a few pieces
+    tensor input_tensor2;
+    setup_tensor(&input_tensor2, "Write a long story about a dragon.");
+
+    stream_state_t partial = {0};
+    partial.abort_after = 3;
+    err = wasi_run_inference_stream(backend_ctx, exec_ctx, 0, &input_tensor2,
+                                    NULL, 0, collect_stream_piece, &partial);
+    ASSERT_SUCCESS(err, "Aborted streaming inference failed");
+    ASSERT(partial.pieces == 3, "Callback abort did not stop generation");
+
+    printf("✅ Generation stopped by callback after %d pieces\n", partial.pieces);
+
+    // The session is still usable after an abort
+    uint8_t output_buffer[512];
+    uint32_t output_size = sizeof(output_buffer);
+    tensor input_tensor3;
+    setup_tensor(&input_tensor3, "Thanks, that is enough.");
+    err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor3, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Inference after aborted stream failed");
+
+    // Invalid arguments
+    err = wasi_run_inference_stream(backend_ctx, exec_ctx, 0, &input_tensor, NULL, 0, NULL, NULL);
+    ASSERT(err != 0, "Missing callback should be rejected");
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+// Test 11: Asynchronous set_input / compute / get_output pipeline
+int test_async_compute_pipeline() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"max_concurrent\":2}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":2048,\"n_parallel\":2,\"n_predict\":32}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    graph_execution_context ctx_a = 0, ctx_b = 0;
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "async_a", &ctx_a);
+    ASSERT_SUCCESS(err, "Execution context A initialization failed");
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "async_b", &ctx_b);
+    ASSERT_SUCCESS(err, "Execution context B initialization failed");
+
+    // compute() without staged input is rejected
+    err = wasi_compute(backend_ctx, ctx_a);
+    ASSERT(err != 0, "compute() without set_input() should fail");
+
+    tensor input_a, input_b;
+    setup_tensor(&input_a, "Name a planet in the solar system.");
+    setup_tensor(&input_b, "Name a programming language.");
+
+    err = wasi_set_input(backend_ctx, ctx_a, 0, &input_a);
+    ASSERT_SUCCESS(err, "set_input A failed");
+    err = wasi_set_input(backend_ctx, ctx_b, 0, &input_b);
+    ASSERT_SUCCESS(err, "set_input B failed");
+
+    // Both computes return immediately and run concurrently
+    err = wasi_compute(backend_ctx, ctx_a);
+    ASSERT_SUCCESS(err, "compute A failed");
+    err = wasi_compute(backend_ctx, ctx_b);
+    ASSERT_SUCCESS(err, "compute B failed");
+
+    char output_a[512], output_b[512];
+    uint32_t size_a = sizeof(output_a) - 1, size_b = sizeof(output_b) - 1;
+
+    err = wasi_get_output(backend_ctx, ctx_b, 0, (tensor_data)output_b, &size_b);
+    ASSERT_SUCCESS(err, "get_output B failed");
+    ASSERT(size_b > 0, "No output for session B");
+
+    err = wasi_get_output(backend_ctx, ctx_a, 0, (tensor_data)output_a, &size_a);
+    ASSERT_SUCCESS(err, "get_output A failed");
+    ASSERT(size_a > 0, "No output for session A");
+
+    output_a[size_a < sizeof(output_a) ? size_a : sizeof(output_a) - 1] = '\0';
+    output_b[size_b < sizeof(output_b) ? size_b : sizeof(output_b) - 1] = '\0';
+    printf("✅ Session A output: %.60s%s\n", output_a, size_a > 60 ? "..." : "");
+    printf("✅ Session B output: %.60s%s\n", output_b, size_b > 60 ? "..." : "");
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, ctx_a);
+    wasi_close_execution_context(backend_ctx, ctx_b);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+// Test 12: Multi-prompt batched inference
+int test_batched_inference() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"max_concurrent\":4}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":4096,\"n_parallel\":4,\"n_predict\":16}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context(backend_ctx, g, &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    enum { BATCH = 4 };
+    const char *prompts[BATCH] = {
+        "Classify the sentiment (positive/negative): I love this phone.",
+        "Classify the sentiment (positive/negative): The food was awful.",
+        "Classify the sentiment (positive/negative): Best movie of the year.",
+        "Classify the sentiment (positive/negative): I want a refund."
+    };
+    const char *configs[BATCH] = {"{\"max_tokens\":8}", NULL, "{\"max_tokens\":8,\"temperature\":0.1}", NULL};
+    uint32_t config_lens[BATCH] = {(uint32_t)strlen(configs[0]), 0, (uint32_t)strlen(configs[2]), 0};
+
+    tensor inputs[BATCH];
+    char outputs[BATCH][256];
+    tensor_data output_ptrs[BATCH];
+    uint32_t output_sizes[BATCH];
+    for (int i = 0; i < BATCH; i++) {
+        setup_tensor(&inputs[i], prompts[i]);
+        output_ptrs[i] = (tensor_data)outputs[i];
+        output_sizes[i] = sizeof(outputs[i]) - 1;
+    }
+
+    err = wasi_run_inference_batch(backend_ctx, exec_ctx, BATCH, inputs, output_ptrs, output_sizes,
+                                   configs, config_lens);
+    ASSERT_SUCCESS(err, "Batched inference failed");
+
+    for (int i = 0; i < BATCH; i++) {
+        ASSERT(output_sizes[i] > 0, "Batch item produced no output");
+        outputs[i][output_sizes[i] < sizeof(outputs[i]) ? output_sizes[i] : sizeof(outputs[i]) - 1] = '\0';
+        printf("✅ Item %d: %.60s%s\n", i, outputs[i], output_sizes[i] > 60 ? "..." : "");
+    }
+
+    // Invalid arguments
+    err = wasi_run_inference_batch(backend_ctx, exec_ctx, 0, inputs, output_ptrs, output_sizes, NULL, NULL);
+    ASSERT(err != 0, "Empty batch should be rejected");
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_speculative_decoding() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    err = wasi_init_backend(&backend_ctx);
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    // Self-speculation with greedy sampling: the draft agrees with the target,
+    // so nearly every proposed token must be accepted
+    char model_config[512];
+    snprintf(model_config, sizeof(model_config),
+             "{\"model\":{\"n_gpu_layers\":49,\"ctx_size\":2048,\"n_predict\":48},"
+             "\"speculative\":{\"draft_model\":\"%s\",\"n_max\":8,\"n_min\":1,\"p_min\":0.5},"
+             "\"sampling\":{\"temperature\":0.0,\"top_k\":1}}",
+             MODEL_FILE);
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading with draft model failed");
+
+    err = wasi_init_execution_context(backend_ctx, g, &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    tensor input_tensor;
+    setup_tensor(&input_tensor, "Count from one to twenty in words, separated by commas.");
+
+    char output[1024];
+    uint32_t output_size = sizeof(output) - 1;
+    err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, (tensor_data)output, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Inference with speculative decoding failed");
+    ASSERT(output_size > 0, "Speculative decoding produced no output");
+
+    wasi_nn_speculative_stats stats;
+    err = wasi_get_speculative_stats(backend_ctx, exec_ctx, &stats);
+    ASSERT_SUCCESS(err, "Failed to read session speculative stats");
+    ASSERT(stats.enabled, "Draft model should be reported as loaded");
+    ASSERT(stats.n_draft_tokens > 0, "No tokens were drafted");
+    ASSERT(stats.n_draft_accepted <= stats.n_draft_tokens, "Accepted more tokens than drafted");
+    ASSERT(stats.speedup >= 1.0, "Speedup must be at least 1.0");
+    printf("✅ Drafted %llu, accepted %llu (%.1f%%), speedup %.2fx, %.1f tokens/s\n",
+           (unsigned long long)stats.n_draft_tokens, (unsigned long long)stats.n_draft_accepted,
+           stats.acceptance_rate * 100.0, stats.speedup, stats.tokens_per_second);
+
+    wasi_nn_speculative_stats backend_stats;
+    err = wasi_get_speculative_stats(backend_ctx, 0, &backend_stats);
+    ASSERT_SUCCESS(err, "Failed to read backend speculative stats");
+    ASSERT(backend_stats.n_draft_tokens >= stats.n_draft_tokens, "Backend counters should include the session");
+
+    err = wasi_get_speculative_stats(backend_ctx, 9999, &stats);
+    ASSERT(err != 0, "Unknown execution context should be rejected");
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+// Test 13: run_inference and compute share the task queue and its limits
+int test_queued_task_execution() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    wasi_nn_error err;
+
+    // One processor and room for a single waiting turn
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"max_concurrent\":1,"
+                         "\"queue_size\":4,\"queue_warning_threshold\":1,\"queue_reject_threshold\":1}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":2048,\"n_parallel\":1,\"n_predict\":64}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    graph_execution_context ctx[3] = {0, 0, 0};
+    const char *session_ids[] = {"queued_a", "queued_b", "queued_c"};
+    for (int i = 0; i < 3; i++) {
+        err = wasi_init_execution_context_with_session_id(backend_ctx, session_ids[i], &ctx[i]);
+        ASSERT_SUCCESS(err, "Execution context initialization failed");
+    }
+
+    // run_inference goes through the queue and keeps its runtime parameters
+    tensor input;
+    setup_tensor(&input, "Count from one to twenty.");
+    char output[1024];
+    uint32_t output_size = sizeof(output) - 1;
+    const char *runtime_config = "{\"max_tokens\":4,\"priority\":\"high\"}";
+    err = wasi_run_inference(backend_ctx, ctx[0], 0, &input, (tensor_data)output, &output_size,
+                             runtime_config, strlen(runtime_config));
+    ASSERT_SUCCESS(err, "Queued run_inference failed");
+    ASSERT(output_size > 0, "Queued run_inference produced no output");
+
+    wasi_nn_backend_stats stats;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    ASSERT(stats.tasks_completed >= 1, "run_inference should have run as a task");
+    ASSERT(stats.tasks_pending == 0, "No task should be waiting");
+
+    // With one turn running and one waiting, a third is refused
+    tensor inputs[3];
+    wasi_nn_error compute_err[3];
+    const char *prompts[] = {"Write a long story about a dragon.", "Write a long story about a knight.",
+                             "Write a long story about a wizard."};
+    for (int i = 0; i < 3; i++) {
+        setup_tensor(&inputs[i], prompts[i]);
+        ASSERT_SUCCESS(wasi_set_input(backend_ctx, ctx[i], 0, &inputs[i]), "set_input failed");
+        compute_err[i] = wasi_compute(backend_ctx, ctx[i]);
+    }
+    ASSERT_SUCCESS(compute_err[0], "The first compute should be queued");
+    ASSERT(compute_err[2] != 0, "A compute beyond queue_reject_threshold should be refused");
+
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    ASSERT(stats.tasks_rejected >= 1, "The refused compute should be counted");
+
+    for (int i = 0; i < 3; i++) {
+        if (compute_err[i] != 0) {
+            continue;
+        }
+        output_size = sizeof(output) - 1;
+        err = wasi_get_output(backend_ctx, ctx[i], 0, (tensor_data)output, &output_size);
+        ASSERT_SUCCESS(err, "get_output for a queued compute failed");
+    }
+    printf("✅ Tasks completed: %llu, rejected: %llu, timed out: %llu\n",
+           (unsigned long long)stats.tasks_completed, (unsigned long long)stats.tasks_rejected,
+           (unsigned long long)stats.tasks_timed_out);
+
+    // Cleanup
+    for (int i = 0; i < 3; i++) {
+        wasi_close_execution_context(backend_ctx, ctx[i]);
+    }
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+// Thread data for the submission contention benchmark
+typedef struct {
+    void *backend_ctx;
+    graph_execution_context exec_ctx;
+    int rounds;
+    wasi_nn_error result;
+    double submit_us_total;
+    double submit_us_max;
+} submission_thread_data_t;
+
+static void* submission_thread(void* arg) {
+    submission_thread_data_t* data = (submission_thread_data_t*)arg;
+    char output[256];
+
+    tensor input_tensor;
+    setup_tensor(&input_tensor, "Say hi.");
+
+    for (int round = 0; round < data->rounds; round++) {
+        data->result = wasi_set_input(data->backend_ctx, data->exec_ctx, 0, &input_tensor);
+        if (data->result != success) {
+            return NULL;
+        }
+
+        // Only the submission is timed; generation happens on the processors
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        data->result = wasi_compute(data->backend_ctx, data->exec_ctx);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (data->result != success) {
+            return NULL;
+        }
+        double submit_us = (end.tv_sec - start.tv_sec) * 1000000.0 +
+                           (end.tv_nsec - start.tv_nsec) / 1000.0;
+        data->submit_us_total += submit_us;
+        if (submit_us > data->submit_us_max) {
+            data->submit_us_max = submit_us;
+        }
+
+        uint32_t output_size = sizeof(output) - 1;
+        data->result = wasi_get_output(data->backend_ctx, data->exec_ctx, 0, (tensor_data)output, &output_size);
+        if (data->result != success) {
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+// Test 14: Many host threads submitting to the task queue at once
+int test_task_submission_contention() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":32,\"max_concurrent\":4,\"queue_size\":64}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":4096,\"n_parallel\":4,\"n_predict\":4}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    const int num_threads = 16;
+    pthread_t threads[num_threads];
+    submission_thread_data_t thread_data[num_threads];
+
+    for (int i = 0; i < num_threads; i++) {
+        memset(&thread_data[i], 0, sizeof(thread_data[i]));
+        thread_data[i].backend_ctx = backend_ctx;
+        thread_data[i].rounds = 4;
+        err = wasi_init_execution_context(backend_ctx, g, &thread_data[i].exec_ctx);
+        ASSERT_SUCCESS(err, "Execution context initialization failed");
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < num_threads; i++) {
+        int result = pthread_create(&threads[i], NULL, submission_thread, &thread_data[i]);
+        ASSERT(result == 0, "Failed to create thread");
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+                        (end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+    double submit_us_total = 0.0, submit_us_max = 0.0;
+    int submissions = 0;
+    for (int i = 0; i < num_threads; i++) {
+        ASSERT_SUCCESS(thread_data[i].result, "Submission thread failed");
+        submit_us_total += thread_data[i].submit_us_total;
+        submissions += thread_data[i].rounds;
+        if (thread_data[i].submit_us_max > submit_us_max) {
+            submit_us_max = thread_data[i].submit_us_max;
+        }
+    }
+
+    wasi_nn_backend_stats stats;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    ASSERT(stats.tasks_completed >= (uint64_t)submissions, "Every submitted task should have run");
+    ASSERT(stats.tasks_rejected == 0, "No task should be rejected below queue_size");
+
+    printf("✅ %d threads, %d submissions in %.1f ms: compute() mean %.1f us, max %.1f us\n",
+           num_threads, submissions, elapsed_ms, submit_us_total / submissions, submit_us_max);
+
+    // Cleanup
+    for (int i = 0; i < num_threads; i++) {
+        wasi_close_execution_context(backend_ctx, thread_data[i].exec_ctx);
+    }
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+// Test 15: A tenant flooding the queue does not hold back another tenant
+int test_fair_scheduling() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    wasi_nn_error err;
+
+    // One processor, so queued turns run strictly one after another
+    const char *config = "{\"backend\":{\"max_sessions\":16,\"max_concurrent\":1,\"queue_size\":16,"
+                         "\"fair_scheduling_enabled\":true,\"tenant_weights\":{\"interactive\":2}}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":4096,\"n_parallel\":1,\"n_predict\":48}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    // Sessions join their tenant with a first short turn
+    const int num_batch = 6;
+    graph_execution_context batch_ctx[num_batch], interactive_ctx = 0;
+    char output[512];
+    uint32_t output_size;
+    tensor input;
+    setup_tensor(&input, "Hi.");
+    const char *batch_tenant = "{\"tenant\":\"batch\",\"max_tokens\":1}";
+    const char *interactive_tenant = "{\"tenant\":\"interactive\",\"max_tokens\":1}";
+    for (int i = 0; i <= num_batch; i++) {
+        graph_execution_context *exec_ctx = i < num_batch ? &batch_ctx[i] : &interactive_ctx;
+        const char *runtime_config = i < num_batch ? batch_tenant : interactive_tenant;
+        err = wasi_init_execution_context(backend_ctx, g, exec_ctx);
+        ASSERT_SUCCESS(err, "Execution context initialization failed");
+        output_size = sizeof(output) - 1;
+        err = wasi_run_inference(backend_ctx, *exec_ctx, 0, &input, (tensor_data)output, &output_size,
+                                 runtime_config, strlen(runtime_config));
+        ASSERT_SUCCESS(err, "Tenant setup turn failed");
+    }
+
+    wasi_nn_backend_stats stats;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    const uint64_t completed_before = stats.tasks_completed;
+
+    // The batch tenant queues all its turns before the interactive one arrives
+    tensor batch_input, interactive_input;
+    setup_tensor(&batch_input, "Write a long paragraph about the history of bridges.");
+    setup_tensor(&interactive_input, "What is 3 + 4?");
+    for (int i = 0; i < num_batch; i++) {
+        ASSERT_SUCCESS(wasi_set_input(backend_ctx, batch_ctx[i], 0, &batch_input), "set_input failed");
+        ASSERT_SUCCESS(wasi_compute(backend_ctx, batch_ctx[i]), "Batch compute failed");
+    }
+    ASSERT_SUCCESS(wasi_set_input(backend_ctx, interactive_ctx, 0, &interactive_input), "set_input failed");
+    ASSERT_SUCCESS(wasi_compute(backend_ctx, interactive_ctx), "Interactive compute failed");
+
+    output_size = sizeof(output) - 1;
+    err = wasi_get_output(backend_ctx, interactive_ctx, 0, (tensor_data)output, &output_size);
+    ASSERT_SUCCESS(err, "Interactive get_output failed");
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    const uint64_t ran_first = stats.tasks_completed - completed_before;
+    ASSERT(ran_first <= 3, "The interactive turn should not wait behind the whole batch backlog");
+
+    for (int i = 0; i < num_batch; i++) {
+        output_size = sizeof(output) - 1;
+        err = wasi_get_output(backend_ctx, batch_ctx[i], 0, (tensor_data)output, &output_size);
+        ASSERT_SUCCESS(err, "Batch get_output failed");
+    }
+    printf("✅ Interactive turn finished after %llu of %d queued turns\n",
+           (unsigned long long)ran_first, num_batch + 1);
+
+    // Cleanup
+    for (int i = 0; i < num_batch; i++) {
+        wasi_close_execution_context(backend_ctx, batch_ctx[i]);
+    }
+    wasi_close_execution_context(backend_ctx, interactive_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+// Test 16: A turn past its deadline stops decoding and returns its partial output
+int test_deadline_cancellation() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":4,\"max_concurrent\":1,\"queue_size\":8}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":4096,\"n_parallel\":1}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context(backend_ctx, g, &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    // Far more tokens than fit in the deadline
+    const uint32_t deadline_ms = 2000;
+    const char *runtime_config = "{\"deadline_ms\":2000,\"max_tokens\":3000,\"ignore_eos\":true}";
+    tensor input;
+    setup_tensor(&input, "Count from one to one thousand in words.");
+    char output[16384];
+    uint32_t output_size = sizeof(output) - 1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input, (tensor_data)output, &output_size,
+                             runtime_config, strlen(runtime_config));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+                        (end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+    ASSERT(err == timeout, "A turn past its deadline should return timeout");
+    ASSERT(output_size > 0, "The text generated before the deadline should be returned");
+    ASSERT(elapsed_ms < deadline_ms + 1000, "Decoding should stop soon after the deadline");
+
+    // The partial answer is kept, so the conversation carries on
+    const char *followup = "{\"max_tokens\":16}";
+    setup_tensor(&input, "Stop there. What number did you reach?");
+    output_size = sizeof(output) - 1;
+    err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input, (tensor_data)output, &output_size,
+                             followup, strlen(followup));
+    ASSERT_SUCCESS(err, "Turn after a deadline cut-off failed");
+
+    printf("✅ Turn stopped %.0f ms after submission (deadline %u ms) with partial output\n",
+           elapsed_ms, deadline_ms);
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+static void* low_priority_inference_thread(void* arg) {
+    inference_thread_data_t* data = (inference_thread_data_t*)arg;
+    const char *runtime_config = "{\"priority\":0,\"max_tokens\":512,\"ignore_eos\":true}";
+
+    tensor input_tensor;
+    setup_tensor(&input_tensor, data->prompt);
+
+    data->output_size = sizeof(data->output) - 1;
+    data->result = wasi_run_inference(data->backend_ctx, data->exec_ctx, 0, &input_tensor,
+                                      (uint8_t*)data->output, &data->output_size,
+                                      runtime_config, strlen(runtime_config));
+    return NULL;
+}
+
+// Test 17: An URGENT turn preempts a running LOW generation, which resumes afterwards
+int test_urgent_preemption() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context urgent_ctx = 0;
+    wasi_nn_error err;
+
+    // Default concurrency: one general processor and one regular KV sequence,
+    // both held by the LOW turn. The URGENT turn takes the urgent lane and the
+    // sequence reserved for it.
+    const char *config = "{\"backend\":{\"max_sessions\":4,\"queue_size\":8,\"preemption_enabled\":true}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":4096}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    // A long batch generation at LOW priority
+    inference_thread_data_t low_data;
+    memset(&low_data, 0, sizeof(low_data));
+    low_data.backend_ctx = backend_ctx;
+    low_data.prompt = "Write a long story about a lighthouse keeper.";
+    ASSERT_SUCCESS(wasi_init_execution_context(backend_ctx, g, &low_data.exec_ctx),
+                   "Execution context initialization failed");
+    ASSERT_SUCCESS(wasi_init_execution_context(backend_ctx, g, &urgent_ctx),
+                   "Execution context initialization failed");
+
+    pthread_t low_thread;
+    ASSERT(pthread_create(&low_thread, NULL, low_priority_inference_thread, &low_data) == 0,
+           "Failed to create thread");
+    usleep(500000);  // let it start generating
+
+    // The interactive turn arrives while the batch job is decoding
+    const char *urgent_config = "{\"priority\":3,\"max_tokens\":8}";
+    tensor urgent_input;
+    setup_tensor(&urgent_input, "What is 2 + 2?");
+    char urgent_output[512];
+    uint32_t urgent_size = sizeof(urgent_output) - 1;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    err = wasi_run_inference(backend_ctx, urgent_ctx, 0, &urgent_input, (tensor_data)urgent_output,
+                             &urgent_size, urgent_config, strlen(urgent_config));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double urgent_ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+                       (end.tv_nsec - start.tv_nsec) / 1000000.0;
+    ASSERT_SUCCESS(err, "URGENT inference failed");
+
+    wasi_nn_backend_stats stats;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    ASSERT(stats.n_slots == 2, "One regular and one reserved sequence expected with preemption enabled");
+    // Parking needs both turns in slots at once, so the URGENT turn did not wait for a sequence
+    ASSERT(stats.tasks_preempted >= 1, "The LOW generation should have been parked");
+
+    // The parked generation resumes and completes normally
+    pthread_join(low_thread, NULL);
+    ASSERT_SUCCESS(low_data.result, "LOW inference failed after preemption");
+    ASSERT(low_data.output_size > 0, "The resumed generation should produce output");
+
+    printf("✅ URGENT turn done in %.0f ms while a LOW generation was parked (%llu preemptions)\n",
+           urgent_ms, (unsigned long long)stats.tasks_preempted);
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, low_data.exec_ctx);
+    wasi_close_execution_context(backend_ctx, urgent_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+static void* cancellable_inference_thread(void* arg) {
+    inference_thread_data_t* data = (inference_thread_data_t*)arg;
+    const char *runtime_config = "{\"max_tokens\":2000,\"ignore_eos\":true}";
+
+    tensor input_tensor;
+    setup_tensor(&input_tensor, data->prompt);
+
+    data->output_size = sizeof(data->output) - 1;
+    data->result = wasi_run_inference(data->backend_ctx, data->exec_ctx, 0, &input_tensor,
+                                      (uint8_t*)data->output, &data->output_size,
+                                      runtime_config, strlen(runtime_config));
+    return NULL;
+}
+
+// Test 18: cancel_inference stops a running turn and returns its partial output
+int test_cancel_inference() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":4,\"max_concurrent\":2,\"queue_size\":8}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":4096,\"n_parallel\":2}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    inference_thread_data_t data;
+    memset(&data, 0, sizeof(data));
+    data.backend_ctx = backend_ctx;
+    data.prompt = "Count from one to one thousand in words.";
+    ASSERT_SUCCESS(wasi_init_execution_context(backend_ctx, g, &data.exec_ctx),
+                   "Execution context initialization failed");
+
+    // Cancelling an idle session is harmless and does not carry over to the next turn
+    ASSERT_SUCCESS(wasi_cancel_inference(backend_ctx, data.exec_ctx), "Cancelling an idle session failed");
+
+    pthread_t thread;
+    ASSERT(pthread_create(&thread, NULL, cancellable_inference_thread, &data) == 0,
+           "Failed to create thread");
+    usleep(1000000);  // let it generate for a while
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_SUCCESS(wasi_cancel_inference(backend_ctx, data.exec_ctx), "cancel_inference failed");
+    pthread_join(thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double cancel_ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+                       (end.tv_nsec - start.tv_nsec) / 1000000.0;
+
+    ASSERT(data.result == cancelled, "A cancelled turn should return cancelled");
+    ASSERT(data.output_size > 0, "The text generated before the cancel should be returned");
+    ASSERT(cancel_ms < 1000, "The cancelled call should return within a few decode steps");
+
+    // The session carries on with the partial answer in its history
+    const char *followup = "{\"max_tokens\":16}";
+    tensor input;
+    setup_tensor(&input, "Where did you stop?");
+    char output[512];
+    uint32_t output_size = sizeof(output) - 1;
+    err = wasi_run_inference(backend_ctx, data.exec_ctx, 0, &input, (tensor_data)output, &output_size,
+                             followup, strlen(followup));
+    ASSERT_SUCCESS(err, "Turn after a cancel failed");
+
+    printf("✅ Cancelled turn returned after %.0f ms with %u bytes of partial output\n",
+           cancel_ms, data.output_size);
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, data.exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+// Test 19: a turn cancelled while queued leaves no phantom active task behind
+int test_cancel_queued_turn() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    wasi_nn_error err;
+
+    // Two task processors: the third turn has to wait in the queue
+    const char *config = "{\"backend\":{\"max_sessions\":4,\"max_concurrent\":2,\"queue_size\":8}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":49,\"ctx_size\":4096,\"n_parallel\":2}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    inference_thread_data_t data[3];
+    pthread_t threads[3];
+    memset(data, 0, sizeof(data));
+    for (int i = 0; i < 3; i++) {
+        data[i].backend_ctx = backend_ctx;
+        data[i].prompt = "Count from one to one thousand in words.";
+        ASSERT_SUCCESS(wasi_init_execution_context(backend_ctx, g, &data[i].exec_ctx),
+                       "Execution context initialization failed");
+    }
+    for (int i = 0; i < 3; i++) {
+        ASSERT(pthread_create(&threads[i], NULL, cancellable_inference_thread, &data[i]) == 0,
+               "Failed to create thread");
+        usleep(300000);  // keep the submission order
+    }
+
+    wasi_nn_backend_stats stats;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting backend stats failed");
+    ASSERT(stats.tasks_pending == 1 && stats.tasks_active == 2, "Two turns should run and one wait");
+
+    // Cancel the queued turn, then the running ones
+    ASSERT_SUCCESS(wasi_cancel_inference(backend_ctx, data[2].exec_ctx), "cancel_inference failed");
+    pthread_join(threads[2], NULL);
+    ASSERT(data[2].result == cancelled, "A queued turn should be cancelled");
+    for (int i = 0; i < 2; i++) {
+        ASSERT_SUCCESS(wasi_cancel_inference(backend_ctx, data[i].exec_ctx), "cancel_inference failed");
+        pthread_join(threads[i], NULL);
+        ASSERT(data[i].result == cancelled, "A running turn should be cancelled");
+    }
+
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting backend stats failed");
+    ASSERT(stats.tasks_cancelled == 1, "The queued turn should count as cancelled");
+    ASSERT(stats.tasks_pending == 0 && stats.tasks_active == 0, "No task should be left active");
+    printf("✅ Queue drained after cancels: %u pending, %u active, %llu cancelled\n",
+           stats.tasks_pending, stats.tasks_active, (unsigned long long)stats.tasks_cancelled);
+
+    // Cleanup
+    for (int i = 0; i < 3; i++) {
+        wasi_close_execution_context(backend_ctx, data[i].exec_ctx);
+    }
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
@@ -249,3 +249,881 @@ int test_concurrency_management() {
 
     return 1;
 }
+
+// Test 12: Interleaved sessions keep isolated KV sequences
+int test_interleaved_session_sequences() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"max_concurrent\":2}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    // Two KV sequences for three sessions forces LRU rebinding
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":2048,\"n_parallel\":2,\"n_predict\":32}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    const char *session_names[] = {"seq_alice", "seq_bob", "seq_carol"};
+    const char *introductions[] = {
+        "Hello, my name is Alice.",
+        "Hello, my name is Bob.",
+        "Hello, my name is Carol."
+    };
+    graph_execution_context exec_ctxs[3];
+
+    for (int i = 0; i < 3; i++) {
+        err = wasi_init_execution_context_with_session_id(backend_ctx, session_names[i], &exec_ctxs[i]);
+        ASSERT_SUCCESS(err, "Execution context initialization failed");
+    }
+
+    // First turn for every session, interleaved
+    for (int i = 0; i < 3; i++) {
+        tensor input_tensor;
+        setup_tensor(&input_tensor, introductions[i]);
+
+        uint8_t output_buffer[512];
+        uint32_t output_size = sizeof(output_buffer);
+
+        err = wasi_run_inference(backend_ctx, exec_ctxs[i], 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+        ASSERT_SUCCESS(err, "First turn inference failed");
+        ASSERT(output_size > 0, "No output generated on first turn");
+    }
+
+    // Second turn: the evicted session re-prefills, the others reuse their cache
+    for (int i = 0; i < 3; i++) {
+        tensor input_tensor;
+        setup_tensor(&input_tensor, "What is my name?");
+
+        uint8_t output_buffer[512];
+        uint32_t output_size = sizeof(output_buffer);
+
+        err = wasi_run_inference(backend_ctx, exec_ctxs[i], 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+        ASSERT_SUCCESS(err, "Second turn inference failed");
+        ASSERT(output_size > 0, "No output generated on second turn");
+
+        printf("✅ Session '%s' response: %.60s%s\n", session_names[i],
+               (char*)output_buffer, output_size > 60 ? "..." : "");
+    }
+
+    // Closing one session must not disturb the others
+    err = wasi_close_execution_context(backend_ctx, exec_ctxs[0]);
+    ASSERT_SUCCESS(err, "Closing session failed");
+
+    tensor input_tensor;
+    setup_tensor(&input_tensor, "Repeat my name once more.");
+
+    uint8_t output_buffer[512];
+    uint32_t output_size = sizeof(output_buffer);
+
+    err = wasi_run_inference(backend_ctx, exec_ctxs[1], 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Inference after closing another session failed");
+
+    printf("✅ Interleaved sessions kept isolated KV sequences\n");
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctxs[1]);
+    wasi_close_execution_context(backend_ctx, exec_ctxs[2]);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+// Shared preamble long enough to clear prefix_cache_min_tokens
+#define SHARED_PREFIX_PREAMBLE \
+    "You are a support assistant for the Hawk Cloud platform. Hawk Cloud offers compute " \
+    "instances, object storage, managed databases and a global CDN. Always answer in one " \
+    "short sentence, never invent features, and refer billing questions to the billing " \
+    "team. Instance types: h1.small (2 vCPU, 4 GB), h1.medium (4 vCPU, 8 GB), h1.large " \
+    "(8 vCPU, 16 GB). Storage is billed per GB-month. Question: "
+
+static int run_shared_prefix_sessions(int enable_prefix_cache, char *second_output, size_t output_capacity,
+                                      uint64_t prefilled[2], uint64_t *prefix_cache_hits) {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    wasi_nn_error err;
+
+    char config[256];
+    snprintf(config, sizeof(config),
+             "{\"backend\":{\"max_sessions\":10,\"max_concurrent\":2},"
+             "\"memory\":{\"enable_prefix_cache\":%s,\"prefix_cache_min_tokens\":16}}",
+             enable_prefix_cache ? "true" : "false");
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"model\":{\"n_gpu_layers\":98,\"ctx_size\":2048,\"n_parallel\":2,\"n_predict\":24},"
+                               "\"sampling\":{\"temperature\":0.0,\"top_k\":1}}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    const char *session_names[] = {"prefix_first", "prefix_second"};
+    const char *prompts[] = {
+        SHARED_PREFIX_PREAMBLE "How many vCPUs does h1.medium have?",
+        SHARED_PREFIX_PREAMBLE "How much memory does h1.large have?"
+    };
+
+    for (int i = 0; i < 2; i++) {
+        graph_execution_context exec_ctx = 0;
+        err = wasi_init_execution_context_with_session_id(backend_ctx, session_names[i], &exec_ctx);
+        ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+        tensor input_tensor;
+        setup_tensor(&input_tensor, prompts[i]);
+
+        uint8_t output_buffer[512];
+        uint32_t output_size = sizeof(output_buffer) - 1;
+        err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+        ASSERT_SUCCESS(err, "Inference failed");
+        ASSERT(output_size > 0, "No output generated");
+
+        wasi_nn_backend_stats stats;
+        ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, exec_ctx, &stats), "Getting stats failed");
+        prefilled[i] = stats.n_prompt_tokens - stats.n_prompt_tokens_reused;
+
+        if (i == 1) {
+            size_t n = output_size < output_capacity - 1 ? output_size : output_capacity - 1;
+            memcpy(second_output, output_buffer, n);
+            second_output[n] = '\0';
+        }
+    }
+
+    wasi_nn_backend_stats stats;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    *prefix_cache_hits = stats.prefix_cache_hits;
+
+    wasi_deinit_backend(backend_ctx);
+    return 1;
+}
+
+int test_shared_prefix_cache() {
+    char shared_output[512];
+    char baseline_output[512];
+    uint64_t shared_prefilled[2] = {0, 0};
+    uint64_t baseline_prefilled[2] = {0, 0};
+    uint64_t shared_hits = 0, baseline_hits = 0;
+
+    // The second session copies the preamble from the first one's KV sequence
+    ASSERT(run_shared_prefix_sessions(1, shared_output, sizeof(shared_output), shared_prefilled, &shared_hits),
+           "Sessions with prefix cache failed");
+    ASSERT(shared_hits > 0, "The second session should hit the prefix cache");
+    ASSERT(shared_prefilled[1] < shared_prefilled[0],
+           "The second session should prefill fewer tokens than the first");
+
+    // Baseline: the second session prefills the whole prompt itself
+    ASSERT(run_shared_prefix_sessions(0, baseline_output, sizeof(baseline_output), baseline_prefilled, &baseline_hits),
+           "Sessions without prefix cache failed");
+    ASSERT(baseline_hits == 0, "The prefix cache was disabled");
+
+    printf("✅ Prefilled %llu then %llu tokens with prefix cache, %llu then %llu without\n",
+           (unsigned long long)shared_prefilled[0], (unsigned long long)shared_prefilled[1],
+           (unsigned long long)baseline_prefilled[0], (unsigned long long)baseline_prefilled[1]);
+
+    printf("✅ With prefix cache:    %.60s\n", shared_output);
+    printf("✅ Without prefix cache: %.60s\n", baseline_output);
+
+    // Greedy decoding over a copied prefix must match a full prefill
+    ASSERT(strcmp(shared_output, baseline_output) == 0,
+           "Copied prefix changed the generated output");
+
+    return 1;
+}
+
+int test_session_persistence() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"session_cache_dir\":\"/tmp/wasi_nn_session_test\"}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":2048,\"n_predict\":32}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "persistent_user", &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    tensor input_tensor;
+    setup_tensor(&input_tensor, "Please remember this: my favourite colour is teal.");
+
+    uint8_t output_buffer[512];
+    uint32_t output_size = sizeof(output_buffer) - 1;
+    err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "First turn inference failed");
+
+    err = wasi_save_session_state(backend_ctx, exec_ctx);
+    ASSERT_SUCCESS(err, "Saving session state failed");
+
+    // Closing saves the session as well; reopening the same ID resumes it
+    err = wasi_close_execution_context(backend_ctx, exec_ctx);
+    ASSERT_SUCCESS(err, "Closing session failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "persistent_user", &exec_ctx);
+    ASSERT_SUCCESS(err, "Reopening session failed");
+
+    setup_tensor(&input_tensor, "What is my favourite colour?");
+    output_size = sizeof(output_buffer) - 1;
+    err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Inference after resume failed");
+    ASSERT(output_size > 0, "No output generated after resume");
+    output_buffer[output_size < sizeof(output_buffer) ? output_size : sizeof(output_buffer) - 1] = '\0';
+    printf("✅ Resumed session response: %.60s%s\n", (char*)output_buffer, output_size > 60 ? "..." : "");
+
+    // Explicit restore of an existing session
+    err = wasi_restore_session_state(backend_ctx, exec_ctx);
+    ASSERT_SUCCESS(err, "Restoring session state failed");
+
+    // Nothing was saved for this session
+    graph_execution_context fresh_ctx = 0;
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "never_saved_user", &fresh_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+    err = wasi_restore_session_state(backend_ctx, fresh_ctx);
+    ASSERT(err != 0, "Restoring an unsaved session should fail");
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, fresh_ctx);
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_context_shift_long_conversation() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10},"
+                         "\"memory\":{\"context_shifting\":true,\"n_keep_tokens\":64}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    // A small single-slot context so the conversation overflows after a few turns
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":512,\"n_parallel\":1,\"n_predict\":48}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "long_conversation_user", &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    tensor input_tensor;
+    uint8_t output_buffer[1024];
+    char message[256];
+    for (int turn = 1; turn <= 12; turn++) {
+        snprintf(message, sizeof(message),
+                 "Turn %d: tell me one short fact about the number %d, in a single sentence.",
+                 turn, turn * 7);
+        setup_tensor(&input_tensor, message);
+
+        uint32_t output_size = sizeof(output_buffer) - 1;
+        err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+        ASSERT_SUCCESS(err, "Inference failed while the context was shifting");
+        ASSERT(output_size > 0, "No output generated after a context shift");
+    }
+    printf("✅ 12 turns completed in a 512-token context\n");
+
+    wasi_nn_backend_stats stats;
+    err = wasi_get_backend_stats(backend_ctx, exec_ctx, &stats);
+    ASSERT_SUCCESS(err, "Backend stats failed");
+    ASSERT(stats.context_shifts > 0, "The conversation should have outgrown the context and been shifted");
+    ASSERT(stats.n_prompt_tokens > 512, "The turns together should have submitted more than the context holds");
+    ASSERT(stats.kv_tokens_spanned <= 512, "The session's sequence should stay within ctx_size");
+    printf("✅ %llu context shifts, sequence at %llu of 512 tokens\n",
+           (unsigned long long)stats.context_shifts, (unsigned long long)stats.kv_tokens_spanned);
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_sink_window_streaming() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    // Attention sinks plus a 256-token recent window in a 512-token slot
+    const char *config = "{\"backend\":{\"max_sessions\":10},"
+                         "\"memory\":{\"context_shifting\":true,\"cache_strategy\":\"smart\","
+                         "\"n_keep_tokens\":0,\"kv_sink_tokens\":4,\"kv_window_tokens\":256}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":512,\"n_parallel\":1,\"n_predict\":32}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "streaming_window_user", &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    // Per-token latency of the first and the last turns; with a bounded
+    // sequence the late turns should not get slower as the conversation grows
+    const int n_turns = 24;
+    const int n_measured = 4;
+    double early_ms = 0.0, late_ms = 0.0;
+    uint64_t early_tokens = 0, late_tokens = 0, max_kv_tokens = 0, total_tokens = 0;
+    // BOS + 4 sinks + 256 recent tokens, plus the n_predict reserve of a turn
+    const uint64_t kv_bound = 1 + 4 + 256 + 32;
+
+    tensor input_tensor;
+    uint8_t output_buffer[1024];
+    char message[256];
+    for (int turn = 1; turn <= n_turns; turn++) {
+        snprintf(message, sizeof(message),
+                 "Turn %d: tell me one short fact about the number %d, in a single sentence.",
+                 turn, turn * 11);
+        setup_tensor(&input_tensor, message);
+
+        wasi_nn_speculative_stats before, after;
+        ASSERT_SUCCESS(wasi_get_speculative_stats(backend_ctx, exec_ctx, &before), "Getting stats failed");
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint32_t output_size = sizeof(output_buffer) - 1;
+        err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ASSERT_SUCCESS(err, "Inference failed while streaming past the context size");
+
+        ASSERT_SUCCESS(wasi_get_speculative_stats(backend_ctx, exec_ctx, &after), "Getting stats failed");
+        const double elapsed_ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+                                  (end.tv_nsec - start.tv_nsec) / 1000000.0;
+        const uint64_t n_tokens = after.n_generated_tokens - before.n_generated_tokens;
+        total_tokens += n_tokens;
+        if (turn <= n_measured) {
+            early_ms += elapsed_ms;
+            early_tokens += n_tokens;
+        } else if (turn > n_turns - n_measured) {
+            late_ms += elapsed_ms;
+            late_tokens += n_tokens;
+        }
+
+        wasi_nn_backend_stats stats;
+        ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, exec_ctx, &stats), "Getting backend stats failed");
+        if (stats.kv_tokens_spanned > max_kv_tokens) {
+            max_kv_tokens = stats.kv_tokens_spanned;
+        }
+        ASSERT(stats.kv_tokens_spanned <= kv_bound, "The sequence should settle at sinks plus the recent window");
+    }
+
+    ASSERT(total_tokens > kv_bound, "The conversation should run past the window");
+    ASSERT(early_tokens > 0 && late_tokens > 0, "Turns should generate tokens");
+    const double early_per_token = early_ms / early_tokens;
+    const double late_per_token = late_ms / late_tokens;
+    printf("✅ %d turns, at most %llu KV tokens: %.2f ms/token early, %.2f ms/token late\n",
+           n_turns, (unsigned long long)max_kv_tokens, early_per_token, late_per_token);
+    ASSERT(late_per_token < early_per_token * 2.0, "Per-token latency should stay flat as the conversation grows");
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_history_token_budget() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"history_max_tokens\":256,"
+                         "\"history_truncation\":\"drop_oldest\"}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":2048,\"n_parallel\":1,\"n_predict\":32}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "history_budget_user", &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    // Well past the budget: each turn's prompt must stay within it
+    tensor input_tensor;
+    uint8_t output_buffer[1024];
+    char message[256];
+    uint64_t max_prompt_tokens = 0;
+    for (int turn = 1; turn <= 16; turn++) {
+        snprintf(message, sizeof(message),
+                 "Turn %d: name a city that starts with the letter %c, in one word.", turn, 'A' + turn);
+        setup_tensor(&input_tensor, message);
+
+        wasi_nn_backend_stats before, after;
+        ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, exec_ctx, &before), "Getting stats failed");
+        uint32_t output_size = sizeof(output_buffer) - 1;
+        err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+        ASSERT_SUCCESS(err, "Inference failed with a bounded history");
+        ASSERT(output_size > 0, "No output generated with a bounded history");
+        ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, exec_ctx, &after), "Getting stats failed");
+
+        const uint64_t n_prompt = after.n_prompt_tokens - before.n_prompt_tokens;
+        if (n_prompt > max_prompt_tokens) {
+            max_prompt_tokens = n_prompt;
+        }
+    }
+    ASSERT(max_prompt_tokens <= 256, "Prompts should stay within history_max_tokens");
+    printf("✅ 16 turns, largest prompt %llu tokens (budget 256)\n", (unsigned long long)max_prompt_tokens);
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_request_arena_reuse() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":2048,\"n_parallel\":1,\"n_predict\":16}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "arena_user", &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    // Same-sized runtime configs: after the first request the arena has its blocks
+    const char *runtime_config = "{\"temperature\":0.2,\"top_p\":0.9,\"max_tokens\":16}";
+    tensor input_tensor;
+    uint8_t output_buffer[512];
+    wasi_nn_backend_stats warm, stats;
+    for (int turn = 0; turn < 4; turn++) {
+        setup_tensor(&input_tensor, "Say one word.");
+        uint32_t output_size = sizeof(output_buffer) - 1;
+        err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size,
+                                 runtime_config, strlen(runtime_config));
+        ASSERT_SUCCESS(err, "Inference with a runtime config failed");
+        if (turn == 0) {
+            ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &warm), "Getting stats failed");
+        }
+    }
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+
+    ASSERT(stats.arena_requests >= warm.arena_requests + 3, "Each runtime config should use the arena");
+    ASSERT(stats.arena_peak_bytes > 0, "Arena use should be recorded");
+    ASSERT(stats.arena_heap_allocs == warm.arena_heap_allocs, "A warm arena should not take heap blocks");
+    printf("✅ %llu arena requests, %llu heap blocks, peak %llu bytes, %llu scratch regrowths\n",
+           (unsigned long long)stats.arena_requests, (unsigned long long)stats.arena_heap_allocs,
+           (unsigned long long)stats.arena_peak_bytes, (unsigned long long)stats.scratch_reallocs);
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_shared_model_registry() {
+    void *first_backend = NULL, *second_backend = NULL;
+    graph g1 = 0, g2 = 0;
+    graph_execution_context first_ctx = 0, second_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"share_models\":true}}";
+    err = wasi_init_backend_with_config(&first_backend, config, strlen(config));
+    ASSERT_SUCCESS(err, "First backend initialization failed");
+    err = wasi_init_backend_with_config(&second_backend, config, strlen(config));
+    ASSERT_SUCCESS(err, "Second backend initialization failed");
+
+    // Same file and GPU placement; the context sizes may differ
+    const char *first_model_config = "{\"n_gpu_layers\":98,\"ctx_size\":2048,\"n_parallel\":1,\"n_predict\":16}";
+    const char *second_model_config = "{\"n_gpu_layers\":98,\"ctx_size\":1024,\"n_parallel\":1,\"n_predict\":16}";
+    err = wasi_load_by_name_with_config(first_backend, MODEL_FILE, strlen(MODEL_FILE),
+                                        first_model_config, strlen(first_model_config), &g1);
+    ASSERT_SUCCESS(err, "First model loading failed");
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    err = wasi_load_by_name_with_config(second_backend, MODEL_FILE, strlen(MODEL_FILE),
+                                        second_model_config, strlen(second_model_config), &g2);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ASSERT_SUCCESS(err, "Second model loading failed");
+    const double second_load_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    wasi_nn_backend_stats stats;
+    ASSERT_SUCCESS(wasi_get_backend_stats(second_backend, 0, &stats), "Getting stats failed");
+    ASSERT(stats.model_shared_refs == 2, "Both backends should hold the same model");
+
+    err = wasi_init_execution_context_with_session_id(first_backend, "shared_model_user_1", &first_ctx);
+    ASSERT_SUCCESS(err, "First execution context initialization failed");
+    err = wasi_init_execution_context_with_session_id(second_backend, "shared_model_user_2", &second_ctx);
+    ASSERT_SUCCESS(err, "Second execution context initialization failed");
+
+    tensor input_tensor;
+    uint8_t output_buffer[512];
+    uint32_t output_size = sizeof(output_buffer) - 1;
+    setup_tensor(&input_tensor, "Say hello.");
+    err = wasi_run_inference(first_backend, first_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Inference on the first backend failed");
+
+    // The weights stay alive for the remaining backend
+    wasi_close_execution_context(first_backend, first_ctx);
+    wasi_deinit_backend(first_backend);
+
+    output_size = sizeof(output_buffer) - 1;
+    err = wasi_run_inference(second_backend, second_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Inference after the other backend was released failed");
+    ASSERT(output_size > 0, "No output from the remaining backend");
+    ASSERT_SUCCESS(wasi_get_backend_stats(second_backend, 0, &stats), "Getting stats failed");
+    ASSERT(stats.model_shared_refs == 1, "Only the remaining backend should hold the model");
+    printf("✅ Second backend attached to the loaded model in %.1f ms\n", second_load_ms);
+
+    // Cleanup
+    wasi_close_execution_context(second_backend, second_ctx);
+    wasi_deinit_backend(second_backend);
+
+    return 1;
+}
+
+int test_kv_admission_control() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"admission_policy\":\"reject\"},"
+                         "\"memory_policy\":{\"context_shifting\":false}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":512,\"n_parallel\":1,\"n_predict\":16}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "admission_user", &exec_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    tensor input_tensor;
+    uint8_t output_buffer[512];
+    uint32_t output_size;
+    wasi_nn_backend_stats before, after;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, exec_ctx, &before), "Getting stats failed");
+
+    // A prompt larger than the slot is refused before it is decoded
+    static char long_prompt[16384];
+    size_t len = 0;
+    while (len + 32 < sizeof(long_prompt)) {
+        len += snprintf(long_prompt + len, sizeof(long_prompt) - len, "word%zu ", len);
+    }
+    setup_tensor(&input_tensor, long_prompt);
+    output_size = sizeof(output_buffer) - 1;
+    err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT(err == too_large, "A prompt larger than the slot should be refused with too_large");
+
+    // So is an output budget that cannot fit without context shifting
+    const char *runtime_config = "{\"max_tokens\":4096}";
+    setup_tensor(&input_tensor, "Count to ten.");
+    output_size = sizeof(output_buffer) - 1;
+    err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size,
+                             runtime_config, strlen(runtime_config));
+    ASSERT(err == too_large, "max_tokens beyond the slot should be refused with too_large");
+
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, exec_ctx, &after), "Getting stats failed");
+    ASSERT(after.admission_rejections >= before.admission_rejections + 2, "Both refusals should be counted");
+    ASSERT(after.n_prompt_tokens == before.n_prompt_tokens, "Refused turns should not reach the engine");
+
+    // Refused turns leave the session usable
+    setup_tensor(&input_tensor, "Say hello.");
+    output_size = sizeof(output_buffer) - 1;
+    err = wasi_run_inference(backend_ctx, exec_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "A turn that fits should be admitted");
+    ASSERT(output_size > 0, "No output from the admitted turn");
+    printf("✅ %llu refusals, admitted turn produced %u bytes\n",
+           (unsigned long long)after.admission_rejections, output_size);
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, exec_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_idle_kv_compaction() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context first_ctx = 0, second_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"kv_offload\":false,\"kv_compaction\":true,"
+                         "\"kv_compaction_idle_ms\":200,\"kv_compaction_threshold\":0.05},"
+                         "\"memory\":{\"memory_sample_interval_ms\":100}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":2048,\"n_parallel\":2,\"n_predict\":16}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "compaction_user_1", &first_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "compaction_user_2", &second_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    tensor input_tensor;
+    uint8_t output_buffer[512];
+    uint32_t output_size;
+    const char *prompts[] = {"Tell me a fact about rivers.", "Tell me a fact about mountains."};
+    for (int turn = 0; turn < 2; turn++) {
+        setup_tensor(&input_tensor, prompts[turn]);
+        output_size = sizeof(output_buffer) - 1;
+        err = wasi_run_inference(backend_ctx, first_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+        ASSERT_SUCCESS(err, "First session inference failed");
+        output_size = sizeof(output_buffer) - 1;
+        err = wasi_run_inference(backend_ctx, second_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+        ASSERT_SUCCESS(err, "Second session inference failed");
+    }
+
+    // Closing one session frees its cells between those of the other
+    wasi_close_execution_context(backend_ctx, first_ctx);
+    wasi_nn_backend_stats stats;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    ASSERT(stats.kv_fragmentation > 0.0, "Freed cells should show up as fragmentation");
+    const double fragmentation = stats.kv_fragmentation;
+    const uint64_t kv_tokens_before = stats.kv_tokens_spanned;
+
+    usleep(1000 * 1000);
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    ASSERT(stats.kv_compactions >= 1, "The idle backend should have compacted its KV cache");
+    ASSERT(stats.kv_fragmentation_before_compaction >= 0.05,
+           "Compaction should only run over kv_compaction_threshold");
+    ASSERT(stats.kv_fragmentation_after_compaction < stats.kv_fragmentation_before_compaction,
+           "Compaction should leave fewer holes than it found");
+    ASSERT(stats.kv_tokens_spanned == kv_tokens_before, "Compaction should keep every sequence");
+
+    // The remaining session keeps its cache across the compaction
+    const uint64_t reused_before = stats.n_prompt_tokens_reused;
+    setup_tensor(&input_tensor, "And one about lakes.");
+    output_size = sizeof(output_buffer) - 1;
+    err = wasi_run_inference(backend_ctx, second_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Inference after compaction failed");
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting stats failed");
+    ASSERT(stats.n_prompt_tokens_reused > reused_before, "The compacted sequence should still be reused");
+    printf("✅ Fragmentation %.1f%% -> %.1f%% in %.2f ms\n", fragmentation * 100.0,
+           stats.kv_fragmentation_after_compaction * 100.0, stats.kv_compaction_ms);
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, second_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_backend_stats() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context first_ctx = 0, second_ctx = 0;
+    wasi_nn_error err;
+
+    const char *config = "{\"backend\":{\"max_sessions\":10}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":2048,\"n_parallel\":2,\"n_predict\":16}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "stats_user_1", &first_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "stats_user_2", &second_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    wasi_nn_backend_stats stats;
+    err = wasi_get_backend_stats(backend_ctx, 0, &stats);
+    ASSERT_SUCCESS(err, "Getting backend stats failed");
+    ASSERT(stats.n_sessions == 2, "Both sessions should be counted");
+    ASSERT(stats.kv_cells_total > 0 && stats.kv_bytes_per_token > 0, "KV cache size should be known");
+    ASSERT(stats.kv_tokens_spanned == 0, "No tokens should be cached before the first turn");
+
+    tensor input_tensor;
+    uint8_t output_buffer[512];
+    uint32_t output_size = sizeof(output_buffer) - 1;
+    setup_tensor(&input_tensor, "Name three primary colours.");
+    err = wasi_run_inference(backend_ctx, first_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "First session inference failed");
+
+    output_size = sizeof(output_buffer) - 1;
+    setup_tensor(&input_tensor, "Write a haiku about autumn leaves falling in a quiet park.");
+    err = wasi_run_inference(backend_ctx, second_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Second session inference failed");
+
+    wasi_nn_backend_stats first, second;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, first_ctx, &first), "Getting session stats failed");
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, second_ctx, &second), "Getting session stats failed");
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting backend stats failed");
+
+    ASSERT(first.kv_tokens_spanned > 0 && second.kv_tokens_spanned > 0, "Each session should hold KV tokens");
+    ASSERT(first.kv_tokens_spanned <= first.n_prompt_tokens + 16, "Session KV tokens exceed prompt plus output");
+    ASSERT(stats.kv_tokens_spanned == first.kv_tokens_spanned + second.kv_tokens_spanned,
+           "Backend KV tokens should be the sum over sessions");
+    ASSERT(stats.kv_bytes_spanned == stats.kv_tokens_spanned * stats.kv_bytes_per_token, "KV bytes should follow tokens");
+    ASSERT(stats.n_sessions_bound == 2, "Both sessions should hold a KV sequence");
+    printf("✅ KV: %llu/%u tokens (%.1f%%), %.1f MiB of %.1f MiB\n",
+           (unsigned long long)stats.kv_tokens_spanned, stats.kv_cells_total, stats.kv_usage * 100.0,
+           stats.kv_bytes_spanned / (1024.0 * 1024.0), stats.kv_bytes_total / (1024.0 * 1024.0));
+
+    err = wasi_get_backend_stats(backend_ctx, 9999, &stats);
+    ASSERT(err != 0, "Stats for an unknown execution context should fail");
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, first_ctx);
+    wasi_close_execution_context(backend_ctx, second_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_memory_governor_eviction() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context exec_ctxs[4] = {0};
+    wasi_nn_error err;
+
+    // A limit far below the model size keeps the governor at critical pressure
+    const char *config = "{\"backend\":{\"max_sessions\":10},"
+                         "\"memory\":{\"max_memory_mb\":64,\"memory_sample_interval_ms\":100}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        MODEL_CONFIG, strlen(MODEL_CONFIG), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    char session_id[32];
+    for (int i = 0; i < 4; i++) {
+        snprintf(session_id, sizeof(session_id), "governor_user_%d", i);
+        err = wasi_init_execution_context_with_session_id(backend_ctx, session_id, &exec_ctxs[i]);
+        ASSERT_SUCCESS(err, "Execution context initialization failed");
+    }
+
+    usleep(500000);  // several governor samples
+
+    wasi_nn_backend_stats stats;
+    err = wasi_get_backend_stats(backend_ctx, 0, &stats);
+    ASSERT_SUCCESS(err, "Getting backend stats failed");
+    ASSERT(stats.memory_limit_bytes == 64ull * 1024 * 1024, "Configured limit should be published");
+    ASSERT(stats.memory_usage_bytes > stats.memory_limit_bytes, "Usage should exceed the tiny limit");
+    ASSERT(stats.memory_pressure_level == 2, "Governor should report critical pressure");
+    ASSERT(stats.n_sessions < 4, "Idle sessions should have been evicted");
+    ASSERT(stats.n_sessions > 0, "One pressure episode should evict only half of the idle sessions");
+    const uint32_t n_left = stats.n_sessions;
+    printf("✅ Critical pressure at %.1f MiB, %u of 4 idle sessions left\n",
+           stats.memory_usage_bytes / (1024.0 * 1024.0), n_left);
+
+    // Pressure persists, but the episode has been relieved already
+    usleep(500000);
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting backend stats failed");
+    ASSERT(stats.n_sessions == n_left, "Sessions should not be evicted again within the same episode");
+
+    // Evicted handles report it, and closing them still works
+    uint32_t n_evicted = 0;
+    for (int i = 0; i < 4; i++) {
+        wasi_nn_backend_stats session_stats;
+        err = wasi_get_backend_stats(backend_ctx, exec_ctxs[i], &session_stats);
+        if (err == session_evicted) {
+            n_evicted++;
+        } else {
+            ASSERT_SUCCESS(err, "Live session stats failed");
+        }
+    }
+    ASSERT(n_evicted == 4 - n_left, "Every evicted handle should return session_evicted");
+    for (int i = 0; i < 4; i++) {
+        ASSERT_SUCCESS(wasi_close_execution_context(backend_ctx, exec_ctxs[i]), "Closing a handle failed");
+    }
+    printf("✅ %u evicted handles returned session_evicted\n", n_evicted);
+
+    // Cleanup
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}
+
+int test_kv_offload_tiers() {
+    void *backend_ctx = NULL;
+    graph g = 0;
+    graph_execution_context first_ctx = 0, second_ctx = 0;
+    wasi_nn_error err;
+
+    // A 0 MiB RAM tier sends every snapshot straight to disk
+    const char *config = "{\"backend\":{\"max_sessions\":10,\"kv_offload\":true,\"kv_offload_idle_ms\":0,"
+                         "\"kv_offload_ram_mb\":0,\"kv_offload_dir\":\"/tmp/wasi_nn_test_offload\"},"
+                         "\"memory\":{\"memory_sample_interval_ms\":100}}";
+    err = wasi_init_backend_with_config(&backend_ctx, config, strlen(config));
+    ASSERT_SUCCESS(err, "Backend initialization failed");
+
+    // One sequence: the second session has to take it from the first
+    const char *model_config = "{\"n_gpu_layers\":98,\"ctx_size\":2048,\"n_parallel\":1,\"n_predict\":16}";
+    err = wasi_load_by_name_with_config(backend_ctx, MODEL_FILE, strlen(MODEL_FILE),
+                                        model_config, strlen(model_config), &g);
+    ASSERT_SUCCESS(err, "Model loading failed");
+
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "offload_user_1", &first_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+    err = wasi_init_execution_context_with_session_id(backend_ctx, "offload_user_2", &second_ctx);
+    ASSERT_SUCCESS(err, "Execution context initialization failed");
+
+    tensor input_tensor;
+    uint8_t output_buffer[512];
+    uint32_t output_size = sizeof(output_buffer) - 1;
+    setup_tensor(&input_tensor, "My favourite animal is the otter. Remember that.");
+    err = wasi_run_inference(backend_ctx, first_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "First session inference failed");
+
+    output_size = sizeof(output_buffer) - 1;
+    setup_tensor(&input_tensor, "Write a haiku about autumn leaves.");
+    err = wasi_run_inference(backend_ctx, second_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Second session inference failed");
+
+    wasi_nn_backend_stats stats;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting backend stats failed");
+    ASSERT(stats.n_sessions_kv_ram + stats.n_sessions_kv_disk == 1, "The first session should be offloaded");
+
+    usleep(500000);  // several governor ticks
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting backend stats failed");
+    ASSERT(stats.n_sessions_kv_disk == 1 && stats.kv_offload_ram_bytes == 0,
+           "The snapshot should have moved to disk");
+
+    wasi_nn_backend_stats before, after;
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, first_ctx, &before), "Getting session stats failed");
+    output_size = sizeof(output_buffer) - 1;
+    setup_tensor(&input_tensor, "Which animal did I mention?");
+    err = wasi_run_inference(backend_ctx, first_ctx, 0, &input_tensor, output_buffer, &output_size, NULL, 0);
+    ASSERT_SUCCESS(err, "Resumed session inference failed");
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, first_ctx, &after), "Getting session stats failed");
+    ASSERT_SUCCESS(wasi_get_backend_stats(backend_ctx, 0, &stats), "Getting backend stats failed");
+
+    ASSERT(stats.kv_offload_restores == 1, "The first session should resume from its offloaded state");
+    ASSERT(after.n_prompt_tokens_reused > before.n_prompt_tokens_reused,
+           "The resumed turn should reuse the restored prompt");
+    printf("✅ Resumed from disk: %llu of %llu prompt tokens reused\n",
+           (unsigned long long)(after.n_prompt_tokens_reused - before.n_prompt_tokens_reused),
+           (unsigned long long)(after.n_prompt_tokens - before.n_prompt_tokens));
+
+    // Cleanup
+    wasi_close_execution_context(backend_ctx, first_ctx);
+    wasi_close_execution_context(backend_ctx, second_ctx);
+    wasi_deinit_backend(backend_ctx);
+
+    return 1;
+}